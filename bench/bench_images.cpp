@@ -0,0 +1,63 @@
+#include "bench_images.h"
+
+#include <cstdio>
+#include <map>
+#include <tuple>
+
+#include "bmp_generator.h"
+
+namespace bench {
+namespace {
+using namespace bmp;
+
+GeneratorOptions GetGeneratorOptions(ImageParams const& params) {
+    return {.width = static_cast<DWord>(params.width),
+            .height = static_cast<DWord>(params.height),
+            .bit_count = params.bit_count,
+            .bottom_up = params.bottom_up,
+            .compression = params.compression,
+            .pattern = params.compression == util::Compression::RLE8 ||
+                                       params.compression == util::Compression::RLE4
+                               ? Pattern::kGlyphs
+                               : Pattern::kRandom};
+}
+
+/// @brief Owns generated files
+class ImageCache {
+private:
+    std::map<std::tuple<Long, Long, Word, bool, util::Compression>, std::string> files_;
+
+public:
+    std::string const& Get(ImageParams const& params) {
+        auto const key = std::tuple{params.width, params.height, params.bit_count,
+                                    params.bottom_up, params.compression};
+        auto it = files_.find(key);
+        if (it == files_.end()) {
+            std::string filename = "bench_" + std::to_string(params.width) + "x" +
+                                   std::to_string(params.height) + "_" +
+                                   std::to_string(params.bit_count) +
+                                   (params.bottom_up ? "_bu" : "_td") + "_" +
+                                   std::to_string(static_cast<int>(params.compression)) + ".bmp";
+            BMPGenerator{GetGeneratorOptions(params)}.Write(filename);
+            it = files_.emplace(key, std::move(filename)).first;
+        }
+        return it->second;
+    }
+
+    ~ImageCache() {
+        for (auto const& [_, filename] : files_) {
+            std::remove(filename.c_str());
+        }
+    }
+};
+}  // namespace
+
+std::size_t GetPixelDataSize(ImageParams const& params) {
+    return BMPGenerator{GetGeneratorOptions(params)}.GetFullScanSize() * params.height;
+}
+
+std::string const& GetBenchImage(ImageParams const& params) {
+    static ImageCache cache;
+    return cache.Get(params);
+}
+}  // namespace bench
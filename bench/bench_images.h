@@ -0,0 +1,25 @@
+#pragma once
+
+#include <string>
+
+#include "util/field_types.h"
+#include "util/ms_constants.h"
+
+namespace bench {
+/// @brief Parameters of generated input image
+struct ImageParams {
+    bmp::Long width;
+    bmp::Long height;
+    bmp::Word bit_count;
+    bool bottom_up = true;
+    // RLE images have text-like content, others are random
+    bmp::util::Compression compression = bmp::util::Compression::RGB;
+};
+
+/// @brief Get filename of BMP with random pixels.
+/// Image is generated on first request and removed when benchmark exits
+std::string const& GetBenchImage(ImageParams const& params);
+
+/// @brief Size of uncompressed pixel data (bytes), including padding
+std::size_t GetPixelDataSize(ImageParams const& params);
+}  // namespace bench
@@ -0,0 +1,121 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <string>
+
+#include "bench_images.h"
+#include "bmp_reader.h"
+#include "decoded_image.h"
+#include "image_editor.h"
+#include "reader_options.h"
+#include "util/field_types.h"
+
+namespace {
+using namespace bmp;
+
+constexpr char kOutputFilename[] = "bench_output.bmp";
+
+/// @brief Cross over the whole image, i.e. both diagonals
+void DrawDiagonals(BMPReader& reader) {
+    auto const& fields = reader.GetImportantFields();
+    reader.DrawCross(0, 0, fields.width - 1, fields.height - 1);
+}
+
+/// @brief Arguments: {size, bit_count}
+void Sizes(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"size", "bpp"});
+    for (long size : {10, 100, 1000, 4000, 20000}) {
+        for (long bit_count : {24, 32}) {
+            b->Args({size, bit_count});
+        }
+    }
+}
+
+void BM_DrawCross(benchmark::State& state) {
+    bench::ImageParams const params{static_cast<Long>(state.range(0)),
+                                    static_cast<Long>(state.range(0)),
+                                    static_cast<Word>(state.range(1))};
+    BMPReader reader{bench::GetBenchImage(params)};
+    reader.ReadHeaders();
+    reader.ReadData();
+    for (auto _ : state) {
+        DrawDiagonals(reader);
+        benchmark::ClobberMemory();
+    }
+    // Pixels on both diagonals
+    state.counters["pixels"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * 2 * params.width,
+            benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_DrawCross)->Apply(Sizes)->Unit(benchmark::kMicrosecond);
+
+template <SaveMode kMode>
+void BM_SaveBMP(benchmark::State& state) {
+    bench::ImageParams const params{static_cast<Long>(state.range(0)),
+                                    static_cast<Long>(state.range(0)),
+                                    static_cast<Word>(state.range(1))};
+    std::string const& filename = bench::GetBenchImage(params);
+    BMPReader reader{filename};
+    reader.ReadHeaders();
+    reader.ReadData();
+    // Incremental and in-place saves need existing output
+    reader.SaveBMP(kOutputFilename);
+    for (auto _ : state) {
+        DrawDiagonals(reader);
+        reader.SaveBMP(kOutputFilename, kMode);
+    }
+    std::remove(kOutputFilename);
+    if constexpr (kMode == SaveMode::kFull) {
+        state.SetBytesProcessed(state.iterations() * bench::GetPixelDataSize(params));
+    }
+    state.counters["pixels"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * params.width * params.height,
+            benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_SaveBMP<SaveMode::kFull>)->Apply(Sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SaveBMP<SaveMode::kIncremental>)->Apply(Sizes)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SaveBMP<SaveMode::kInPlace>)->Apply(Sizes)->Unit(benchmark::kMillisecond);
+
+/// @brief Arguments: {size, variants}
+void Variants(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"size", "variants"});
+    for (long size : {100, 1000, 4000}) {
+        for (long variants : {1, 8, 32}) {
+            b->Args({size, variants});
+        }
+    }
+}
+
+/// @brief Annotate one image with @c variants different crosses: @p kShared decodes the image once
+/// and draws with editors, otherwise every variant is read and drawn by a reader
+template <bool kShared>
+void BM_AnnotationVariants(benchmark::State& state) {
+    bench::ImageParams const params{static_cast<Long>(state.range(0)),
+                                    static_cast<Long>(state.range(0)), 24};
+    std::string const& filename = bench::GetBenchImage(params);
+    auto const variants = static_cast<DWord>(state.range(1));
+    DWord const size = static_cast<DWord>(params.width);
+    BMPReader reader;
+    for (auto _ : state) {
+        if constexpr (kShared) {
+            auto const image = DecodedImage::Decode(filename);
+            for (DWord i = 0; i < variants; ++i) {
+                ImageEditor editor{image};
+                editor.DrawCross(i % size, 0, size - 1, size - 1 - i % size);
+                benchmark::DoNotOptimize(editor.GetEditedTileCount());
+            }
+        } else {
+            for (DWord i = 0; i < variants; ++i) {
+                reader.Open(filename);
+                reader.ReadHeaders();
+                reader.ReadData();
+                reader.DrawCross(i % size, 0, size - 1, size - 1 - i % size);
+                benchmark::ClobberMemory();
+            }
+        }
+    }
+    state.counters["variants"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * variants, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_AnnotationVariants<false>)->Apply(Variants)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AnnotationVariants<true>)->Apply(Variants)->Unit(benchmark::kMillisecond);
+}  // namespace
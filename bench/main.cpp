@@ -0,0 +1,4 @@
+#include <benchmark/benchmark.h>
+
+// Results can be saved in JSON with --benchmark_out=<file> --benchmark_out_format=json
+BENCHMARK_MAIN();
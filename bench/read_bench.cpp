@@ -0,0 +1,300 @@
+#include <benchmark/benchmark.h>
+#include <fstream>
+
+#include "bench_images.h"
+#include "bmp_probe.h"
+#include "bmp_reader.h"
+#include "decode_cache.h"
+#include "reader_options.h"
+#include "util/color.h"
+#include "util/field_types.h"
+
+namespace {
+using namespace bmp;
+
+/// @brief Decode arguments {width, height, bit_count, bottom_up}
+bench::ImageParams GetImageParams(benchmark::State const& state) {
+    return {static_cast<Long>(state.range(0)), static_cast<Long>(state.range(1)),
+            static_cast<Word>(state.range(2)), state.range(3) != 0};
+}
+
+void SetThroughput(benchmark::State& state, bench::ImageParams const& params) {
+    state.SetBytesProcessed(state.iterations() * bench::GetPixelDataSize(params));
+    state.counters["pixels"] = benchmark::Counter(
+            static_cast<double>(state.iterations()) * params.width * params.height,
+            benchmark::Counter::kIsRate);
+}
+
+/// @brief Square images from 10x10 up to 20000x20000, both depths and row orders
+void SizesAndFormats(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"w", "h", "bpp", "bottom_up"});
+    for (long size : {10, 100, 1000, 4000, 20000}) {
+        for (long bit_count : {24, 32}) {
+            for (long bottom_up : {1, 0}) {
+                b->Args({size, size, bit_count, bottom_up});
+            }
+        }
+    }
+}
+
+/// @brief 24-bit images with 0, 1, 2 and 3 padding bytes per scan
+void PaddingCases(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"w", "h", "bpp", "bottom_up"});
+    for (long width : {1000, 1003, 1002, 1001}) {
+        b->Args({width, 1000, 24, 1});
+    }
+}
+
+void BM_ReadHeaders(benchmark::State& state) {
+    auto const params = GetImageParams(state);
+    std::string const& filename = bench::GetBenchImage(params);
+    for (auto _ : state) {
+        BMPReader reader{filename};
+        reader.ReadHeaders();
+        benchmark::DoNotOptimize(reader.GetImportantFields());
+    }
+}
+BENCHMARK(BM_ReadHeaders)->Apply(SizesAndFormats)->Unit(benchmark::kMicrosecond);
+
+void BM_ProbeBMP(benchmark::State& state) {
+    std::string const& filename = bench::GetBenchImage(GetImageParams(state));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ProbeBMP(filename));
+    }
+}
+BENCHMARK(BM_ProbeBMP)->Apply(SizesAndFormats)->Unit(benchmark::kMicrosecond);
+
+template <InputMode kMode>
+void BM_ReadData(benchmark::State& state) {
+    auto const params = GetImageParams(state);
+    std::string const& filename = bench::GetBenchImage(params);
+    for (auto _ : state) {
+        BMPReader reader{filename, {.input_mode = kMode}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        benchmark::DoNotOptimize(reader.GetPixelData());
+    }
+    SetThroughput(state, params);
+}
+BENCHMARK(BM_ReadData<InputMode::kStream>)
+        ->Apply(SizesAndFormats)
+        ->Apply(PaddingCases)
+        ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ReadData<InputMode::kMapped>)
+        ->Apply(SizesAndFormats)
+        ->Apply(PaddingCases)
+        ->Unit(benchmark::kMillisecond);
+
+/// @brief Indexed images. Arguments: {size, bit_count, rle}
+void BM_ReadIndexed(benchmark::State& state) {
+    bool const rle = state.range(2) != 0;
+    bench::ImageParams const params{
+            .width = static_cast<Long>(state.range(0)),
+            .height = static_cast<Long>(state.range(0)),
+            .bit_count = static_cast<Word>(state.range(1)),
+            .compression = !rle                 ? util::Compression::RGB
+                           : state.range(1) == 8 ? util::Compression::RLE8
+                                                 : util::Compression::RLE4};
+    std::string const& filename = bench::GetBenchImage(params);
+    for (auto _ : state) {
+        BMPReader reader{filename};
+        reader.ReadHeaders();
+        reader.ReadData();
+        benchmark::DoNotOptimize(reader.GetPixelData());
+    }
+    SetThroughput(state, params);
+}
+BENCHMARK(BM_ReadIndexed)
+        ->ArgNames({"size", "bpp", "rle"})
+        ->ArgsProduct({{1000, 4000, 20000}, {1, 4, 8}, {0}})
+        ->ArgsProduct({{1000, 4000, 20000}, {4, 8}, {1}})
+        ->Unit(benchmark::kMillisecond);
+
+/// @brief 16 and 32-bit images with implicit or BITFIELDS masks (RGB565 for 16-bit).
+/// Arguments: {size, bit_count, bitfields}
+void BM_ReadBitfields(benchmark::State& state) {
+    bench::ImageParams const params{
+            .width = static_cast<Long>(state.range(0)),
+            .height = static_cast<Long>(state.range(0)),
+            .bit_count = static_cast<Word>(state.range(1)),
+            .compression = state.range(2) != 0 ? util::Compression::BITFIELDS
+                                               : util::Compression::RGB};
+    std::string const& filename = bench::GetBenchImage(params);
+    for (auto _ : state) {
+        BMPReader reader{filename};
+        reader.ReadHeaders();
+        reader.ReadData();
+        benchmark::DoNotOptimize(reader.GetPixelData());
+    }
+    SetThroughput(state, params);
+}
+BENCHMARK(BM_ReadBitfields)
+        ->ArgNames({"size", "bpp", "bitfields"})
+        ->ArgsProduct({{1000, 4000}, {16, 32}, {0, 1}})
+        ->Unit(benchmark::kMillisecond);
+
+/// @brief Threshold modes on 24-bit images. Arguments: {size, mode}
+void BM_ReadThreshold(benchmark::State& state) {
+    bench::ImageParams const params{static_cast<Long>(state.range(0)),
+                                    static_cast<Long>(state.range(0)), 24};
+    std::string const& filename = bench::GetBenchImage(params);
+    ReaderOptions const options{.input_mode = InputMode::kMapped,
+                                .threshold = {.mode = static_cast<ThresholdMode>(state.range(1))}};
+    for (auto _ : state) {
+        BMPReader reader{filename, options};
+        reader.ReadHeaders();
+        reader.ReadData();
+        benchmark::DoNotOptimize(reader.GetPixelData());
+    }
+    SetThroughput(state, params);
+}
+BENCHMARK(BM_ReadThreshold)
+        ->ArgNames({"size", "mode"})
+        ->ArgsProduct({{1000, 4000},
+                       {static_cast<long>(ThresholdMode::kFixed),
+                        static_cast<long>(ThresholdMode::kLuma),
+                        static_cast<long>(ThresholdMode::kOtsu),
+                        static_cast<long>(ThresholdMode::kAdaptive)}})
+        ->Unit(benchmark::kMillisecond);
+
+/// @brief Region of interest of 4000x4000 24-bit image. Arguments: {region size, input mode}
+void BM_ReadRegion(benchmark::State& state) {
+    bench::ImageParams const params{4000, 4000, 24};
+    std::string const& filename = bench::GetBenchImage(params);
+    auto const size = static_cast<DWord>(state.range(0));
+    ReaderOptions const options{.input_mode = static_cast<InputMode>(state.range(1))};
+    for (auto _ : state) {
+        BMPReader reader{filename, options};
+        reader.ReadHeaders();
+        benchmark::DoNotOptimize(reader.ReadRegion(1000, 1000, size, size));
+    }
+    SetThroughput(state, {static_cast<Long>(size), static_cast<Long>(size), 24});
+}
+BENCHMARK(BM_ReadRegion)
+        ->ArgNames({"size", "mode"})
+        ->ArgsProduct({{64, 512, 3000},
+                       {static_cast<long>(InputMode::kStream),
+                        static_cast<long>(InputMode::kMapped)}})
+        ->Unit(benchmark::kMillisecond);
+
+/// @brief Stream mode with reads overlapping decoding. Arguments: {read-ahead, queue depth}
+void BM_ReadAhead(benchmark::State& state) {
+    bench::ImageParams const params{4000, 4000, 24};
+    std::string const& filename = bench::GetBenchImage(params);
+    ReaderOptions const options{.block_size = 1 << 20,
+                                .read_ahead = static_cast<ReadAhead>(state.range(0)),
+                                .queue_depth = static_cast<std::size_t>(state.range(1))};
+    for (auto _ : state) {
+        BMPReader reader{filename, options};
+        reader.ReadHeaders();
+        reader.ReadData();
+        benchmark::DoNotOptimize(reader.GetPixelData());
+    }
+    SetThroughput(state, params);
+}
+BENCHMARK(BM_ReadAhead)
+        ->ArgNames({"read_ahead", "depth"})
+        ->Args({static_cast<long>(ReadAhead::kNone), 1})
+        ->ArgsProduct({{static_cast<long>(ReadAhead::kIOUring),
+                        static_cast<long>(ReadAhead::kThread)},
+                       {2, 4, 8}})
+        ->Unit(benchmark::kMillisecond);
+
+/// @brief Many small images: a new reader per image vs one reused reader. Arguments: {size, reuse}
+void BM_ReuseReader(benchmark::State& state) {
+    bench::ImageParams const params{static_cast<Long>(state.range(0)),
+                                    static_cast<Long>(state.range(0)), 24};
+    std::string const& filename = bench::GetBenchImage(params);
+    BMPReader reused;
+    for (auto _ : state) {
+        if (state.range(1) != 0) {
+            reused.Open(filename);
+            reused.ReadHeaders();
+            reused.ReadData();
+            benchmark::DoNotOptimize(reused.GetPixelData());
+        } else {
+            BMPReader reader{filename};
+            reader.ReadHeaders();
+            reader.ReadData();
+            benchmark::DoNotOptimize(reader.GetPixelData());
+        }
+    }
+    SetThroughput(state, params);
+}
+BENCHMARK(BM_ReuseReader)
+        ->ArgNames({"size", "reuse"})
+        ->ArgsProduct({{10, 100, 1000}, {0, 1}})
+        ->Unit(benchmark::kMicrosecond);
+
+/// @brief ReadData that is served by decode cache vs decoding. Arguments: {size, cached}
+void BM_DecodeCache(benchmark::State& state) {
+    bench::ImageParams const params{static_cast<Long>(state.range(0)),
+                                    static_cast<Long>(state.range(0)), 24};
+    std::string const& filename = bench::GetBenchImage(params);
+    DecodeCache cache;
+    BMPReader reader{{.decode_cache = state.range(1) != 0 ? &cache : nullptr}};
+    for (auto _ : state) {
+        reader.Open(filename);
+        reader.ReadHeaders();
+        reader.ReadData();
+        benchmark::DoNotOptimize(reader.GetPixelData());
+    }
+    SetThroughput(state, params);
+}
+BENCHMARK(BM_DecodeCache)
+        ->ArgNames({"size", "cached"})
+        ->ArgsProduct({{100, 1000, 4000}, {0, 1}})
+        ->Unit(benchmark::kMicrosecond);
+
+constexpr bench::ImageParams kBlockReadParams{2001, 2000, 24};
+
+/// @brief Reference: one istream::read per pixel, as ReadData used to do
+void BM_PerPixelIstreamRead(benchmark::State& state) {
+    std::string const& filename = bench::GetBenchImage(kBlockReadParams);
+    std::size_t read_calls = 0;
+    for (auto _ : state) {
+        BMPReader reader{filename};
+        reader.ReadHeaders();
+        auto const& fields = reader.GetImportantFields();
+
+        std::ifstream ifs{filename, std::ios::binary};
+        ifs.seekg(fields.offset);
+        util::RGBColor color;
+        for (std::size_t scan_num = 0; scan_num < fields.height; ++scan_num) {
+            for (std::size_t x = 0; x < fields.width; ++x) {
+                ifs.read(reinterpret_cast<char*>(&color), sizeof(color));
+                ++read_calls;
+            }
+            ifs.ignore(fields.padding_bytes);
+            ++read_calls;
+        }
+        benchmark::DoNotOptimize(color);
+    }
+    state.counters["read_calls"] =
+            benchmark::Counter(read_calls, benchmark::Counter::kAvgIterations);
+    SetThroughput(state, kBlockReadParams);
+}
+BENCHMARK(BM_PerPixelIstreamRead)->Unit(benchmark::kMillisecond);
+
+/// @brief Stream mode ReadData with different block sizes (argument, bytes)
+void BM_BlockRead(benchmark::State& state) {
+    std::string const& filename = bench::GetBenchImage(kBlockReadParams);
+    std::size_t read_calls = 0;
+    for (auto _ : state) {
+        BMPReader reader{filename, {.block_size = static_cast<std::size_t>(state.range(0))}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        read_calls += reader.GetIOCounters().read_calls;
+    }
+    state.counters["read_calls"] =
+            benchmark::Counter(read_calls, benchmark::Counter::kAvgIterations);
+    SetThroughput(state, kBlockReadParams);
+}
+// 1 byte means one scan per call
+BENCHMARK(BM_BlockRead)
+        ->Arg(1)
+        ->Arg(64 << 10)
+        ->Arg(1 << 20)
+        ->Arg(16 << 20)
+        ->Unit(benchmark::kMillisecond);
+}  // namespace
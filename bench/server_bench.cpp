@@ -0,0 +1,49 @@
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "bench_images.h"
+#include "server.h"
+#include "util/field_types.h"
+
+namespace {
+using namespace bmp;
+
+constexpr char kSocketPath[] = "bench_server.sock";
+constexpr char kOutputFilename[] = "bench_server_output.bmp";
+
+/// @brief Latency of one request to a warm server. Arguments: {size, in flight}.
+/// With more requests in flight they are pipelined, time is still per request
+void BM_ServerRequest(benchmark::State& state) {
+    bench::ImageParams const params{static_cast<Long>(state.range(0)),
+                                    static_cast<Long>(state.range(0)), 24};
+    auto const in_flight = static_cast<std::size_t>(state.range(1));
+    std::string const request = bench::GetBenchImage(params) + ",0,0," +
+                                std::to_string(params.width - 1) + ',' +
+                                std::to_string(params.height - 1) + ',' + kOutputFilename;
+
+    Server server{{.socket_path = kSocketPath, .thread_count = 1}};
+    std::thread server_thread{[&] { server.Run(); }};
+    {
+        ServerClient client{kSocketPath};
+        for (auto _ : state) {
+            for (std::size_t i = 0; i < in_flight; ++i) {
+                client.Send(request);
+            }
+            for (std::size_t i = 0; i < in_flight; ++i) {
+                benchmark::DoNotOptimize(client.Receive());
+            }
+        }
+    }
+    server.Stop();
+    server_thread.join();
+    state.SetItemsProcessed(state.iterations() * in_flight);
+    std::remove(kOutputFilename);
+}
+BENCHMARK(BM_ServerRequest)
+        ->ArgNames({"size", "in_flight"})
+        ->ArgsProduct({{10, 100, 1000}, {1, 8}})
+        ->UseRealTime()
+        ->Unit(benchmark::kMicrosecond);
+}  // namespace
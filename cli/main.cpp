@@ -1,31 +1,129 @@
+#include <algorithm>
+#include <csignal>
 #include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <optional>
+#include <string>
 #include <vector>
 
+#include "batch.h"
+#include "binary_image.h"
 #include "bmp_reader.h"
+#include "decode_cache.h"
+#include "reader_stats.h"
+#include "server.h"
 #include "util/field_types.h"
 
 constexpr static char help[] = R"(BMP Reader
-Usage: BMPReader_cli filename x1 y1 x2 y2 new_filename
-OR BMPReader_cli
+Usage: BMPReader_cli [--stats[=json]] filename x1 y1 x2 y2 new_filename
+OR BMPReader_cli [--stats[=json]]
+OR BMPReader_cli [--stats[=json]] [--threads=N] [--cache[=dir]] --batch[=manifest]
+OR BMPReader_cli [--threads=N] [--cache[=dir]] --serve=socket_path
 
 If arguments are not specified, you will be prompted to enter them.
+--stats prints time, I/O and allocations of every phase to stderr (as JSON with --stats=json).
+    With --batch, CPU time and allocations are printed once for the whole batch.
+--batch reads jobs from manifest (stdin if it is not given or "-"), one per line: either CSV
+    input,x1,y1,x2,y2,output
+or JSON
+    {"input": "in.bmp", "cross": [x1, y1, x2, y2], "output": "out.bmp"}
+Jobs run in parallel on N threads (default: all cores), images are not printed. Status of
+every job and total throughput are printed to stdout.
+--serve runs until SIGINT or SIGTERM, taking the same jobs as framed requests over Unix domain
+socket (see src/server.h for the protocol).
+--cache keeps decoded images in memory (--cache-budget=MiB, 256 by default) and, if dir is given,
+in dir, so that inputs that were already decoded with the same threshold are not decoded again.
 )";
 
-void PrintPixelData(std::vector<std::vector<bool>> const& data) {
-    for (auto const& scan : data) {
-        for (auto px : scan) {
-            if (px) {
-                std::cout << '#';
-            } else {
-                std::cout << '.';
+void PrintPixelData(bmp::BinaryImage const& data) {
+    std::string line(data.GetWidth(), '.');
+    for (std::size_t y = 0; y < data.GetHeight(); ++y) {
+        auto const* words = data.GetRow(y);
+        for (std::size_t word_num = 0; word_num < data.GetStride(); ++word_num) {
+            auto const x_begin = word_num * bmp::BinaryImage::kBitsPerWord;
+            auto const x_end = std::min(x_begin + bmp::BinaryImage::kBitsPerWord, line.size());
+            for (auto x = x_begin; x < x_end; ++x) {
+                line[x] = (words[word_num] >> (x - x_begin)) & 1 ? '#' : '.';
             }
         }
-        std::cout << '\n';
+        std::cout << line << '\n';
     }
 }
 
+// Run jobs of manifest, return exit code
+int RunBatchMode(std::istream& manifest, bmp::BatchOptions const& options, bool print_stats,
+                 bool stats_json) {
+    std::vector<bmp::BatchJob> jobs;
+    try {
+        jobs = bmp::ParseManifest(manifest);
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+
+    bmp::BatchSummary const summary = bmp::RunBatch(
+            jobs, options,
+            [&](std::size_t job_num, bmp::JobResult const& result) {
+                bmp::BatchJob const& job = jobs[job_num];
+                if (result.error.empty()) {
+                    std::cout << "ok     " << job.input << " -> " << job.output << " ("
+                              << std::fixed << std::setprecision(3) << result.wall_ns / 1e6
+                              << " ms, thread " << result.thread << ")\n";
+                } else {
+                    std::cout << "FAILED " << job.input << ": " << result.error << '\n';
+                }
+            });
+    bmp::PrintBatchSummary(std::cout, summary);
+    if (bmp::DecodeCache const* cache = options.reader_options.decode_cache) {
+        bmp::DecodeCacheStats const cache_stats = cache->GetStats();
+        std::cout << "decode cache: " << cache_stats.memory_hits << " memory hits, "
+                  << cache_stats.disk_hits << " disk hits, " << cache_stats.misses
+                  << " misses\n";
+    }
+    if (print_stats) {
+        bmp::PrintBatchStats(std::cerr, summary, stats_json);
+    }
+    return summary.failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+bmp::Server* g_server = nullptr;
+
+void StopServer(int) {
+    g_server->Stop();
+}
+
+// Serve requests on socket_path until interrupted, return exit code
+int RunServerMode(std::string const& socket_path, bmp::BatchOptions const& options) {
+    try {
+        bmp::Server server{{.socket_path = socket_path,
+                            .thread_count = options.thread_count,
+                            .job_options = options}};
+        g_server = &server;
+        struct sigaction action{};
+        action.sa_handler = StopServer;
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        std::cerr << "Serving on " << socket_path << " with " << server.GetThreadCount()
+                  << " threads\n";
+        server.Run();
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        g_server = nullptr;
+    } catch (std::exception const& e) {
+        std::cerr << e.what() << '\n';
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 // Arguments:
+//	- optional --stats or --stats=json
+//	- optional --batch or --batch=manifest and --threads=N: see RunBatchMode
+//	- optional --serve=socket_path and --threads=N: see RunServerMode
+//	- optional --cache, --cache=dir and --cache-budget=MiB
 // 	- input BMP filename
 //	- coordinates of cross (x1, y1, x2, y2)
 //	- filename to save edited BMP
@@ -33,17 +131,87 @@ void PrintPixelData(std::vector<std::vector<bool>> const& data) {
 int main(int argc, char** argv) {
     std::string filename, new_filename;
     bmp::DWord x1, y1, x2, y2;
-    if (argc == 7) {
-        filename = argv[1];
-        if (filename == "-h" || filename == "--help") {
+    bool print_stats = false, stats_json = false;
+    bool batch = false;
+    std::string manifest_filename = "-";
+    std::size_t thread_count = 0;
+    std::string socket_path;
+    bool use_cache = false;
+    bmp::DecodeCacheOptions cache_options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
             std::cout << help;
             return EXIT_SUCCESS;
         }
-        x1 = std::atoi(argv[2]);
-        y1 = std::atoi(argv[3]);
-        x2 = std::atoi(argv[4]);
-        y2 = std::atoi(argv[5]);
-        new_filename = argv[6];
+        if (arg == "--stats" || arg == "--stats=json") {
+            print_stats = true;
+            stats_json = arg == "--stats=json";
+        } else if (arg == "--batch" || arg.starts_with("--batch=")) {
+            batch = true;
+            if (arg != "--batch") {
+                manifest_filename = arg.substr(std::string{"--batch="}.size());
+            }
+        } else if (arg.starts_with("--serve=")) {
+            socket_path = arg.substr(std::string{"--serve="}.size());
+        } else if (arg == "--cache" || arg.starts_with("--cache=")) {
+            use_cache = true;
+            if (arg != "--cache") {
+                cache_options.directory = arg.substr(std::string{"--cache="}.size());
+            }
+        } else if (arg.starts_with("--cache-budget=")) {
+            cache_options.memory_budget =
+                    std::size_t(std::atoll(arg.c_str() + std::string{"--cache-budget="}.size()))
+                    << 20;
+        } else if (arg.starts_with("--threads=")) {
+            thread_count = std::atoi(arg.c_str() + std::string{"--threads="}.size());
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (print_stats && !bmp::kStatsEnabled) {
+        std::cerr << "Statistics are disabled, rebuild with -D ENABLE_STATS=ON\n";
+        print_stats = false;
+    }
+    // Allocations are counted by counting_new.cpp, only for --stats
+    bmp::EnableAllocationCounting(print_stats);
+
+    std::optional<bmp::DecodeCache> cache;
+    if (use_cache) {
+        try {
+            cache.emplace(cache_options);
+        } catch (std::exception const& e) {
+            std::cerr << e.what() << '\n';
+            return EXIT_FAILURE;
+        }
+    }
+    bmp::BatchOptions const options{
+            .thread_count = thread_count,
+            .reader_options = {.decode_cache = cache ? &*cache : nullptr}};
+
+    if (!socket_path.empty()) {
+        return RunServerMode(socket_path, options);
+    }
+    if (batch) {
+        if (manifest_filename == "-") {
+            return RunBatchMode(std::cin, options, print_stats, stats_json);
+        }
+        std::ifstream manifest{manifest_filename};
+        if (!manifest) {
+            std::cerr << "Cannot open manifest " << manifest_filename << '\n';
+            return EXIT_FAILURE;
+        }
+        return RunBatchMode(manifest, options, print_stats, stats_json);
+    }
+
+    if (args.size() == 6) {
+        filename = args[0];
+        x1 = std::atoi(args[1].c_str());
+        y1 = std::atoi(args[2].c_str());
+        x2 = std::atoi(args[3].c_str());
+        y2 = std::atoi(args[4].c_str());
+        new_filename = args[5];
     } else {
         std::cout << "Input BMP filename: ";
         std::cin >> filename;
@@ -59,7 +227,7 @@ int main(int argc, char** argv) {
         std::cin >> new_filename;
     }
 
-    bmp::BMPReader reader{filename};
+    bmp::BMPReader reader{filename, options.reader_options};
     reader.ReadHeaders();
     reader.ReadData();
 
@@ -71,4 +239,8 @@ int main(int argc, char** argv) {
     PrintPixelData(reader.GetPixelData());
 
     reader.SaveBMP(new_filename);
+
+    if (print_stats) {
+        bmp::PrintStats(std::cerr, reader.GetStats(), stats_json);
+    }
 }
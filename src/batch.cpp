@@ -0,0 +1,391 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <ios>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "bmp_reader.h"
+#include "util/manifest_error.h"
+#include "util/work_stealing_pool.h"
+
+namespace bmp {
+
+using namespace util;
+
+namespace {
+std::string_view Trim(std::string_view str) {
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front()))) {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back()))) {
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+DWord ParseCoordinate(std::string_view str, std::size_t line_num) {
+    str = Trim(str);
+    DWord value = 0;
+    auto const [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+    if (ec != std::errc{} || end != str.data() + str.size()) {
+        throw ManifestError(line_num, "invalid coordinate \"" + std::string{str} + '"');
+    }
+    return value;
+}
+
+/// @brief Split CSV line. Quoted fields may contain commas, "" stands for a quote
+std::vector<std::string> SplitCSV(std::string_view line, std::size_t line_num) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (std::size_t i = 0; i < line.size(); ++i) {
+        char const c = line[i];
+        if (quoted) {
+            if (c != '"') {
+                fields.back() += c;
+            } else if (i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                ++i;
+            } else {
+                quoted = false;
+            }
+        } else if (c == '"' && Trim(fields.back()).empty()) {
+            fields.back().clear();
+            quoted = true;
+        } else if (c == ',') {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
+    }
+    if (quoted) {
+        throw ManifestError(line_num, "unterminated quote");
+    }
+    return fields;
+}
+
+BatchJob ParseCSVLine(std::string_view line, std::size_t line_num) {
+    std::vector<std::string> const fields = SplitCSV(line, line_num);
+    if (fields.size() != 6) {
+        throw ManifestError(line_num, "expected 6 fields, got " + std::to_string(fields.size()));
+    }
+    return {std::string{Trim(fields[0])},        ParseCoordinate(fields[1], line_num),
+            ParseCoordinate(fields[2], line_num), ParseCoordinate(fields[3], line_num),
+            ParseCoordinate(fields[4], line_num), std::string{Trim(fields[5])}};
+}
+
+constexpr std::pair<char const*, InputMode> kInputModes[] = {{"stream", InputMode::kStream},
+                                                             {"mapped", InputMode::kMapped}};
+constexpr std::pair<char const*, ThresholdMode> kThresholdModes[] = {
+        {"fixed", ThresholdMode::kFixed},
+        {"luma", ThresholdMode::kLuma},
+        {"otsu", ThresholdMode::kOtsu},
+        {"adaptive", ThresholdMode::kAdaptive}};
+constexpr std::pair<char const*, SaveMode> kSaveModes[] = {{"full", SaveMode::kFull},
+                                                           {"incremental", SaveMode::kIncremental},
+                                                           {"in_place", SaveMode::kInPlace}};
+
+/// @brief Parser of flat JSON object with string, number and array-of-numbers values
+class JSONLineParser {
+private:
+    std::string_view text_;
+    std::size_t pos_ = 0;
+    std::size_t line_num_;
+
+    [[noreturn]] void Fail(std::string const& msg) const {
+        throw ManifestError(line_num_, msg + " at column " + std::to_string(pos_ + 1));
+    }
+
+    void SkipSpaces() {
+        while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) {
+            ++pos_;
+        }
+    }
+
+    bool Consume(char c) {
+        SkipSpaces();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void Expect(char c) {
+        if (!Consume(c)) {
+            Fail(std::string{"expected '"} + c + '\'');
+        }
+    }
+
+    std::string ParseString() {
+        Expect('"');
+        std::string str;
+        while (pos_ < text_.size() && text_[pos_] != '"') {
+            char c = text_[pos_++];
+            if (c == '\\') {
+                if (pos_ == text_.size()) {
+                    break;
+                }
+                switch (text_[pos_++]) {
+                    case '"':
+                        c = '"';
+                        break;
+                    case '\\':
+                        c = '\\';
+                        break;
+                    case '/':
+                        c = '/';
+                        break;
+                    case 't':
+                        c = '\t';
+                        break;
+                    case 'n':
+                        c = '\n';
+                        break;
+                    default:
+                        Fail("unsupported escape sequence");
+                }
+            }
+            str += c;
+        }
+        Expect('"');
+        return str;
+    }
+
+    DWord ParseNumber() {
+        SkipSpaces();
+        std::size_t const begin = pos_;
+        while (pos_ < text_.size() && std::isdigit(static_cast<unsigned char>(text_[pos_]))) {
+            ++pos_;
+        }
+        if (begin == pos_) {
+            Fail("expected number");
+        }
+        return ParseCoordinate(text_.substr(begin, pos_ - begin), line_num_);
+    }
+
+    template <typename Enum, std::size_t N>
+    Enum ParseEnum(std::pair<char const*, Enum> const (&names)[N]) {
+        std::string const name = ParseString();
+        for (auto const& [enum_name, value] : names) {
+            if (name == enum_name) {
+                return value;
+            }
+        }
+        Fail("unknown value \"" + name + '"');
+    }
+
+public:
+    JSONLineParser(std::string_view text, std::size_t line_num)
+        : text_(text), line_num_(line_num) {}
+
+    BatchJob Parse() {
+        BatchJob job;
+        // input, output and four coordinates
+        unsigned seen = 0;
+        auto mark = [&](unsigned bits) {
+            if (seen & bits) {
+                Fail("duplicate key");
+            }
+            seen |= bits;
+        };
+        Expect('{');
+        if (!Consume('}')) {
+            do {
+                std::string const key = ParseString();
+                Expect(':');
+                if (key == "input") {
+                    mark(1);
+                    job.input = ParseString();
+                } else if (key == "output") {
+                    mark(2);
+                    job.output = ParseString();
+                } else if (key == "cross") {
+                    mark(4 | 8 | 16 | 32);
+                    Expect('[');
+                    job.x1 = ParseNumber();
+                    Expect(',');
+                    job.y1 = ParseNumber();
+                    Expect(',');
+                    job.x2 = ParseNumber();
+                    Expect(',');
+                    job.y2 = ParseNumber();
+                    Expect(']');
+                } else if (key == "x1" || key == "y1" || key == "x2" || key == "y2") {
+                    DWord* const coordinates[] = {&job.x1, &job.y1, &job.x2, &job.y2};
+                    std::size_t const index =
+                            (key[0] == 'y' ? 1 : 0) + (key[1] == '2' ? 2 : 0);
+                    mark(4u << index);
+                    *coordinates[index] = ParseNumber();
+                } else if (key == "input_mode") {
+                    job.input_mode = ParseEnum(kInputModes);
+                } else if (key == "threshold") {
+                    job.threshold = ParseEnum(kThresholdModes);
+                } else if (key == "save_mode") {
+                    job.save_mode = ParseEnum(kSaveModes);
+                } else {
+                    Fail("unknown key \"" + key + '"');
+                }
+            } while (Consume(','));
+            Expect('}');
+        }
+        SkipSpaces();
+        if (pos_ != text_.size()) {
+            Fail("unexpected characters");
+        }
+        if (seen != 63) {
+            Fail("input, output and cross coordinates are required");
+        }
+        return job;
+    }
+};
+}  // namespace
+
+BatchJob ParseJob(std::string_view line, std::size_t line_num) {
+    line = Trim(line);
+    if (!line.empty() && line.front() == '{') {
+        return JSONLineParser{line, line_num}.Parse();
+    }
+    return ParseCSVLine(line, line_num);
+}
+
+std::vector<BatchJob> ParseManifest(std::istream& is) {
+    std::vector<BatchJob> jobs;
+    std::string line;
+    for (std::size_t line_num = 1; std::getline(is, line); ++line_num) {
+        std::string_view const trimmed = Trim(line);
+        if (trimmed.empty() || trimmed.front() == '#') {
+            continue;
+        }
+        if (trimmed != "input,x1,y1,x2,y2,output") {
+            jobs.push_back(ParseJob(trimmed, line_num));
+        }
+    }
+    return jobs;
+}
+
+JobResult RunJob(BMPReader& reader, BatchJob const& job, BatchOptions const& options) {
+    JobResult result;
+    auto const start = std::chrono::steady_clock::now();
+    try {
+        ReaderOptions reader_options = options.reader_options;
+        reader_options.input_mode = job.input_mode.value_or(reader_options.input_mode);
+        reader_options.threshold.mode = job.threshold.value_or(reader_options.threshold.mode);
+        reader.SetOptions(reader_options);
+        reader.Open(job.input);
+        result.bytes = reader.GetFileSize();
+        reader.ReadHeaders();
+        reader.ReadData();
+        reader.DrawCross(job.x1, job.y1, job.x2, job.y2);
+        reader.SaveBMP(job.output, job.save_mode.value_or(options.save_mode));
+        ImportantFields const& fields = reader.GetImportantFields();
+        result.pixels = std::uint64_t{fields.width} * fields.height;
+    } catch (std::exception const& e) {
+        result.error = e.what();
+    }
+    result.wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    return result;
+}
+
+BatchSummary RunBatch(std::vector<BatchJob> const& jobs, BatchOptions const& options,
+                      JobCallback on_done) {
+    // Jobs are ordered by input size: the largest are started first, small ones fill the gaps
+    std::vector<std::uint64_t> sizes(jobs.size());
+    for (std::size_t i = 0; i < jobs.size(); ++i) {
+        std::error_code ec;
+        std::uint64_t const size = std::filesystem::file_size(jobs[i].input, ec);
+        sizes[i] = ec ? 0 : size;
+    }
+    std::vector<std::size_t> order(jobs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t lhs, std::size_t rhs) { return sizes[lhs] > sizes[rhs]; });
+
+    WorkStealingPool const pool{options.thread_count};
+    // One reader per thread, buffers are reused from job to job
+    std::vector<std::unique_ptr<BMPReader>> readers(pool.GetThreadCount());
+    BatchSummary summary{.jobs = jobs.size()};
+    std::mutex summary_mutex;
+
+    auto const batch_start = std::chrono::steady_clock::now();
+    {
+        PhaseTimer const timer{summary.batch_stats};
+        pool.Run(order, [&](std::size_t job_num, std::size_t thread) {
+            if (!readers[thread]) {
+                readers[thread] = std::make_unique<BMPReader>(options.reader_options);
+            }
+            JobResult result = RunJob(*readers[thread], jobs[job_num], options);
+            result.thread = thread;
+
+            std::lock_guard lock{summary_mutex};
+            if (result.error.empty()) {
+                summary.bytes += result.bytes;
+                summary.pixels += result.pixels;
+            } else {
+                ++summary.failed;
+            }
+            on_done(job_num, result);
+        });
+    }
+    summary.wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - batch_start)
+                              .count();
+    for (auto const& reader : readers) {
+        if (reader) {
+            summary.stats += reader->GetStats();
+        }
+    }
+    // Every reader has seen CPU time and allocations of all the others
+    for (PhaseStats& phase : summary.stats.phases) {
+        phase.cpu_ns = 0;
+        phase.allocations = 0;
+        phase.allocated_bytes = 0;
+    }
+    return summary;
+}
+
+void PrintBatchSummary(std::ostream& os, BatchSummary const& summary) {
+    std::ios::fmtflags const flags = os.flags();
+    double const seconds = std::max(summary.wall_ns / 1e9, 1e-9);
+    double const mib = summary.bytes / double(1 << 20);
+    double const megapixels = summary.pixels / 1e6;
+    os << std::fixed << std::setprecision(3) << summary.jobs << " jobs, " << summary.failed
+       << " failed, " << mib << " MiB, " << megapixels << " Mpx in " << seconds << " s: "
+       << mib / seconds << " MiB/s, " << megapixels / seconds << " Mpx/s\n";
+    os.flags(flags);
+}
+
+void PrintBatchStats(std::ostream& os, BatchSummary const& summary, bool json) {
+    PhaseStats const& batch = summary.batch_stats;
+    if (json) {
+        std::ostringstream stats;
+        PrintStats(stats, summary.stats, true);
+        std::string text = stats.str();
+        // Closing brace and line break
+        text.resize(text.size() - 2);
+        os << text << ", \"batch\": {\"wall_ns\": " << batch.wall_ns
+           << ", \"cpu_ns\": " << batch.cpu_ns << ", \"allocations\": " << batch.allocations
+           << ", \"allocated_bytes\": " << batch.allocated_bytes << "}}\n";
+        return;
+    }
+    PrintStats(os, summary.stats, false);
+    std::ios::fmtflags const flags = os.flags();
+    os << std::fixed << std::setprecision(3) << "batch:          " << batch.wall_ns / 1e6
+       << " wall ms, " << batch.cpu_ns / 1e6 << " cpu ms, " << batch.allocations << " allocs, "
+       << batch.allocated_bytes << " alloc bytes\n";
+    os.flags(flags);
+}
+}  // namespace bmp
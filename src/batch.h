@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "reader_options.h"
+#include "reader_stats.h"
+#include "util/field_types.h"
+#include "util/function_ref.h"
+
+namespace bmp {
+/// @brief Draw a cross on one BMP and save the result
+struct BatchJob {
+    std::string input;
+    // Bottom-up coordinates, as in BMPReader::DrawCross
+    DWord x1 = 0;
+    DWord y1 = 0;
+    DWord x2 = 0;
+    DWord y2 = 0;
+    std::string output;
+    // Override BatchOptions for this job
+    std::optional<InputMode> input_mode{};
+    std::optional<ThresholdMode> threshold{};
+    std::optional<SaveMode> save_mode{};
+};
+
+class BMPReader;
+
+/// @brief Parse one job. It is either CSV (<tt>input,x1,y1,x2,y2,output</tt>, fields may be
+/// double-quoted) or JSON object
+/// (<tt>{"input": "a.bmp", "cross": [x1, y1, x2, y2], "output": "b.bmp"}</tt>). In JSON
+/// coordinates may also be given as "x1", "y1", "x2" and "y2" keys, and optional keys override
+/// settings: "input_mode" ("stream", "mapped"), "threshold" ("fixed", "luma", "otsu",
+/// "adaptive") and "save_mode" ("full", "incremental", "in_place")
+/// @param line_num -- line number for error messages
+/// @throw ManifestError
+BatchJob ParseJob(std::string_view line, std::size_t line_num = 1);
+
+/// @brief Parse batch manifest, one job per line (see @c ParseJob). Empty lines, lines starting
+/// with '#' and CSV header <tt>input,x1,y1,x2,y2,output</tt> are skipped
+/// @throw ManifestError
+std::vector<BatchJob> ParseManifest(std::istream& is);
+
+/// @brief @c RunBatch settings
+struct BatchOptions {
+    // Number of jobs that run at once (0 means hardware concurrency)
+    std::size_t thread_count = 0;
+    // Options of every reader. Jobs already run in parallel, so decoding is single-threaded
+    // by default
+    ReaderOptions reader_options{};
+    SaveMode save_mode = SaveMode::kFull;
+};
+
+/// @brief Outcome of one job
+struct JobResult {
+    // Empty if the job succeeded
+    std::string error;
+    // Input file size and number of pixels
+    std::uint64_t bytes = 0;
+    std::uint64_t pixels = 0;
+    std::uint64_t wall_ns = 0;
+    // Thread that ran the job
+    std::size_t thread = 0;
+};
+
+/// @brief Run @p job with @p reader (it is reopened, so one reader may run any number of jobs).
+/// Errors are reported in the result, not thrown
+JobResult RunJob(BMPReader& reader, BatchJob const& job, BatchOptions const& options);
+
+/// @brief Totals of all jobs
+struct BatchSummary {
+    std::size_t jobs = 0;
+    std::size_t failed = 0;
+    // Of successful jobs
+    std::uint64_t bytes = 0;
+    std::uint64_t pixels = 0;
+    std::uint64_t wall_ns = 0;
+    // Sum of statistics of all readers. CPU time and allocations are process-wide, so they
+    // cannot be split among jobs that run at once: they are zero in phases, see batch_stats
+    ReaderStats stats{};
+    // Whole batch, measured once: wall and CPU time of the process and its allocations
+    PhaseStats batch_stats{};
+};
+
+/// @brief Called when job @c job (index in jobs) is finished. Calls are never concurrent
+using JobCallback = util::FunctionRef<void(std::size_t, JobResult const&)>;
+
+/// @brief Run all @p jobs on a work-stealing pool. Every thread reuses one @c BMPReader; larger
+/// inputs are started first, so small and huge images balance across threads. A failed job
+/// does not stop the others, its error is reported to @p on_done
+BatchSummary RunBatch(std::vector<BatchJob> const& jobs, BatchOptions const& options,
+                      JobCallback on_done);
+
+/// @brief Print @p summary with throughput (MiB/s and megapixels/s)
+void PrintBatchSummary(std::ostream& os, BatchSummary const& summary);
+
+/// @brief Print statistics of @p summary as @c PrintStats does, followed by totals of the whole
+/// batch (as "batch" key of the same object with @p json)
+void PrintBatchStats(std::ostream& os, BatchSummary const& summary, bool json = false);
+}  // namespace bmp
@@ -0,0 +1,115 @@
+#include "binary_image.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace bmp {
+
+void BinaryImage::Allocate() {
+    stride_ = WordsPerRow(width_);
+    std::size_t const word_count = stride_ * height_;
+    if (words_ && words_.get_deleter().capacity >= word_count) {
+        return;
+    }
+    words_.reset();
+    if (word_count == 0) {
+        return;
+    }
+    words_ = {static_cast<BitWord*>(
+                      resource_->allocate(word_count * sizeof(BitWord), kAlignment)),
+              AlignedDeleter{resource_, word_count}};
+}
+
+BinaryImage::BinaryImage(std::size_t width, std::size_t height,
+                         std::pmr::memory_resource* resource)
+    : width_(width), height_(height), resource_(resource) {
+    Allocate();
+    if (words_) {
+        std::memset(words_.get(), 0, stride_ * height_ * sizeof(BitWord));
+    }
+}
+
+void BinaryImage::Reset(std::size_t width, std::size_t height) {
+    width_ = width;
+    height_ = height;
+    Allocate();
+    if (words_) {
+        std::memset(words_.get(), 0, stride_ * height_ * sizeof(BitWord));
+    }
+}
+
+void BinaryImage::Assign(std::size_t width, std::size_t height, BitWord const* words) {
+    width_ = width;
+    height_ = height;
+    Allocate();
+    if (words_) {
+        std::memcpy(words_.get(), words, stride_ * height_ * sizeof(BitWord));
+    }
+}
+
+BinaryImage::BinaryImage(BinaryImage const& other)
+    : width_(other.width_), height_(other.height_) {
+    Allocate();
+    if (words_) {
+        std::memcpy(words_.get(), other.words_.get(), stride_ * height_ * sizeof(BitWord));
+    }
+}
+
+BinaryImage& BinaryImage::operator=(BinaryImage const& other) {
+    if (this != &other) {
+        *this = BinaryImage(other);
+    }
+    return *this;
+}
+
+void BinaryImage::Fill(std::size_t y, std::size_t x_begin, std::size_t x_end, bool black) {
+    BitWord* row = GetRow(y);
+    while (x_begin < x_end) {
+        std::size_t const bit = x_begin % kBitsPerWord;
+        std::size_t const count = std::min(kBitsPerWord - bit, x_end - x_begin);
+        BitWord const mask = (count == kBitsPerWord ? ~BitWord{0} : (BitWord{1} << count) - 1)
+                             << bit;
+        BitWord& word = row[x_begin / kBitsPerWord];
+        word = black ? word | mask : word & ~mask;
+        x_begin += count;
+    }
+}
+
+BinaryImage BinaryImage::GetRegion(std::size_t x, std::size_t y, std::size_t width,
+                                   std::size_t height) const {
+    BinaryImage region{width, height};
+    std::size_t const first_word = x / kBitsPerWord;
+    std::size_t const shift = x % kBitsPerWord;
+    for (std::size_t row = 0; row < height; ++row) {
+        BitWord const* src = GetRow(y + row) + first_word;
+        BitWord* dst = region.GetRow(row);
+        // Source words past the row are not read
+        std::size_t const src_words = stride_ - first_word;
+        for (std::size_t word = 0; word < region.stride_; ++word) {
+            BitWord bits = src[word] >> shift;
+            if (shift != 0 && word + 1 < src_words) {
+                bits |= src[word + 1] << (kBitsPerWord - shift);
+            }
+            dst[word] = bits;
+        }
+        if (std::size_t const tail = width % kBitsPerWord; tail > 0) {
+            dst[region.stride_ - 1] &= (BitWord{1} << tail) - 1;
+        }
+    }
+    return region;
+}
+
+std::vector<std::vector<bool>> BinaryImage::ToBoolMatrix() const {
+    std::vector<std::vector<bool>> matrix;
+    matrix.reserve(height_);
+    for (auto const row : *this) {
+        matrix.emplace_back(row.begin(), row.end());
+    }
+    return matrix;
+}
+
+bool BinaryImage::operator==(BinaryImage const& other) const {
+    return width_ == other.width_ && height_ == other.height_ &&
+           std::equal(words_.get(), words_.get() + stride_ * height_, other.words_.get());
+}
+}  // namespace bmp
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <vector>
+
+namespace bmp {
+/// @brief Black-and-white raster, packed into 64-bit words.
+/// Scans are stored top-down in one aligned allocation, every scan takes @c GetStride() words.
+/// Pixel @c x of a scan is bit <tt>x % 64</tt> of word <tt>x / 64</tt>.
+/// @c true (set bit) is black, @c false is white. Bits past the image width are always zero.
+/// Words are allocated from @c std::pmr::memory_resource; copies use the default resource.
+class BinaryImage {
+public:
+    using BitWord = std::uint64_t;
+    constexpr static std::size_t kBitsPerWord = 64;
+    // Allocation is aligned to cache line
+    constexpr static std::size_t kAlignment = 64;
+
+    /// @brief Read-only view of one scan. Iterates over pixels as @c bools
+    class ConstRowView {
+    private:
+        BitWord const* words_;
+        std::size_t width_;
+
+    public:
+        class Iterator {
+        private:
+            BitWord const* words_;
+            std::size_t x_;
+
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = bool;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = bool;
+
+            Iterator() = default;
+
+            Iterator(BitWord const* words, std::size_t x) : words_(words), x_(x) {}
+
+            bool operator*() const {
+                return (words_[x_ / kBitsPerWord] >> (x_ % kBitsPerWord)) & 1;
+            }
+
+            Iterator& operator++() {
+                ++x_;
+                return *this;
+            }
+
+            Iterator operator++(int) {
+                auto prev = *this;
+                ++x_;
+                return prev;
+            }
+
+            bool operator==(Iterator const& other) const {
+                return x_ == other.x_;
+            }
+        };
+
+        ConstRowView(BitWord const* words, std::size_t width) : words_(words), width_(width) {}
+
+        BitWord const* GetWords() const {
+            return words_;
+        }
+
+        std::size_t size() const {
+            return width_;
+        }
+
+        bool operator[](std::size_t x) const {
+            return (words_[x / kBitsPerWord] >> (x % kBitsPerWord)) & 1;
+        }
+
+        Iterator begin() const {
+            return {words_, 0};
+        }
+
+        Iterator end() const {
+            return {words_, width_};
+        }
+    };
+
+    /// @brief Iterates over scans (top-down)
+    class RowIterator {
+    private:
+        BinaryImage const* image_;
+        std::size_t y_;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = ConstRowView;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = ConstRowView;
+
+        RowIterator() = default;
+
+        RowIterator(BinaryImage const* image, std::size_t y) : image_(image), y_(y) {}
+
+        ConstRowView operator*() const {
+            return (*image_)[y_];
+        }
+
+        RowIterator& operator++() {
+            ++y_;
+            return *this;
+        }
+
+        RowIterator operator++(int) {
+            auto prev = *this;
+            ++y_;
+            return prev;
+        }
+
+        bool operator==(RowIterator const& other) const {
+            return y_ == other.y_;
+        }
+    };
+
+private:
+    struct AlignedDeleter {
+        std::pmr::memory_resource* resource;
+        // Number of allocated words
+        std::size_t capacity;
+
+        void operator()(BitWord* words) const {
+            resource->deallocate(words, capacity * sizeof(BitWord), kAlignment);
+        }
+    };
+
+    std::size_t width_ = 0;
+    std::size_t height_ = 0;
+    // Words per scan
+    std::size_t stride_ = 0;
+    std::pmr::memory_resource* resource_ = std::pmr::get_default_resource();
+    std::unique_ptr<BitWord[], AlignedDeleter> words_;
+
+    /// @brief Make room for the current size. Allocation is kept if it is large enough
+    void Allocate();
+
+public:
+    BinaryImage() = default;
+
+    /// @brief Create white image
+    BinaryImage(std::size_t width, std::size_t height,
+                std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    BinaryImage(BinaryImage const& other);
+    BinaryImage& operator=(BinaryImage const& other);
+    BinaryImage(BinaryImage&&) noexcept = default;
+    BinaryImage& operator=(BinaryImage&&) noexcept = default;
+
+    /// @brief Make image white and of the given size. Allocation is reused when it is large
+    /// enough, so images of the same size are recycled without allocations
+    void Reset(std::size_t width, std::size_t height);
+
+    /// @brief Copy image of the given size from @p words (<tt>WordsPerRow(width)</tt> words per
+    /// scan). Allocation is reused as in @c Reset
+    void Assign(std::size_t width, std::size_t height, BitWord const* words);
+
+    std::size_t GetWidth() const {
+        return width_;
+    }
+
+    std::size_t GetHeight() const {
+        return height_;
+    }
+
+    /// @brief Number of words per scan
+    std::size_t GetStride() const {
+        return stride_;
+    }
+
+    /// @brief Number of words that hold @p width pixels
+    constexpr static std::size_t WordsPerRow(std::size_t width) {
+        return (width + kBitsPerWord - 1) / kBitsPerWord;
+    }
+
+    BitWord* GetRow(std::size_t y) {
+        return words_.get() + y * stride_;
+    }
+
+    BitWord const* GetRow(std::size_t y) const {
+        return words_.get() + y * stride_;
+    }
+
+    bool Get(std::size_t x, std::size_t y) const {
+        return (GetRow(y)[x / kBitsPerWord] >> (x % kBitsPerWord)) & 1;
+    }
+
+    void Set(std::size_t x, std::size_t y, bool black = true) {
+        BitWord const mask = BitWord{1} << (x % kBitsPerWord);
+        BitWord& word = GetRow(y)[x / kBitsPerWord];
+        word = black ? word | mask : word & ~mask;
+    }
+
+    /// @brief Set pixels <tt>[x_begin, x_end)</tt> of row @p y, word by word
+    void Fill(std::size_t y, std::size_t x_begin, std::size_t x_end, bool black = true);
+
+    ConstRowView operator[](std::size_t y) const {
+        return {GetRow(y), width_};
+    }
+
+    RowIterator begin() const {
+        return {this, 0};
+    }
+
+    RowIterator end() const {
+        return {this, height_};
+    }
+
+    /// @brief Copy of pixels <tt>[x, x + width) x [y, y + height)</tt>. Region must be inside
+    /// the image
+    BinaryImage GetRegion(std::size_t x, std::size_t y, std::size_t width,
+                          std::size_t height) const;
+
+    /// @brief Compatibility adapter: get image as an array of @c bools (one vector per scan)
+    std::vector<std::vector<bool>> ToBoolMatrix() const;
+
+    bool operator==(BinaryImage const& other) const;
+};
+}  // namespace bmp
@@ -0,0 +1,435 @@
+#include "bmp_generator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+
+#include "util/bitfields_kernel.h"
+#include "util/bitmap_file_header.h"
+#include "util/bitmap_info_header.h"
+#include "util/file.h"
+#include "util/invalid_bmp_error.h"
+#include "util/ms_constants.h"
+
+namespace bmp {
+
+using namespace util;
+
+namespace {
+constexpr ChannelMasks kStandMasks{0x00FF0000, 0x0000FF00, 0x000000FF};
+constexpr ChannelMasks k565Masks{0xF800, 0x07E0, 0x001F};
+constexpr ChannelMasks k555Masks{0x7C00, 0x03E0, 0x001F};
+
+// Glyph is 5x7 pixels; cells also contain one blank column and two blank rows
+constexpr std::size_t kGlyphWidth = 5;
+constexpr std::size_t kGlyphHeight = 7;
+constexpr std::size_t kCellWidth = kGlyphWidth + 1;
+constexpr std::size_t kCellHeight = kGlyphHeight + 2;
+
+/// @brief splitmix64 finalizer
+std::uint64_t Mix(std::uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+template <typename T>
+void Append(std::vector<Byte>& bytes, T const& value) {
+    std::size_t const size = bytes.size();
+    bytes.resize(size + sizeof(value));
+    std::memcpy(bytes.data() + size, &value, sizeof(value));
+}
+
+/// @brief Append RLE escape (zero count) with argument @p value
+void AppendEscape(Byte*& out, Byte value) {
+    *out++ = 0;
+    *out++ = value;
+}
+
+/// @brief Scale 8-bit channel value to @p mask and put it in place
+DWord PackChannel(Byte value, DWord mask) {
+    DWord const low = mask & -mask;
+    std::uint64_t const max = mask / low;
+    return static_cast<DWord>((value * max + 127) / 255 * low);
+}
+
+void FillRandomRow(std::uint64_t seed, std::size_t y, Byte* scan, std::size_t size) {
+    // xorshift is much faster than <random> engines, which matters for multi-GB images
+    std::uint64_t state = Mix(seed ^ Mix(y)) | 1;
+    for (std::size_t i = 0; i < size; i += sizeof(state)) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        std::memcpy(scan + i, &state, std::min(sizeof(state), size - i));
+    }
+}
+}  // namespace
+
+BMPGenerator::BMPGenerator(GeneratorOptions const& options) : options_(options) {
+    InvalidBMPError::Assert(options_.width > 0 && options_.height > 0,
+                            "width and height must be positive");
+    InvalidBMPError::Assert(IsSupportedBitCount(options_.bit_count),
+                            std::to_string(options_.bit_count) + "-bit BMPs are not supported");
+    switch (options_.compression) {
+        case Compression::RGB:
+            break;
+        case Compression::BITFIELDS:
+            InvalidBMPError::Assert(options_.bit_count == 16 || options_.bit_count == 32,
+                                    "BITFIELDS compression needs 16 or 32-bit pixels");
+            break;
+        case Compression::RLE8:
+        case Compression::RLE4:
+            InvalidBMPError::Assert(
+                    options_.bit_count == (options_.compression == Compression::RLE8 ? 8 : 4),
+                    "RLE8 needs 8-bit pixels, RLE4 needs 4-bit pixels");
+            InvalidBMPError::Assert(options_.bottom_up, "RLE BMPs cannot be top-down");
+            break;
+        default:
+            throw InvalidBMPError("only RGB, BITFIELDS and RLE BMPs can be generated");
+    }
+    if (options_.header_version == HeaderVersion::kCore) {
+        InvalidBMPError::Assert(options_.width <= std::numeric_limits<Word>::max() &&
+                                        options_.height <= std::numeric_limits<Word>::max(),
+                                "image is too large for CORE header");
+        InvalidBMPError::Assert(options_.bottom_up, "CORE header cannot describe top-down BMP");
+        InvalidBMPError::Assert(options_.compression == Compression::RGB,
+                                "CORE header cannot describe compressed BMP");
+    } else {
+        InvalidBMPError::Assert(options_.width <= std::numeric_limits<Long>::max() &&
+                                        options_.height <= std::numeric_limits<Long>::max(),
+                                "image is too large");
+    }
+
+    if (options_.compression == Compression::BITFIELDS && options_.masks.red != 0) {
+        masks_ = options_.masks;
+        DWord const pixel_mask = options_.bit_count == 32 ? ~DWord{0} : 0xFFFF;
+        for (DWord mask : {masks_.red, masks_.green, masks_.blue}) {
+            InvalidBMPError::Assert(IsContiguousMask(mask) && (mask & ~pixel_mask) == 0,
+                                    "invalid bit mask: " + std::to_string(mask));
+        }
+        InvalidBMPError::Assert((masks_.red & masks_.green) == 0 &&
+                                        (masks_.red & masks_.blue) == 0 &&
+                                        (masks_.green & masks_.blue) == 0,
+                                "bit masks overlap");
+    } else if (options_.bit_count == 16) {
+        masks_ = options_.compression == Compression::BITFIELDS ? k565Masks : k555Masks;
+    } else if (options_.bit_count == 32) {
+        masks_ = kStandMasks;
+    }
+
+    if (IsIndexed(options_.bit_count)) {
+        std::size_t const entries = std::size_t{1} << options_.bit_count;
+        for (std::size_t index = 0; index < entries; ++index) {
+            auto const gray = static_cast<Byte>(index * 255 / (entries - 1));
+            palette_.push_back({gray, gray, gray});
+        }
+    }
+    headers_ = BuildHeaders(std::uint64_t{GetFullScanSize()} * options_.height);
+}
+
+std::vector<Byte> BMPGenerator::BuildHeaders(std::uint64_t data_size) const {
+    bool const bitfields = options_.compression == Compression::BITFIELDS;
+    bool const core = options_.header_version == HeaderVersion::kCore;
+    DWord info_header_size = 0;
+    switch (options_.header_version) {
+        case HeaderVersion::kCore:
+            info_header_size = sizeof(DWord) + sizeof(BitmapCoreHeader);
+            break;
+        case HeaderVersion::kV3:
+            info_header_size = sizeof(DWord) + sizeof(BitmapInfoHeader);
+            break;
+        case HeaderVersion::kV4:
+            info_header_size = sizeof(DWord) + sizeof(BitmapV4Header);
+            break;
+        case HeaderVersion::kV5:
+            info_header_size = sizeof(DWord) + sizeof(BitmapV5Header);
+            break;
+    }
+    // Bits that are not used by channels
+    DWord const alpha_mask = options_.bit_count == 32
+                                     ? ~(masks_.red | masks_.green | masks_.blue)
+                                     : 0;
+    // V3 header is followed by masks; newer headers contain them
+    DWord const masks_size =
+            bitfields && options_.header_version == HeaderVersion::kV3 ? 3 * sizeof(DWord) : 0;
+    // CORE color table consists of RGBTRIPLEs, others of RGBQUADs
+    DWord const palette_bytes = palette_.size() * (core ? 3 : 4);
+    DWord const offset =
+            sizeof(BitmapFileHeader) + info_header_size + masks_size + palette_bytes;
+
+    // Both fields are 32-bit. File size is truncated for huge files, size_image is set to 0
+    // (allowed for uncompressed images)
+    bool const fits = offset + data_size <= std::numeric_limits<DWord>::max();
+    std::vector<Byte> headers;
+    Append(headers, BitmapFileHeader{
+                            .signature = 0x4D42,
+                            .file_size = static_cast<DWord>(offset + data_size),
+                            .reserved1 = 0,
+                            .reserved2 = 0,
+                            .offset = offset,
+                    });
+    Append(headers, info_header_size);
+
+    Long const height = static_cast<Long>(options_.height);
+    BitmapInfoHeader const info_header{
+            .width = static_cast<Long>(options_.width),
+            .height = options_.bottom_up ? height : -height,
+            .planes = 1,
+            .bit_count = options_.bit_count,
+            .compression = static_cast<DWord>(options_.compression),
+            .size_image = fits ? static_cast<DWord>(data_size) : 0,
+            .x_px_per_meter = 0,
+            .y_px_per_meter = 0,
+            .clr_used = 0,
+            .clr_important = 0,
+    };
+    BitmapV4Header const v4_header{
+            .info = info_header,
+            .red_mask = masks_.red,
+            .green_mask = masks_.green,
+            .blue_mask = masks_.blue,
+            .alpha_mask = alpha_mask,
+            .cs_type = static_cast<DWord>(ColorSpace::SRGB),
+            .endpoints = {},
+            .gamma_red = 0,
+            .gamma_green = 0,
+            .gamma_blue = 0,
+    };
+    switch (options_.header_version) {
+        case HeaderVersion::kCore:
+            Append(headers, BitmapCoreHeader{
+                                    .width = static_cast<Word>(options_.width),
+                                    .height = static_cast<Word>(options_.height),
+                                    .planes = 1,
+                                    .bit_count = options_.bit_count,
+                            });
+            break;
+        case HeaderVersion::kV3:
+            Append(headers, info_header);
+            if (bitfields) {
+                Append(headers, masks_.red);
+                Append(headers, masks_.green);
+                Append(headers, masks_.blue);
+            }
+            break;
+        case HeaderVersion::kV4:
+            Append(headers, v4_header);
+            break;
+        case HeaderVersion::kV5:
+            Append(headers, BitmapV5Header{
+                                    .v4 = v4_header,
+                                    // LCS_GM_IMAGES
+                                    .intent = 4,
+                                    .profile_data = 0,
+                                    .profile_size = 0,
+                                    .reserved = 0,
+                            });
+            break;
+    }
+
+    for (auto const& color : palette_) {
+        Append(headers, color);
+        if (!core) {
+            headers.push_back(0);
+        }
+    }
+    return headers;
+}
+
+void BMPGenerator::FillColorRow(std::size_t y, Byte* pixels, std::size_t byte_count) const {
+    std::size_t const row_size = std::size_t{options_.width} * byte_count;
+    switch (options_.pattern) {
+        case Pattern::kRandom:
+            FillRandomRow(options_.seed, y, pixels, row_size);
+            return;
+        case Pattern::kGradient: {
+            std::size_t const max_x = std::max<std::size_t>(options_.width - 1, 1);
+            std::size_t const max_y = std::max<std::size_t>(options_.height - 1, 1);
+            Byte const green = static_cast<Byte>(y * 255 / max_y);
+            for (std::size_t x = 0; x < options_.width; ++x) {
+                Byte* pixel = pixels + x * byte_count;
+                pixel[0] = static_cast<Byte>((x + y) * 255 / (max_x + max_y));
+                pixel[1] = green;
+                pixel[2] = static_cast<Byte>(x * 255 / max_x);
+                if (byte_count == 4) {
+                    pixel[3] = 0xFF;
+                }
+            }
+            return;
+        }
+        case Pattern::kGlyphs: {
+            std::memset(pixels, 0xFF, row_size);
+            std::size_t const glyph_y = y % kCellHeight;
+            if (glyph_y >= kGlyphHeight) {
+                return;
+            }
+            std::size_t const cell_y = y / kCellHeight;
+            for (std::size_t cell_x = 0; cell_x * kCellWidth < options_.width; ++cell_x) {
+                std::uint64_t const glyph = Mix(options_.seed ^ Mix(cell_y << 32 | cell_x));
+                // Every eighth cell is a space
+                if (glyph >> 61 == 0) {
+                    continue;
+                }
+                std::size_t const last_x =
+                        std::min<std::size_t>(kGlyphWidth, options_.width - cell_x * kCellWidth);
+                for (std::size_t glyph_x = 0; glyph_x < last_x; ++glyph_x) {
+                    if ((glyph >> (glyph_y * kGlyphWidth + glyph_x)) & 1) {
+                        std::memset(pixels + (cell_x * kCellWidth + glyph_x) * byte_count, 0,
+                                    std::min<std::size_t>(byte_count, 3));
+                    }
+                }
+            }
+            return;
+        }
+    }
+}
+
+void BMPGenerator::FillRow(std::size_t y, Byte* scan) const {
+    std::memset(scan, 0, GetFullScanSize());
+    std::size_t const byte_count = options_.bit_count / 8;
+    bool const packed = options_.bit_count == 16 ||
+                        (options_.bit_count == 32 && !(masks_ == kStandMasks));
+    if (!IsIndexed(options_.bit_count) && (!packed || options_.pattern == Pattern::kRandom)) {
+        // Random bits are valid pixels with any masks
+        FillColorRow(y, scan, byte_count);
+        return;
+    }
+    if (packed) {
+        std::vector<Byte> pixels(std::size_t{options_.width} * 3);
+        FillColorRow(y, pixels.data(), 3);
+        DWord const alpha_mask = options_.bit_count == 32
+                                         ? ~(masks_.red | masks_.green | masks_.blue)
+                                         : 0;
+        for (std::size_t x = 0; x < options_.width; ++x) {
+            Byte const* pixel = pixels.data() + x * 3;
+            DWord const packed_pixel = PackChannel(pixel[2], masks_.red) |
+                                       PackChannel(pixel[1], masks_.green) |
+                                       PackChannel(pixel[0], masks_.blue) | alpha_mask;
+            std::memcpy(scan + x * byte_count, &packed_pixel, byte_count);
+        }
+        return;
+    }
+    std::size_t const pixels_per_byte = 8 / options_.bit_count;
+    if (options_.pattern == Pattern::kRandom) {
+        // Random bytes are random indices as well
+        FillRandomRow(options_.seed, y, scan,
+                      (options_.width + pixels_per_byte - 1) / pixels_per_byte);
+        return;
+    }
+
+    // Gray level of pixel is turned into the closest palette entry
+    std::vector<Byte> pixels(std::size_t{options_.width} * 3);
+    FillColorRow(y, pixels.data(), 3);
+    std::size_t const max_index = palette_.size() - 1;
+    for (std::size_t x = 0; x < options_.width; ++x) {
+        Byte const* pixel = pixels.data() + x * 3;
+        unsigned const gray = (unsigned{pixel[0]} + pixel[1] + pixel[2]) / 3;
+        auto const index = static_cast<Byte>((gray * max_index + 127) / 255);
+        // Pixels are stored from the highest bits
+        scan[x / pixels_per_byte] |=
+                index << (8 - options_.bit_count * (x % pixels_per_byte + 1));
+    }
+}
+
+std::size_t BMPGenerator::EncodeRow(std::size_t y, Byte* out) const {
+    bool const rle4 = options_.compression == Compression::RLE4;
+    std::vector<Byte> scan(GetFullScanSize());
+    FillRow(y, scan.data());
+    std::vector<Byte> indices(options_.width);
+    for (std::size_t x = 0; x < indices.size(); ++x) {
+        indices[x] = rle4 ? (scan[x / 2] >> (x % 2 == 0 ? 4 : 0)) & 0xF : scan[x];
+    }
+
+    // Length of run of equal indices that starts from x
+    auto get_run = [&](std::size_t x) {
+        std::size_t run = 1;
+        while (x + run < indices.size() && run < 255 && indices[x + run] == indices[x]) {
+            ++run;
+        }
+        return run;
+    };
+
+    Byte* const begin = out;
+    std::size_t x = 0;
+    while (x < indices.size()) {
+        std::size_t const run = get_run(x);
+        if (run >= 3) {
+            *out++ = static_cast<Byte>(run);
+            *out++ = rle4 ? indices[x] * 0x11 : indices[x];
+            x += run;
+            continue;
+        }
+
+        // Collect pixels until the next long run. Absolute mode needs at least 3 pixels
+        std::size_t end = x + run;
+        while (end < indices.size() && end - x < 255 && get_run(end) < 3) {
+            ++end;
+        }
+        end = std::min(end, x + 255);
+        std::size_t const count = end - x;
+        if (count < 3) {
+            for (; x < end; ++x) {
+                *out++ = 1;
+                *out++ = rle4 ? indices[x] << 4 : indices[x];
+            }
+            continue;
+        }
+        AppendEscape(out, static_cast<Byte>(count));
+        std::size_t const bytes = rle4 ? (count + 1) / 2 : count;
+        std::memset(out, 0, bytes + bytes % 2);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (rle4) {
+                out[i / 2] |= indices[x + i] << (i % 2 == 0 ? 4 : 0);
+            } else {
+                out[i] = indices[x + i];
+            }
+        }
+        out += bytes + bytes % 2;
+        x = end;
+    }
+    // End of line
+    AppendEscape(out, 0);
+    return out - begin;
+}
+
+void BMPGenerator::Write(std::string const& filename) const {
+    File const file{filename, O_WRONLY | O_CREAT | O_TRUNC};
+    file.WriteAt(headers_.data(), headers_.size(), 0);
+
+    // Encoded rows are not longer than 2 bytes per pixel plus end of line
+    std::size_t const max_scan =
+            IsRLE() ? 2 * std::size_t{options_.width} + 2 : GetFullScanSize();
+    std::size_t const batch_scans = std::max<std::size_t>(1, (1 << 20) / max_scan);
+    // Room for end of bitmap marker
+    std::vector<Byte> batch(batch_scans * max_scan + 2);
+    std::uint64_t offset = headers_.size();
+    for (std::size_t scan_num = 0; scan_num < options_.height; scan_num += batch_scans) {
+        std::size_t const count = std::min<std::size_t>(batch_scans, options_.height - scan_num);
+        std::size_t size = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            std::size_t const scan = scan_num + i;
+            std::size_t const y = options_.bottom_up ? options_.height - 1 - scan : scan;
+            if (IsRLE()) {
+                size += EncodeRow(y, batch.data() + size);
+            } else {
+                FillRow(y, batch.data() + size);
+                size += max_scan;
+            }
+        }
+        if (IsRLE() && scan_num + count == options_.height) {
+            Byte* end = batch.data() + size;
+            AppendEscape(end, 1);
+            size += 2;
+        }
+        file.WriteAt(batch.data(), size, offset);
+        offset += size;
+    }
+
+    if (IsRLE()) {
+        std::vector<Byte> const headers = BuildHeaders(offset - headers_.size());
+        file.WriteAt(headers.data(), headers.size(), 0);
+    }
+}
+}  // namespace bmp
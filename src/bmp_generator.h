@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "header_reader.h"
+#include "util/bitfields_kernel.h"
+#include "util/field_types.h"
+#include "util/ms_constants.h"
+
+namespace bmp {
+/// @brief Info header written by @c BMPGenerator
+enum class HeaderVersion { kCore, kV3, kV4, kV5 };
+
+/// @brief Generated image content
+enum class Pattern {
+    // Uniformly distributed random bytes
+    kRandom,
+    // Red grows to the right, green grows to the bottom, blue along the diagonal
+    kGradient,
+    // Lines of black random 5x7 glyphs on white background
+    kGlyphs,
+};
+
+/// @brief @c BMPGenerator settings
+struct GeneratorOptions {
+    DWord width;
+    DWord height;
+    // 1, 4, 8 (gray palette), 16, 24 or 32
+    Word bit_count = 24;
+    // Top-down images need V3 header or newer
+    bool bottom_up = true;
+    // RGB, BITFIELDS (16 or 32-bit), RLE8 (8-bit) or RLE4 (4-bit). Compressed images need V3
+    // header or newer, RLE images must be bottom-up
+    util::Compression compression = util::Compression::RGB;
+    // Masks of BITFIELDS images. Zeros mean RGB565 for 16-bit and standard masks for 32-bit
+    util::ChannelMasks masks{};
+    HeaderVersion header_version = HeaderVersion::kV3;
+    Pattern pattern = Pattern::kRandom;
+    std::uint64_t seed = 0;
+};
+
+/// @brief Writes synthetic BMPs of any size.
+/// Content depends only on options and pixel position, so any row can be generated on its own
+/// and images are streamed to disk without being built in memory.
+class BMPGenerator {
+private:
+    GeneratorOptions options_;
+    Palette palette_;
+    util::ChannelMasks masks_{};
+    std::vector<Byte> headers_;
+
+    /// @param data_size -- pixel data size (bytes)
+    std::vector<Byte> BuildHeaders(std::uint64_t data_size) const;
+
+    /// @brief Write row @p y as BGR(X) pixels, without padding
+    void FillColorRow(std::size_t y, Byte* pixels, std::size_t byte_count) const;
+
+    bool IsRLE() const {
+        return options_.compression == util::Compression::RLE8 ||
+               options_.compression == util::Compression::RLE4;
+    }
+
+    /// @brief Encode row @p y and end of line marker into @p out
+    /// @return number of bytes written, at most <tt>2 * width + 2</tt>
+    std::size_t EncodeRow(std::size_t y, Byte* out) const;
+
+public:
+    /// @throw InvalidBMPError if options describe BMP that cannot be written
+    explicit BMPGenerator(GeneratorOptions const& options);
+
+    /// @brief File header, info header, bit masks and color table
+    std::vector<Byte> const& GetHeaders() const {
+        return headers_;
+    }
+
+    /// @brief Color table of 1, 4 and 8-bit images: shades of gray from black to white
+    Palette const& GetPalette() const {
+        return palette_;
+    }
+
+    /// @brief Masks of 16 and 32-bit images (implicit ones if compression is RGB)
+    util::ChannelMasks const& GetMasks() const {
+        return masks_;
+    }
+
+    /// @brief Size of uncompressed scan (including padding)
+    std::size_t GetFullScanSize() const {
+        return (std::size_t{options_.width} * options_.bit_count + 31) / 32 * 4;
+    }
+
+    /// @brief File size. RLE images are usually smaller
+    std::uint64_t GetFileSize() const {
+        return headers_.size() + std::uint64_t{GetFullScanSize()} * options_.height;
+    }
+
+    /// @brief Write row @p y (counting from the top) in uncompressed file format, including
+    /// padding. RLE images contain the same pixels
+    /// @param scan -- @c GetFullScanSize() bytes
+    void FillRow(std::size_t y, Byte* scan) const;
+
+    /// @brief Write the whole BMP, about 1 MiB of scans at a time.
+    /// Headers of RLE images are written last, when data size is known
+    void Write(std::string const& filename) const;
+};
+}  // namespace bmp
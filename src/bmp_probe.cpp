@@ -0,0 +1,45 @@
+#include "bmp_probe.h"
+
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+
+#include "header_reader.h"
+#include "util/file.h"
+#include "util/thread_pool.h"
+
+namespace bmp {
+
+using namespace util;
+
+ImportantFields ProbeBMP(std::string const& filename) {
+    File const file{filename};
+    return ReadImportantFields(file, file.GetSize());
+}
+
+std::vector<ProbeResult> ProbeDirectory(std::string const& directory, std::size_t thread_count) {
+    std::vector<ProbeResult> results;
+    for (auto const& entry : std::filesystem::directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            results.push_back({.filename = entry.path().string()});
+        }
+    }
+    std::sort(results.begin(), results.end(), [](ProbeResult const& lhs, ProbeResult const& rhs) {
+        return lhs.filename < rhs.filename;
+    });
+
+    // Probing is dominated by syscall latency, so small chunks are fine
+    constexpr std::size_t kChunkSize = 16;
+    ThreadPool pool{thread_count};
+    pool.ParallelFor(results.size(), kChunkSize, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            try {
+                results[i].fields = ProbeBMP(results[i].filename);
+            } catch (std::exception const& e) {
+                results[i].error = e.what();
+            }
+        }
+    });
+    return results;
+}
+}  // namespace bmp
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "important_fields.h"
+
+namespace bmp {
+/// @brief Read and check BMP headers without reading pixel data.
+/// Costs one @c open, one @c fstat and one @c pread
+/// @throw IOError, InvalidBMPError -- same as @c BMPReader::ReadHeaders
+ImportantFields ProbeBMP(std::string const& filename);
+
+/// @brief Result of probing one file
+struct ProbeResult {
+    std::string filename;
+    // Valid if error is empty
+    ImportantFields fields{};
+    std::string error{};
+};
+
+/// @brief Probe all regular files in @p directory (not recursively) in parallel.
+/// Files that are not valid BMPs get an error message instead of throwing
+/// @param thread_count -- 0 means hardware concurrency
+/// @return results sorted by filename
+std::vector<ProbeResult> ProbeDirectory(std::string const& directory,
+                                        std::size_t thread_count = 0);
+}  // namespace bmp
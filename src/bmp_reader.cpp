@@ -2,206 +2,600 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <ios>
 #include <iostream>
 #include <istream>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 #include <sys/stat.h>
 #include <vector>
 
-#include "util/bitmap_file_header.h"
+#include "decode_cache.h"
+#include "scan_decoder.h"
+#include "threshold.h"
 #include "util/bitmap_info_header.h"
-#include "util/color.h"
 #include "util/field_types.h"
 #include "util/invalid_bmp_error.h"
 #include "util/io_error.h"
 #include "util/ms_constants.h"
+#include "util/read_ahead.h"
 
 namespace bmp {
 
 using namespace util;
 
-void BMPReader::ReadFileHeader() {
-    util::BitmapFileHeader file_header;
-    ifs_ >> file_header;
+BMPReader::BMPReader(ReaderOptions options, std::pmr::memory_resource* resource)
+    : options_(options),
+      resource_(resource),
+      arena_(resource),
+      filename_(resource),
+      contents_(resource),
+      contents_is_(&contents_buf_),
+      palette_(resource),
+      pixel_data_(0, 0, resource),
+      dirty_scans_(resource) {
+    // Color table never needs more room
+    palette_.reserve(kMaxPaletteSize);
+}
+
+BMPReader::BMPReader(std::string const& filename, ReaderOptions options,
+                     std::pmr::memory_resource* resource)
+    : BMPReader(options, resource) {
+    Open(filename);
+}
 
-    if (file_size_ > 0) {
-        InvalidBMPError::Assert(file_header.file_size == file_size_,
-                                "invalid file size: requested " + std::to_string(file_size_) +
-                                        ", header says " + std::to_string(file_header.file_size));
+void BMPReader::Open(std::string const& filename) {
+    Reset();
+    filename_ = filename;
+    if (options_.input_mode == InputMode::kMapped) {
+        mapped_file_ = MappedFile(filename.c_str());
+        file_size_ = mapped_file_.GetSize();
+        contents_buf_.Reset(mapped_file_.GetData(), mapped_file_.GetSize());
+    } else {
+        // Contents are not read until they are needed
+        file_ = File(filename.c_str());
+        file_size_ = file_.GetSize();
     }
-    imp_fields.offset = file_header.offset;
 }
 
-void BMPReader::ReadInfoHeader() {
-    DWord h_size;
-    if (!ifs_.read(reinterpret_cast<char*>(&h_size), sizeof(h_size))) {
-        throw IOError("cannot read info header size");
+void BMPReader::SetOptions(ReaderOptions const& options) {
+    Reset();
+    if (options.thread_count != options_.thread_count) {
+        thread_pool_.reset();
     }
+    options_ = options;
+}
+
+void BMPReader::Reset() {
+    file_ = File();
+    mapped_file_ = MappedFile();
+    contents_buf_.Reset(nullptr, 0);
+    contents_is_.clear();
+    // Allocations are kept
+    filename_.clear();
+    contents_.clear();
+    palette_.clear();
+    dirty_scans_.clear();
+    pixel_data_.Reset(0, 0);
+    imp_fields = {};
+    black_index_ = 0;
+    file_size_ = 0;
+    io_counters_ = {};
+}
 
-    if (h_size == 12) {
-        ReadCoreInfoHeader();
-        // 54 and 56-bit headers are not documented by Microsoft, but are used sometimes
-    } else if (h_size == 40 || h_size == 54 || h_size == 56 || h_size == 108 || h_size == 124) {
-        ReadNewInfoHeader();
+void BMPReader::ReadHeaders() {
+    PhaseTimer const timer{stats_[Phase::kReadHeaders]};
+    if (options_.input_mode == InputMode::kMapped) {
+        imp_fields = ReadImportantFields(contents_is_, file_size_);
+        ReadPalette(mapped_file_.GetData(), mapped_file_.GetSize(), imp_fields, palette_);
     } else {
-        throw InvalidBMPError("invalid info header size: " + std::to_string(h_size));
+        imp_fields = ReadImportantFields(file_, file_size_);
+        ReadPalette(file_, imp_fields, palette_);
     }
+    black_index_ = ScanDecoder::GetDarkestIndex(palette_);
 }
 
-void BMPReader::ReadCoreInfoHeader() {
-    util::BitmapCoreHeader core_header;
-    ifs_ >> core_header;
+void BMPReader::LoadContents() {
+    if (options_.input_mode == InputMode::kMapped || !contents_.empty()) {
+        return;
+    }
+    contents_.resize(file_size_);
+    file_.ReadAt(contents_.data(), contents_.size(), 0);
+    if constexpr (kStatsEnabled) {
+        ++stats_.read_calls;
+        stats_.bytes_read += contents_.size();
+    }
+}
 
-    imp_fields.width = core_header.width;
-    imp_fields.height = core_header.height;
-    imp_fields.byte_count = core_header.bit_count / 8;
+std::shared_ptr<DecodedImage const> BMPReader::ReleaseImage() {
+    LoadContents();
+    std::shared_ptr<DecodedImage> image{new DecodedImage};
+    image->imp_fields_ = imp_fields;
+    image->palette_.assign(palette_.begin(), palette_.end());
+    image->black_index_ = black_index_;
+    image->source_ = options_.input_mode == InputMode::kMapped ? mapped_file_.GetIdentity()
+                                                               : file_.GetIdentity();
+    image->source_modified_ = !dirty_scans_.empty();
+    image->decode_cache_ = options_.decode_cache;
+    // Image must not depend on reader's resource
+    if (resource_ == std::pmr::get_default_resource()) {
+        image->pixel_data_ = std::move(pixel_data_);
+        pixel_data_ = BinaryImage(0, 0, resource_);
+    } else {
+        image->pixel_data_ = pixel_data_;
+    }
+    if (options_.input_mode == InputMode::kMapped) {
+        // Pages that were not drawn on are still backed by the file, and saves to the file
+        // (in place, by any editor) would show through them
+        image->contents_.assign(mapped_file_.GetData(),
+                                mapped_file_.GetData() + mapped_file_.GetSize());
+    } else {
+        // Vector of another resource is copied
+        image->contents_ = std::move(contents_);
+    }
+    Reset();
+    return image;
+}
+
+ReaderStats BMPReader::GetStats() const {
+    ReaderStats stats = stats_;
+    if constexpr (kStatsEnabled) {
+        stats.read_calls += io_counters_.read_calls;
+        stats.bytes_read += io_counters_.bytes_read;
+    }
+    return stats;
 }
 
-void BMPReader::ReadNewInfoHeader() {
-    util::BitmapInfoHeader info_header;
-    ifs_ >> info_header;
+void BMPReader::ReadData() {
+    PhaseTimer const timer{stats_[Phase::kReadData]};
+    // Drawn scans are decoded as edited, but cache key is still the file's one
+    if (options_.decode_cache == nullptr || !dirty_scans_.empty()) {
+        Decode();
+        return;
+    }
+    DecodeKey const key{options_.input_mode == InputMode::kMapped ? mapped_file_.GetIdentity()
+                                                                  : file_.GetIdentity(),
+                        imp_fields.width, imp_fields.height, options_.threshold};
+    if (options_.decode_cache->Lookup(key, pixel_data_)) {
+        return;
+    }
+    Decode();
+    options_.decode_cache->Insert(key, pixel_data_);
+}
+
+void BMPReader::Decode() {
+    pixel_data_.Reset(imp_fields.width, imp_fields.height);
+    arena_.Reset();
+    if constexpr (kStatsEnabled) {
+        stats_.pixels_decoded += std::uint64_t{imp_fields.width} * imp_fields.height;
+    }
+
+    ThresholdMode const mode = options_.threshold.mode;
+    if (imp_fields.compression == Compression::RLE8 ||
+        imp_fields.compression == Compression::RLE4) {
+        InvalidBMPError::Assert(mode == ThresholdMode::kFixed || mode == ThresholdMode::kLuma,
+                                "RLE BMPs support fixed and luma thresholds only");
+        ReadRLEData();
+        return;
+    }
 
-    imp_fields.width = info_header.width;
-    imp_fields.height = std::abs(info_header.height);
-    imp_fields.bottom_up = info_header.height > 0;
-    imp_fields.byte_count = info_header.bit_count / 8;
-    imp_fields.compression = static_cast<Compression>(info_header.compression);
-    // If size_image is 0, it will be calculated later
-    imp_fields.size_image = info_header.size_image;
-    if (info_header.clr_used > 0) {
-        imp_fields.palette_used = true;
-        imp_fields.palette_important = info_header.clr_important;
+    // Decoder is specialized for the format once and shared by all chunks
+    ScanDecoder const decoder{imp_fields, palette_, options_.threshold};
+    if (mode == ThresholdMode::kFixed || mode == ThresholdMode::kLuma) {
+        ForEachScanBlock([&](Byte const* scans, std::size_t first_scan, std::size_t count) {
+            DecodeScans(decoder, scans, first_scan, count);
+        });
+        return;
     }
 
-    // Check masks
-    if (imp_fields.byte_count == 4 && imp_fields.compression == Compression::BITFIELDS ||
-        imp_fields.compression == Compression::ALPHABITFIELDS) {
-        DWord r_mask, g_mask, b_mask;
-        if (!ifs_.read(reinterpret_cast<char*>(&r_mask), sizeof(r_mask)) ||
-            !ifs_.read(reinterpret_cast<char*>(&g_mask), sizeof(g_mask)) ||
-            !ifs_.read(reinterpret_cast<char*>(&b_mask), sizeof(b_mask))) {
-            throw IOError("cannot read bit mask");
+    // Threshold depends on the whole image: luma is kept in compact buffer, histogram is built
+    // in the same pass
+    std::size_t const width = imp_fields.width;
+    std::pmr::vector<Byte> luma(width * imp_fields.height, &arena_);
+    LumaHistogram histogram{};
+    std::mutex histogram_mutex;
+    auto const row_stride = static_cast<std::ptrdiff_t>(width);
+    ForEachScanBlock([&](Byte const* scans, std::size_t first_scan, std::size_t count) {
+        Byte* first_row = luma.data() + GetPixelDataRow(first_scan) * width;
+        if (mode == ThresholdMode::kAdaptive) {
+            decoder.DecodeLuma(scans, count, imp_fields.GetFullScanSize(), first_row,
+                               imp_fields.bottom_up ? -row_stride : row_stride, nullptr);
+            return;
         }
-        if (r_mask != kStandRMask || g_mask != kStandGMask || b_mask != kStandBMask) {
-            throw InvalidBMPError("non-standard bit masks are not supported yet");
+        LumaHistogram block_histogram{};
+        decoder.DecodeLuma(scans, count, imp_fields.GetFullScanSize(), first_row,
+                           imp_fields.bottom_up ? -row_stride : row_stride, &block_histogram);
+        std::lock_guard lock{histogram_mutex};
+        for (std::size_t value = 0; value < histogram.size(); ++value) {
+            histogram[value] += block_histogram[value];
         }
+    });
+
+    if (mode == ThresholdMode::kOtsu) {
+        ThresholdLuma(luma.data(), GetOtsuThreshold(histogram), pixel_data_);
+    } else {
+        ThresholdAdaptive(luma.data(), options_.threshold, pixel_data_, &arena_);
     }
 }
 
-void BMPReader::ReadData() {
-    ifs_.seekg(imp_fields.offset);
-
-    std::vector<std::vector<RGBColor>> bit_data;
-    for (std::size_t scan_num = 0; scan_num < imp_fields.height; ++scan_num) {
-        std::vector<RGBColor> scan;
-        for (std::size_t cell_num = 0; cell_num < imp_fields.width; ++cell_num) {
-            RGBColor color;
-            if (imp_fields.byte_count == 3) {
-                color = Read24bitPixel();
-            } else {
-                color = Read32bitPixel();
-            }
-            scan.push_back(color);
+void BMPReader::ForEachScanBlock(ScanBlockSink sink) {
+    if (options_.thread_count != 1) {
+        ForEachScanBlockParallel(sink);
+        return;
+    }
+
+    if (HasContents()) {
+        // Scans are decoded straight from the mapping or contents, no intermediate copies are made
+        sink(GetContentScans(), 0, imp_fields.height);
+        return;
+    }
+
+    // Whole blocks of scans are read with one call into reusable buffer
+    std::size_t const full_scan = imp_fields.GetFullScanSize();
+    std::size_t const block_scans = std::clamp<std::size_t>(options_.block_size / full_scan, 1,
+                                                            imp_fields.height);
+    if (options_.read_ahead != ReadAhead::kNone && imp_fields.height > block_scans) {
+        ForEachScanBlockReadAhead(block_scans, sink);
+        return;
+    }
+    std::pmr::vector<Byte> block(block_scans * full_scan, &arena_);
+    for (std::size_t scan_num = 0; scan_num < imp_fields.height; scan_num += block_scans) {
+        std::size_t const count = std::min<std::size_t>(block_scans, imp_fields.height - scan_num);
+        file_.ReadAt(block.data(), count * full_scan, imp_fields.offset + scan_num * full_scan);
+        ++io_counters_.read_calls;
+        io_counters_.bytes_read += count * full_scan;
+        sink(block.data(), scan_num, count);
+    }
+}
+
+void BMPReader::ForEachScanBlockReadAhead(std::size_t block_scans, ScanBlockSink sink) {
+    std::size_t const full_scan = imp_fields.GetFullScanSize();
+    ReadAheadQueue queue{file_, std::max<std::size_t>(options_.queue_depth, 2),
+                         block_scans * full_scan, options_.read_ahead == ReadAhead::kIOUring};
+    std::size_t next_scan = 0;
+    auto push_blocks = [&] {
+        while (next_scan < imp_fields.height && queue.CanPush()) {
+            std::size_t const count = std::min(block_scans, imp_fields.height - next_scan);
+            queue.Push(imp_fields.offset + next_scan * full_scan, count * full_scan);
+            ++io_counters_.read_calls;
+            io_counters_.bytes_read += count * full_scan;
+            next_scan += count;
         }
-        if (imp_fields.padding_bytes > 0) {
-            ifs_.ignore(imp_fields.padding_bytes);
+    };
+
+    push_blocks();
+    for (std::size_t scan_num = 0; scan_num < imp_fields.height; scan_num += block_scans) {
+        Byte const* block = queue.Pop();
+        // Freed buffers are refilled before the block is decoded
+        push_blocks();
+        sink(block, scan_num, std::min(block_scans, imp_fields.height - scan_num));
+    }
+}
+
+BinaryImage BMPReader::ReadRegion(DWord x, DWord y, DWord width, DWord height) {
+    PhaseTimer const timer{stats_[Phase::kReadRegion]};
+    if (std::uint64_t{x} + width > imp_fields.width ||
+        std::uint64_t{y} + height > imp_fields.height) {
+        throw std::out_of_range("region is out of image");
+    }
+    if (width == 0 || height == 0) {
+        return BinaryImage(width, height);
+    }
+    // Top row of region in top-down coordinates
+    std::size_t const top = imp_fields.height - y - height;
+    if (imp_fields.compression == Compression::RLE8 ||
+        imp_fields.compression == Compression::RLE4) {
+        // Decoded image replaces pixel data only for a moment. Pixel data is restored even if
+        // decoding throws
+        struct PixelDataGuard {
+            BinaryImage& pixel_data;
+            BinaryImage saved;
+
+            ~PixelDataGuard() {
+                pixel_data = std::move(saved);
+            }
+        } const guard{pixel_data_, std::move(pixel_data_)};
+        // Not ReadData: the whole image is decoded as a part of this phase, and decode cache is
+        // not used for regions
+        Decode();
+        return pixel_data_.GetRegion(x, top, width, height);
+    }
+
+    arena_.Reset();
+    // Indexed scans can only be split at byte boundaries: pixels [first_pixel, x) are decoded too
+    std::size_t const pixels_per_byte = IsIndexed(imp_fields.bit_count) ? 8 / imp_fields.bit_count
+                                                                        : 1;
+    std::size_t const first_pixel = x - x % pixels_per_byte;
+    std::size_t const begin_byte = first_pixel * imp_fields.bit_count / 8;
+    std::size_t const end_byte = ((std::size_t{x} + width) * imp_fields.bit_count + 7) / 8;
+
+    ImportantFields region_fields = imp_fields;
+    region_fields.width = static_cast<DWord>(x + width - first_pixel);
+    if constexpr (kStatsEnabled) {
+        stats_.pixels_decoded += std::uint64_t{region_fields.width} * height;
+    }
+    ScanDecoder const decoder{region_fields, palette_, options_.threshold};
+
+    // Scans of region are contiguous in file
+    RegionSpan const span{.first_scan = imp_fields.bottom_up ? y : top,
+                          .height = height,
+                          .begin_byte = begin_byte,
+                          .row_bytes = end_byte - begin_byte};
+    return DecodeRegion(decoder, span, x - first_pixel, width);
+}
+
+void BMPReader::ForEachRegionBlock(RegionSpan const& span, RegionBlockSink sink) {
+    std::size_t const full_scan = imp_fields.GetFullScanSize();
+    std::size_t const begin = imp_fields.offset + span.first_scan * full_scan + span.begin_byte;
+    if (HasContents()) {
+        sink(GetContentScans() + span.first_scan * full_scan + span.begin_byte, full_scan, 0,
+             span.height);
+        return;
+    }
+
+    // Gaps between rows are small: one read of several scans is cheaper than a read per row
+    bool const read_gaps = span.row_bytes * 2 >= full_scan;
+    std::size_t const scan_size = read_gaps ? full_scan : span.row_bytes;
+    std::size_t const block_scans = std::clamp<std::size_t>(options_.block_size / scan_size, 1,
+                                                            span.height);
+    std::pmr::vector<Byte> block((block_scans - 1) * scan_size + span.row_bytes, &arena_);
+    for (std::size_t scan_num = 0; scan_num < span.height; scan_num += block_scans) {
+        std::size_t const count = std::min(block_scans, span.height - scan_num);
+        if (read_gaps) {
+            std::size_t const size = (count - 1) * full_scan + span.row_bytes;
+            file_.ReadAt(block.data(), size, begin + scan_num * full_scan);
+            ++io_counters_.read_calls;
+            io_counters_.bytes_read += size;
+        } else {
+            for (std::size_t i = 0; i < count; ++i) {
+                file_.ReadAt(block.data() + i * span.row_bytes, span.row_bytes,
+                             begin + (scan_num + i) * full_scan);
+            }
+            io_counters_.read_calls += count;
+            io_counters_.bytes_read += count * span.row_bytes;
         }
-        bit_data.push_back(scan);
+        sink(block.data(), scan_size, scan_num, count);
     }
+}
 
-    if (imp_fields.bottom_up) {
-        std::reverse(bit_data.begin(), bit_data.end());
+BinaryImage BMPReader::DecodeRegion(ScanDecoder const& decoder, RegionSpan const& span,
+                                    std::size_t skip, std::size_t width) {
+    std::size_t const decoded_width = skip + width;
+    std::size_t const height = span.height;
+    // Region row of region scan
+    auto get_row = [&](std::size_t scan) {
+        return imp_fields.bottom_up ? height - 1 - scan : scan;
+    };
+    ThresholdMode const mode = options_.threshold.mode;
+    if (mode == ThresholdMode::kFixed || mode == ThresholdMode::kLuma) {
+        BinaryImage decoded{decoded_width, height};
+        auto const stride = static_cast<std::ptrdiff_t>(decoded.GetStride());
+        ForEachRegionBlock(span, [&](Byte const* scans, std::size_t scan_size,
+                                     std::size_t first_scan, std::size_t count) {
+            decoder.DecodeScans(scans, count, scan_size, decoded.GetRow(get_row(first_scan)),
+                                imp_fields.bottom_up ? -stride : stride);
+        });
+        // Separate returns: conditional expression would copy the decoded image
+        if (skip == 0) {
+            return decoded;
+        }
+        return decoded.GetRegion(skip, 0, width, height);
     }
 
-    for (auto const& scan : bit_data) {
-        std::vector<bool> black_and_white_scan;
-        std::transform(scan.begin(), scan.end(), std::back_inserter(black_and_white_scan),
-                       [](util::RGBColor color) {
-                           return (color.red + color.green + color.blue) <= 122 * 3;
-                       });
-        pixel_data_.push_back(std::move(black_and_white_scan));
+    std::pmr::vector<Byte> luma(decoded_width * height, &arena_);
+    auto const row_stride = static_cast<std::ptrdiff_t>(decoded_width);
+    ForEachRegionBlock(span, [&](Byte const* scans, std::size_t scan_size, std::size_t first_scan,
+                                 std::size_t count) {
+        decoder.DecodeLuma(scans, count, scan_size,
+                           luma.data() + get_row(first_scan) * decoded_width,
+                           imp_fields.bottom_up ? -row_stride : row_stride, nullptr);
+    });
+    // Leading pixels are dropped before threshold is computed
+    if (skip != 0) {
+        for (std::size_t row = 0; row < height; ++row) {
+            std::memmove(luma.data() + row * width, luma.data() + row * decoded_width + skip,
+                         width);
+        }
     }
+    BinaryImage region{width, height};
+    if (mode == ThresholdMode::kOtsu) {
+        LumaHistogram histogram{};
+        AddToHistogram(luma.data(), width * height, histogram);
+        ThresholdLuma(luma.data(), GetOtsuThreshold(histogram), region);
+    } else {
+        ThresholdAdaptive(luma.data(), options_.threshold, region, &arena_);
+    }
+    return region;
 }
 
-RGBColor BMPReader::Read24bitPixel() {
-    RGBColor color;
-    if (!ifs_.read(reinterpret_cast<char*>(&color), sizeof(color))) {
+Byte const* BMPReader::GetContentScans() const {
+    if (imp_fields.offset > GetContentsSize() ||
+        (GetContentsSize() - imp_fields.offset) / imp_fields.GetFullScanSize() <
+                imp_fields.height) {
         throw IOError("cannot read pixel data");
     }
-    return color;
+    Byte const* const contents = options_.input_mode == InputMode::kMapped
+                                         ? mapped_file_.GetData()
+                                         : contents_.data();
+    return contents + imp_fields.offset;
 }
 
-RGBColor BMPReader::Read32bitPixel() {
-    RGBColor color;
-    DWord raw_color;
-    if (!ifs_.read(reinterpret_cast<char*>(&raw_color), sizeof(raw_color))) {
-        throw IOError("cannot read pixel data");
+void BMPReader::ReadRLEData() {
+    InvalidBMPError::Assert(imp_fields.offset <= file_size_, "invalid pixel data offset");
+    std::size_t const size = std::min<std::uint64_t>(imp_fields.size_image,
+                                                     file_size_ - imp_fields.offset);
+    ScanDecoder const decoder{imp_fields, palette_, options_.threshold};
+    if (options_.input_mode == InputMode::kMapped) {
+        decoder.DecodeRLE(mapped_file_.GetData() + imp_fields.offset, size, pixel_data_);
+        return;
     }
-    color.red = raw_color & kStandRMask >> 16;
-    color.green = raw_color & kStandGMask >> 8;
-    color.blue = raw_color & kStandBMask;
-    return color;
+
+    std::pmr::vector<Byte> data(size, &arena_);
+    file_.ReadAt(data.data(), data.size(), imp_fields.offset);
+    ++io_counters_.read_calls;
+    io_counters_.bytes_read += size;
+    decoder.DecodeRLE(data.data(), data.size(), pixel_data_);
 }
 
-void BMPReader::DrawPixel(DWord x, DWord y) {
-    // Draw on pixel data (note: it's top-down)
-    auto rev_y = imp_fields.height - y - 1;
-    pixel_data_[rev_y][x] = true;
+void BMPReader::DecodeScans(ScanDecoder const& decoder, Byte const* scans,
+                            std::size_t first_scan, std::size_t count) {
+    // Scans are written straight to their top-down positions
+    auto const stride = static_cast<std::ptrdiff_t>(pixel_data_.GetStride());
+    decoder.DecodeScans(scans, count, imp_fields.GetFullScanSize(),
+                        pixel_data_.GetRow(GetPixelDataRow(first_scan)),
+                        imp_fields.bottom_up ? -stride : stride);
+}
 
-    // Draw on BMP contents
-    auto const prev_scans = y == 0 ? 0 : y - 1;
-    auto const full_scan = imp_fields.width * imp_fields.byte_count + imp_fields.padding_bytes;
-    auto const pos = imp_fields.offset + prev_scans * full_scan + x * imp_fields.byte_count;
-    bmp_contents_.seekp(pos);
+void BMPReader::ForEachScanBlockParallel(ScanBlockSink sink) {
+    if (!thread_pool_) {
+        thread_pool_ = std::make_unique<ThreadPool>(options_.thread_count);
+    }
 
-    constexpr static util::RGBColor Black24bitPx{0, 0, 0};
-    constexpr static DWord Black32bitPx = 0;
-    if (imp_fields.byte_count == 3) {
-        bmp_contents_.write(reinterpret_cast<char const*>(&Black24bitPx), sizeof(Black24bitPx));
-    } else {
-        bmp_contents_.write(reinterpret_cast<char const*>(&Black32bitPx), sizeof(Black32bitPx));
+    // Several chunks per thread keep threads busy when some of them are slower
+    std::size_t const full_scan = imp_fields.GetFullScanSize();
+    std::size_t const max_chunk_scans = std::max<std::size_t>(1, kMaxChunkBytes / full_scan);
+    std::size_t const chunk_scans = std::clamp<std::size_t>(
+            imp_fields.height / (thread_pool_->GetThreadCount() * 4), 1, max_chunk_scans);
+
+    if (HasContents()) {
+        Byte const* scans = GetContentScans();
+        thread_pool_->ParallelFor(imp_fields.height, chunk_scans,
+                                  [&](std::size_t begin, std::size_t end) {
+                                      sink(scans + begin * full_scan, begin, end - begin);
+                                  });
+        return;
     }
+
+    thread_pool_->ParallelFor(
+            imp_fields.height, chunk_scans, [&](std::size_t begin, std::size_t end) {
+                std::vector<Byte> scans((end - begin) * full_scan);
+                file_.ReadAt(scans.data(), scans.size(), imp_fields.offset + begin * full_scan);
+                sink(scans.data(), begin, end - begin);
+            });
+    io_counters_.read_calls += (imp_fields.height + chunk_scans - 1) / chunk_scans;
+    io_counters_.bytes_read += imp_fields.height * full_scan;
 }
 
-void BMPReader::DrawLine(DWord x1, DWord y1, DWord x2, DWord y2) {
-    using Point = std::pair<DWord, DWord>;
-    std::vector<Point> line;
+void BMPReader::Draw(DrawList const& draw_list) {
+    PhaseTimer const timer{stats_[Phase::kDraw]};
+    // Runs would have to be re-encoded, and scans could change their sizes
+    if (imp_fields.compression == Compression::RLE8 ||
+        imp_fields.compression == Compression::RLE4) {
+        throw InvalidBMPError("drawing on RLE BMPs is not supported");
+    }
+    LoadContents();
+    std::size_t const full_scan = imp_fields.GetFullScanSize();
+    Byte* const scans = GetContents() + imp_fields.offset;
+    for (auto const& span : draw_list.Rasterize(imp_fields.width, imp_fields.height)) {
+        // Draw on pixel data (note: it's top-down)
+        std::size_t const rev_y = imp_fields.height - span.y - 1;
+        if (pixel_data_.GetHeight() > 0) {
+            pixel_data_.Fill(rev_y, span.x_begin, span.x_end);
+        }
 
-    DWord x_diff = std::abs(static_cast<long>(x2) - x1);
-    DWord y_diff = std::abs(static_cast<long>(y2) - y1);
-    if (x_diff >= y_diff) {
-        // k <= 1
-        if (x1 > x2) {
-            std::swap(x1, x2);
-            std::swap(y1, y2);
+        // Draw on BMP contents. Indexed BMPs use the darkest palette entry. In mapped mode pages
+        // are copied on first write
+        std::size_t const scan_num = imp_fields.bottom_up ? span.y : rev_y;
+        Byte* const scan = scans + scan_num * full_scan;
+        FillScan(scan, imp_fields, span.x_begin, span.x_end, black_index_);
+        MarkDirty(scan_num);
+    }
+}
+
+void BMPReader::MarkDirty(std::size_t scan_num) {
+    // Spans come row by row, so the last range can usually be extended
+    if (!dirty_scans_.empty()) {
+        auto& last = dirty_scans_.back();
+        if (last.first <= scan_num && scan_num < last.second) {
+            return;
         }
-        for (auto x = x1; x <= x2; ++x) {
-            auto y_shift = x_diff == 0 ? 0 : (x - x1) * y_diff / x_diff;
-            if (y1 > y2) {
-                y_shift *= -1;
-            }
-            auto y = y1 + y_shift;
-            line.emplace_back(x, y);
+        if (last.second == scan_num) {
+            ++last.second;
+            return;
         }
-    } else {
-        if (y1 > y2) {
-            std::swap(x1, x2);
-            std::swap(y1, y2);
+        if (last.first == scan_num + 1) {
+            --last.first;
+            return;
         }
-        for (auto y = y1; y <= y2; ++y) {
-            auto x_shift = y_diff == 0 ? 0 : (y - y1) * x_diff / y_diff;
-            if (x1 > x2) {
-                x_shift *= -1;
-            }
-            auto x = x1 + x_shift;
-            line.emplace_back(x, y);
+    }
+    dirty_scans_.emplace_back(scan_num, scan_num + 1);
+}
+
+void BMPReader::SaveBMP(std::string const& filename, SaveMode mode) {
+    PhaseTimer const timer{stats_[Phase::kSaveBMP]};
+    // Input holds the original BMP already. Truncating it would lose data that is copied from it
+    // (and pages that are mapped from it)
+    if (mode == SaveMode::kInPlace || IsInputFile(filename)) {
+        File const output{filename, O_WRONLY};
+        WriteDirtyScans(output);
+        InvalidateCache(output);
+        return;
+    }
+    if (mode == SaveMode::kIncremental) {
+        // Source is opened before output is created
+        File const mapped_source = options_.input_mode == InputMode::kMapped
+                                           ? File{filename_.c_str()}
+                                           : File{};
+        File const& source = options_.input_mode == InputMode::kMapped ? mapped_source : file_;
+        File const output{filename, O_WRONLY | O_CREAT | O_TRUNC};
+        CopyFileContents(source, output, file_size_);
+        WriteDirtyScans(output);
+        InvalidateCache(output);
+        return;
+    }
+
+    LoadContents();
+    File const output{filename, O_WRONLY | O_CREAT | O_TRUNC};
+    output.WriteAt(GetContents(), GetContentsSize(), 0);
+    if constexpr (kStatsEnabled) {
+        ++stats_.write_calls;
+        stats_.bytes_written += GetContentsSize();
+    }
+    InvalidateCache(output);
+}
+
+void BMPReader::InvalidateCache(File const& output) {
+    if (options_.decode_cache != nullptr) {
+        options_.decode_cache->Invalidate(output.GetIdentity());
+    }
+}
+
+bool BMPReader::IsInputFile(std::string const& filename) const {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    FileIdentity const output = FileIdentity::FromStat(st);
+    FileIdentity const input = options_.input_mode == InputMode::kMapped
+                                       ? mapped_file_.GetIdentity()
+                                       : file_.GetIdentity();
+    return output.device == input.device && output.inode == input.inode;
+}
+
+void BMPReader::WriteDirtyScans(File const& output) {
+    // Merge ranges, so that every scan is written once
+    std::sort(dirty_scans_.begin(), dirty_scans_.end());
+    std::size_t merged = 0;
+    for (auto const& range : dirty_scans_) {
+        if (merged > 0 && range.first <= dirty_scans_[merged - 1].second) {
+            dirty_scans_[merged - 1].second =
+                    std::max(dirty_scans_[merged - 1].second, range.second);
+        } else {
+            dirty_scans_[merged++] = range;
         }
     }
+    dirty_scans_.resize(merged);
 
-    // Actually draw
-    for (auto const p : line) {
-        DrawPixel(p.first, p.second);
+    std::size_t const full_scan = imp_fields.GetFullScanSize();
+    for (auto const& [begin, end] : dirty_scans_) {
+        std::size_t const offset = imp_fields.offset + begin * full_scan;
+        output.WriteAt(GetContents() + offset, (end - begin) * full_scan, offset);
+        if constexpr (kStatsEnabled) {
+            ++stats_.write_calls;
+            stats_.bytes_written += (end - begin) * full_scan;
+        }
     }
 }
 }  // namespace bmp
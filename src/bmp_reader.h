@@ -1,150 +1,271 @@
 #pragma once
 
-#include <filesystem>
-#include <fstream>
+#include <cstdint>
 #include <ios>
 #include <iostream>
 #include <istream>
-#include <sstream>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <utility>
 #include <unistd.h>
 #include <vector>
 
+#include "binary_image.h"
+#include "decoded_image.h"
+#include "draw_list.h"
+#include "header_reader.h"
+#include "important_fields.h"
+#include "reader_options.h"
+#include "reader_stats.h"
+#include "scan_decoder.h"
 #include "util/color.h"
+#include "util/arena.h"
 #include "util/field_types.h"
+#include "util/file.h"
+#include "util/function_ref.h"
+#include "util/mapped_file.h"
 #include "util/ms_constants.h"
+#include "util/span_stream_buf.h"
+#include "util/thread_pool.h"
 
 namespace bmp {
-/// @brief Reads BMP file into 2D bitset
+/// @brief Reads BMP file into bit-packed black-and-white image.
+/// One reader may process many files (see @c Open): buffers are kept between files, so reading
+/// images of the same size and format makes no allocations after the first one
 class BMPReader {
 public:
-    /// @brief Holds header fields that are used by Reader
-    /// "New version" fields are pre-initialized (except for size_image, that must be calculated)
-    /// @note This class is made public for testing purposes
-    struct ImportantFields {
-        // Pixel data offset (bytes)
-        DWord offset;
-        // Width and height
-        DWord width;
-        DWord height;
-        // Scans order (true is bottom-up, false is top-down)
-        bool bottom_up = true;
-        // Bytes per pixel
-        Word byte_count;
-        util::Compression compression = util::Compression::RGB;
-        // Data size (bytes). CANNOT be zero
-        DWord size_image = 0;
-        // Palette
-        bool palette_used = false;
-        DWord palette_important = 0;
-        // Scans must be aligned to 32 bits
-        Word padding_bytes = 0;
+    /// @note This alias is made public for testing purposes
+    using ImportantFields = bmp::ImportantFields;
+
+    /// @brief Pixel data reads, made by @c ReadData (stream mode)
+    struct IOCounters {
+        std::size_t read_calls = 0;
+        std::uint64_t bytes_read = 0;
     };
 
 private:
-    // Standard masks
-    constexpr static DWord kStandRMask = 0x00FF0000;
-    constexpr static DWord kStandGMask = 0x0000FF00;
-    constexpr static DWord kStandBMask = 0x000000FF;
+    // Upper bound for amount of pixel data that is decoded by one parallel task
+    constexpr static std::size_t kMaxChunkBytes = 4 << 20;
 
-	// Input BMP
-    std::ifstream ifs_;
+    ReaderOptions options_;
+    // Long-living buffers (pixel data, contents, color table) are allocated here
+    std::pmr::memory_resource* resource_;
+    // Scratch buffers of one operation (blocks of scans, luma). Reset by every ReadData
+    util::ArenaResource arena_;
+    std::pmr::string filename_;
+    // Input BMP, for positional reads (InputMode::kStream)
+    util::File file_;
+    // Whole BMP, is being edited on Draw* (InputMode::kStream).
+    // Loaded only when it is needed, see LoadContents
+    std::pmr::vector<Byte> contents_;
+    // Input BMP (InputMode::kMapped). Pages are private, so Draw* edits them in place
+    util::MappedFile mapped_file_;
+    // Headers are read from mapped_file_ (InputMode::kMapped) or with one pread from file_
+    util::SpanStreamBuf contents_buf_;
+    std::istream contents_is_;
     ImportantFields imp_fields;
-    std::vector<std::vector<bool>> pixel_data_;
-    // Holds the whole BMP contents and is being edited on Draw*
-    std::stringstream bmp_contents_;
+    // Color table of 1, 4 and 8-bit BMPs and its entry that is drawn as black
+    Palette palette_;
+    Byte black_index_ = 0;
+    BinaryImage pixel_data_;
 
 	// Input file size. Used to check headers
-    DWord file_size_;
+    std::uint64_t file_size_ = 0;
 
-    void ReadFileHeader();
-    void ReadInfoHeader();
+    // Created on first parallel ReadData
+    std::unique_ptr<util::ThreadPool> thread_pool_;
 
-    void ReadCoreInfoHeader();
-    void ReadNewInfoHeader();
+    IOCounters io_counters_;
+    // Pixel data reads are counted in io_counters_ and merged by GetStats
+    ReaderStats stats_;
 
-    [[nodiscard]] util::RGBColor Read24bitPixel();
-    [[nodiscard]] util::RGBColor Read32bitPixel();
+    // Ranges [begin, end) of scans (file order) that were edited since input was opened.
+    // Ranges may overlap until they are merged on save
+    std::pmr::vector<std::pair<std::size_t, std::size_t>> dirty_scans_;
 
-    /// @note Bottom-up coordinates are used (i. e. bottom-left corner is 0)
-    void DrawPixel(DWord x, DWord y);
+    /// @brief Whether contents are in memory: mapped, or loaded (and maybe drawn on) in stream mode.
+    /// Scans are then decoded from contents, so that pixel data shows what was drawn
+    bool HasContents() const {
+        return options_.input_mode == InputMode::kMapped || !contents_.empty();
+    }
 
-    void DrawLine(DWord x1, DWord y1, DWord x2, DWord y2);
+    /// @brief Get pointer to the first scan in contents (checks that all scans are there)
+    Byte const* GetContentScans() const;
 
-public:
-    /// @param filename -- BMP filename
-    BMPReader(std::string const& filename)
-        : ifs_(filename), file_size_(std::filesystem::file_size(filename)) {
-        // Copy contents of BMP and reset position
-        ifs_ >> bmp_contents_.rdbuf();
-        ifs_.seekg(0);
+    /// @brief Decode and threshold the whole pixel data into @c pixel_data_
+    void Decode();
+
+    /// @brief Receives @p count scans that start from scan @p first_scan (in file order)
+    using ScanBlockSink =
+            util::FunctionRef<void(Byte const* scans, std::size_t first_scan, std::size_t count)>;
+
+    /// @brief Pass all scans of pixel data to @p sink, block by block. Blocks are read according
+    /// to input mode; with several threads @p sink is called concurrently
+    void ForEachScanBlock(ScanBlockSink sink);
+
+    /// @brief Pass blocks of @p block_scans scans to @p sink while next blocks are being read
+    void ForEachScanBlockReadAhead(std::size_t block_scans, ScanBlockSink sink);
+
+    /// @brief Split scans into chunks and pass them to @p sink on thread pool
+    void ForEachScanBlockParallel(ScanBlockSink sink);
+
+    /// @brief Byte range [begin_byte, begin_byte + row_bytes) of @p height scans starting from scan
+    /// @p first_scan (in file order)
+    struct RegionSpan {
+        std::size_t first_scan;
+        std::size_t height;
+        std::size_t begin_byte;
+        std::size_t row_bytes;
+    };
+
+    /// @brief Receives @p count region scans that start from region scan @p first_scan (in file
+    /// order). Scans are @p scan_size bytes apart
+    using RegionBlockSink = util::FunctionRef<void(Byte const* scans, std::size_t scan_size,
+                                                   std::size_t first_scan, std::size_t count)>;
+
+    /// @brief Pass region scans to @p sink block by block, reading only bytes of @p span
+    /// (and short gaps between them)
+    void ForEachRegionBlock(RegionSpan const& span, RegionBlockSink sink);
+
+    /// @brief Decode scans of @p span according to threshold mode
+    /// @param skip -- number of decoded pixels before region
+    BinaryImage DecodeRegion(ScanDecoder const& decoder, RegionSpan const& span, std::size_t skip,
+                             std::size_t width);
+
+    /// @brief Threshold @p count scans that start from scan @p first_scan (in file order)
+    void DecodeScans(ScanDecoder const& decoder, Byte const* scans, std::size_t first_scan,
+                     std::size_t count);
+
+    /// @brief Decode RLE8 or RLE4 pixel data. Scans have different sizes, so it is sequential
+    void ReadRLEData();
+
+    /// @brief Scans are stored top-down in pixel data
+    std::size_t GetPixelDataRow(std::size_t scan_num) const {
+        return imp_fields.bottom_up ? imp_fields.height - scan_num - 1 : scan_num;
     }
 
-	/// @brief Read and check BMP metadata. Must be called before any other operations
-    void ReadHeaders() {
-        ReadFileHeader();
-        ReadInfoHeader();
-
-        if (imp_fields.size_image == 0) {
-            imp_fields.size_image = imp_fields.width * imp_fields.height * imp_fields.byte_count;
-        }
-
-        if (imp_fields.byte_count != 4) {
-            imp_fields.padding_bytes = imp_fields.width * imp_fields.byte_count % 4;
-            if (imp_fields.padding_bytes > 0) {
-                imp_fields.padding_bytes = 4 - imp_fields.padding_bytes;
-            }
-        }
+    /// @brief Read whole BMP into contents_ unless it is mapped or already loaded
+    void LoadContents();
+
+    /// @brief Whole BMP, as it will be saved. Must be loaded with @c LoadContents
+    Byte* GetContents() {
+        return options_.input_mode == InputMode::kMapped ? mapped_file_.GetData()
+                                                         : contents_.data();
+    }
+
+    std::size_t GetContentsSize() const {
+        return options_.input_mode == InputMode::kMapped ? mapped_file_.GetSize()
+                                                         : contents_.size();
     }
 
-	/// @brief Read BMP pixel data
+    /// @brief Remember that scan @p scan_num (file order) was edited
+    void MarkDirty(std::size_t scan_num);
+
+    /// @brief Write all edited scans to @p output, that holds the original BMP
+    void WriteDirtyScans(util::File const& output);
+
+    /// @brief Drop cached rasters of @p output, that was just written. Same-size writes may keep
+    /// its modification time
+    void InvalidateCache(util::File const& output);
+
+    /// @brief Whether @p filename is the input file (the same inode, maybe by another path)
+    bool IsInputFile(std::string const& filename) const;
+
+public:
+    /// @brief Create reader without input, use @c Open before anything else
+    /// @param options -- reader settings
+    /// @param resource -- where buffers are allocated. Must outlive the reader
+    explicit BMPReader(ReaderOptions options = {},
+                       std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    /// @param filename -- BMP filename
+    /// @param options -- reader settings
+    /// @param resource -- where buffers are allocated. Must outlive the reader
+    BMPReader(std::string const& filename, ReaderOptions options = {},
+              std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    BMPReader(BMPReader const&) = delete;
+    BMPReader& operator=(BMPReader const&) = delete;
+
+	/// @brief Close current input (see @c Reset) and open @p filename. @c ReadHeaders must be
+	/// called next
+    void Open(std::string const& filename);
+
+	/// @brief Close current input (see @c Reset) and change settings for the next @c Open
+    void SetOptions(ReaderOptions const& options);
+
+	/// @brief Close input and forget everything about it. Unsaved edits are lost.
+	/// Buffers are kept for the next file, statistics are kept too
+    void Reset();
+
+	/// @brief Read and check BMP metadata. Must be called before any other operations.
+	/// Only headers are read, use @c ProbeBMP if nothing else is needed
+    void ReadHeaders();
+
+	/// @brief Read BMP pixel data. With @c ReaderOptions::decode_cache decoded raster is taken
+	/// from the cache if the same file was decoded with the same threshold settings. Cache is not
+	/// used once anything was drawn: what was drawn before is decoded too, in both input modes
     void ReadData();
 
+	/// @brief Decode only pixels <tt>[x, x + width) x [y, y + height)</tt>. Only bytes of these
+	/// pixels are read, so cost depends on region size, not on file size. Pixel data is not
+	/// changed. RLE BMPs are decoded whole, then cropped
+	/// @note Bottom-up coordinates are used, as in @c DrawCross: (x, y) is the bottom-left corner
+	/// of region. Returned image is top-down, as @c GetPixelData. Otsu and adaptive thresholds are
+	/// computed from the region
+	/// @throw std::out_of_range if region is not inside the image
+    BinaryImage ReadRegion(DWord x, DWord y, DWord width, DWord height);
+
+	/// @brief Draw all primitives of @p draw_list on BMP.
+	/// Pixel data and BMP contents are updated in one pass over affected rows. Pixel data is
+	/// updated only if it was read, so huge images can be edited in mapped mode without decoding
+    void Draw(DrawList const& draw_list);
+
 	/// @brief Draw "X" on BMP
+	/// @note Bottom-up coordinates are used (i. e. bottom-left corner is 0)
     void DrawCross(DWord x1, DWord y1, DWord x2, DWord y2) {
-        DrawLine(x1, y1, x2, y2);
-        DrawLine(x1, y2, x2, y1);
+        DrawList draw_list;
+        draw_list.AddCross(x1, y1, x2, y2);
+        Draw(draw_list);
     }
 
 	/// @brief Save edited BMP
-    void SaveBMP(std::string const& filename) {
-        std::ofstream ofs{filename};
-        ofs << bmp_contents_.rdbuf();
-    }
+	/// @param mode -- with @c SaveMode::kIncremental and @c SaveMode::kInPlace only scans that
+	/// were changed by Draw* are written, so saving costs as much as editing. Input file is
+	/// always saved in place, so that it is never truncated before it is copied
+    void SaveBMP(std::string const& filename, SaveMode mode = SaveMode::kFull);
 
-	/// @brief Get BMP data as an array of @c bools.
-	/// @c true is black, @c false is white.
-    std::vector<std::vector<bool>> const& GetPixelData() const {
+	/// @brief Get BMP data as bit-packed image (top-down).
+	/// @c true is black, @c false is white. Use @c BinaryImage::ToBoolMatrix to get an array of
+	/// @c bools.
+    BinaryImage const& GetPixelData() const {
         return pixel_data_;
     }
 
+	/// @brief Move headers, pixel data and contents (with edits made so far) into an immutable
+	/// image, that may be shared by threads and annotated with @c ImageEditor. Reader is @c Reset.
+	/// Must be called after @c ReadData
+	/// @note Buffers are moved if reader uses the default memory resource, copied otherwise.
+	/// Mapped input is always copied, so that the image does not change with the file
+    std::shared_ptr<DecodedImage const> ReleaseImage();
+
+    /// @brief Size of the input file (bytes), 0 if nothing is open
+    std::uint64_t GetFileSize() const {
+        return file_size_;
+    }
+
+    IOCounters const& GetIOCounters() const {
+        return io_counters_;
+    }
+
+	/// @brief Time, I/O and allocations of every phase. Zeros unless library is built with
+	/// statistics (see @c kStatsEnabled)
+    ReaderStats GetStats() const;
+
     // For testing purposes only
     ImportantFields const& GetImportantFields() const {
         return imp_fields;
     }
 };
-
-// This operator is useful in tests
-inline std::ostream& operator<<(std::ostream& os, BMPReader::ImportantFields const& imp_f) {
-    os << "{\n";
-    os << "\toffset: " << imp_f.offset << '\n';
-    os << "\twidth: " << imp_f.width << '\n';
-    os << "\theight: " << imp_f.height << '\n';
-    os << "\tbottom-up: " << std::boolalpha << imp_f.bottom_up << '\n';
-    os << "\tbyte count: " << imp_f.byte_count << '\n';
-    os << "\tcompression method: " << static_cast<Word>(imp_f.compression) << '\n';
-    os << "\timage size: " << imp_f.size_image << '\n';
-    os << "\tpalette used: " << std::boolalpha << imp_f.palette_used << '\n';
-    os << "\tpalette important fields: " << imp_f.palette_important << '\n';
-    os << "\tpadding bytes: " << imp_f.padding_bytes << '\n';
-    os << "}\n";
-    return os;
-}
-
-inline bool operator==(BMPReader::ImportantFields const& a, BMPReader::ImportantFields const& b) {
-    return a.offset == b.offset && a.width == b.width && a.height == b.height &&
-           a.bottom_up == b.bottom_up && a.byte_count == b.byte_count &&
-           a.compression == b.compression && a.size_image == b.size_image &&
-           a.palette_used == b.palette_used && a.palette_important == b.palette_important &&
-           a.padding_bytes == b.padding_bytes;
-}
 }  // namespace bmp
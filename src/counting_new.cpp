@@ -0,0 +1,46 @@
+// Replacement of global operator new that counts allocations in AllocationCounters.
+// It is not a part of the library: executables link it explicitly (target
+// BMPReader_counting_new), as the library must not replace allocation functions of applications
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#include "reader_stats.h"
+
+void* operator new(std::size_t size) {
+    bmp::CountAllocation(size);
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+// Pixel data of BinaryImage is over-aligned
+void* operator new(std::size_t size, std::align_val_t align) {
+    bmp::CountAllocation(size);
+    auto const alignment = static_cast<std::size_t>(align);
+    // Size for aligned_alloc must be a multiple of alignment
+    std::size_t const rounded = (std::max<std::size_t>(size, 1) + alignment - 1) & ~(alignment - 1);
+    if (void* ptr = std::aligned_alloc(alignment, rounded)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
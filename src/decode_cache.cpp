@@ -0,0 +1,261 @@
+#include "decode_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#include "util/file.h"
+#include "util/io_error.h"
+#include "util/mapped_file.h"
+
+namespace bmp {
+
+using namespace util;
+
+namespace {
+constexpr char kMagic[8] = {'B', 'M', 'P', 'D', 'C', '0', '0', '1'};
+// Scans start at this offset, so they are aligned when entry is mapped
+constexpr std::size_t kHeaderSize = 128;
+
+struct EntryHeader {
+    char magic[8];
+    std::uint64_t width;
+    std::uint64_t height;
+    std::uint64_t device;
+    std::uint64_t inode;
+    std::uint64_t size;
+    std::int64_t mtime_ns;
+    std::uint32_t mode;
+    std::uint32_t max_black_sum;
+    std::uint32_t max_black_luma;
+    std::uint32_t adaptive_percent;
+    std::uint64_t adaptive_window;
+};
+
+static_assert(sizeof(EntryHeader) <= kHeaderSize);
+
+EntryHeader MakeHeader(DecodeKey const& key) {
+    EntryHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.width = key.width;
+    header.height = key.height;
+    header.device = key.file.device;
+    header.inode = key.file.inode;
+    header.size = key.file.size;
+    header.mtime_ns = key.file.mtime_ns;
+    header.mode = static_cast<std::uint32_t>(key.mode);
+    header.max_black_sum = key.max_black_sum;
+    header.max_black_luma = key.max_black_luma;
+    header.adaptive_percent = key.adaptive_percent;
+    header.adaptive_window = key.adaptive_window;
+    return header;
+}
+
+std::size_t GetImageBytes(BinaryImage const& image) {
+    return image.GetStride() * image.GetHeight() * sizeof(BinaryImage::BitWord);
+}
+}  // namespace
+
+DecodeKey::DecodeKey(FileIdentity const& file, std::uint64_t width, std::uint64_t height,
+                     ThresholdOptions const& threshold)
+    : file(file), width(width), height(height), mode(threshold.mode) {
+    switch (threshold.mode) {
+        case ThresholdMode::kFixed:
+            max_black_sum = threshold.max_black_sum;
+            break;
+        case ThresholdMode::kLuma:
+            max_black_luma = threshold.max_black_luma;
+            break;
+        case ThresholdMode::kOtsu:
+            break;
+        case ThresholdMode::kAdaptive:
+            adaptive_percent = threshold.adaptive_percent;
+            adaptive_window = threshold.adaptive_window;
+            break;
+    }
+}
+
+std::uint64_t DecodeKey::Hash() const {
+    // FNV-1a
+    std::uint64_t hash = 0xcbf29ce484222325;
+    for (std::uint64_t const value :
+         {file.device, file.inode, file.size, static_cast<std::uint64_t>(file.mtime_ns), width,
+          height, static_cast<std::uint64_t>(mode), std::uint64_t{max_black_sum},
+          std::uint64_t{max_black_luma}, std::uint64_t{adaptive_percent}, adaptive_window}) {
+        for (int byte = 0; byte < 8; ++byte) {
+            hash = (hash ^ ((value >> (byte * 8)) & 0xFF)) * 0x100000001b3;
+        }
+    }
+    return hash;
+}
+
+DecodeCache::DecodeCache(DecodeCacheOptions options) : options_(std::move(options)) {
+    if (!options_.directory.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(options_.directory, ec);
+        if (ec) {
+            throw IOError("cannot create cache directory " + options_.directory + ": " +
+                          ec.message());
+        }
+    }
+}
+
+std::string DecodeCache::GetFileDirectory(FileIdentity const& file) const {
+    std::ostringstream path;
+    path << options_.directory << '/' << std::hex << file.device << '-' << file.inode;
+    return path.str();
+}
+
+std::string DecodeCache::GetEntryPath(DecodeKey const& key) const {
+    std::ostringstream path;
+    path << GetFileDirectory(key.file) << '/' << std::hex << std::setw(16) << std::setfill('0')
+         << key.Hash() << ".bmpdc";
+    return path.str();
+}
+
+bool DecodeCache::LoadFromDisk(DecodeKey const& key, BinaryImage& image) const {
+    if (options_.directory.empty()) {
+        return false;
+    }
+    std::string const path = GetEntryPath(key);
+    if (access(path.c_str(), F_OK) != 0) {
+        return false;
+    }
+    MappedFile entry;
+    try {
+        entry = MappedFile(path.c_str());
+    } catch (IOError const&) {
+        return false;
+    }
+    if (entry.GetSize() < kHeaderSize) {
+        return false;
+    }
+    EntryHeader header;
+    std::memcpy(&header, entry.GetData(), sizeof(header));
+    EntryHeader const expected = MakeHeader(key);
+    // Entry of another key with the same hash (or of an image of another size), or a broken one
+    if (std::memcmp(&header, &expected, sizeof(header)) != 0 ||
+        entry.GetSize() != kHeaderSize + BinaryImage::WordsPerRow(header.width) * header.height *
+                                                 sizeof(BinaryImage::BitWord)) {
+        return false;
+    }
+    image.Assign(header.width, header.height,
+                 reinterpret_cast<BinaryImage::BitWord const*>(entry.GetData() + kHeaderSize));
+    return true;
+}
+
+void DecodeCache::SaveToDisk(DecodeKey const& key, BinaryImage const& image) const {
+    if (options_.directory.empty()) {
+        return;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(GetFileDirectory(key.file), ec);
+    if (ec) {
+        return;
+    }
+    std::string const path = GetEntryPath(key);
+    std::string const temp_path =
+            path + ".tmp." + std::to_string(getpid()) + '.' +
+            std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    try {
+        File const file{temp_path, O_WRONLY | O_CREAT | O_TRUNC};
+        Byte header[kHeaderSize] = {};
+        EntryHeader const entry_header = MakeHeader(key);
+        std::memcpy(header, &entry_header, sizeof(entry_header));
+        file.WriteAt(header, kHeaderSize, 0);
+        file.WriteAt(image.GetRow(0), GetImageBytes(image), kHeaderSize);
+    } catch (IOError const&) {
+        std::remove(temp_path.c_str());
+        return;
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+    }
+}
+
+void DecodeCache::Remember(DecodeKey const& key, BinaryImage const& image) {
+    if (auto it = index_.find(key); it != index_.end()) {
+        memory_used_ -= GetImageBytes(it->second->image);
+        entries_.erase(it->second);
+        index_.erase(it);
+    }
+    std::size_t const bytes = GetImageBytes(image);
+    if (bytes > options_.memory_budget) {
+        return;
+    }
+    while (memory_used_ + bytes > options_.memory_budget) {
+        memory_used_ -= GetImageBytes(entries_.back().image);
+        index_.erase(entries_.back().key);
+        entries_.pop_back();
+        ++stats_.evictions;
+    }
+    entries_.push_front({key, image});
+    index_.emplace(key, entries_.begin());
+    memory_used_ += bytes;
+}
+
+bool DecodeCache::Lookup(DecodeKey const& key, BinaryImage& image) {
+    {
+        std::lock_guard lock{mutex_};
+        if (auto it = index_.find(key); it != index_.end()) {
+            entries_.splice(entries_.begin(), entries_, it->second);
+            BinaryImage const& cached = it->second->image;
+            image.Assign(cached.GetWidth(), cached.GetHeight(), cached.GetRow(0));
+            ++stats_.memory_hits;
+            return true;
+        }
+    }
+    // Disk is read without lock, so that other threads are not blocked
+    bool const found = LoadFromDisk(key, image);
+    std::lock_guard lock{mutex_};
+    if (found) {
+        ++stats_.disk_hits;
+        Remember(key, image);
+    } else {
+        ++stats_.misses;
+    }
+    return found;
+}
+
+void DecodeCache::Insert(DecodeKey const& key, BinaryImage const& image) {
+    SaveToDisk(key, image);
+    std::lock_guard lock{mutex_};
+    Remember(key, image);
+}
+
+void DecodeCache::Invalidate(FileIdentity const& file) {
+    {
+        std::lock_guard lock{mutex_};
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            if (it->key.file.device == file.device && it->key.file.inode == file.inode) {
+                memory_used_ -= GetImageBytes(it->image);
+                index_.erase(it->key);
+                it = entries_.erase(it);
+                ++stats_.invalidations;
+            } else {
+                ++it;
+            }
+        }
+    }
+    if (!options_.directory.empty()) {
+        std::error_code ec;
+        std::filesystem::remove_all(GetFileDirectory(file), ec);
+    }
+}
+
+DecodeCacheStats DecodeCache::GetStats() const {
+    std::lock_guard lock{mutex_};
+    return stats_;
+}
+
+std::size_t DecodeCache::GetMemoryUsed() const {
+    std::lock_guard lock{mutex_};
+    return memory_used_;
+}
+}  // namespace bmp
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "binary_image.h"
+#include "reader_options.h"
+#include "util/file_identity.h"
+
+namespace bmp {
+/// @brief Identifies decoded raster: input file, its dimensions and settings that affect decoding
+struct DecodeKey {
+    util::FileIdentity file;
+    // Dimensions from headers of the file: entries of other sizes are never returned
+    std::uint64_t width = 0;
+    std::uint64_t height = 0;
+    ThresholdMode mode = ThresholdMode::kFixed;
+    std::uint32_t max_black_sum = 0;
+    std::uint32_t max_black_luma = 0;
+    std::uint32_t adaptive_percent = 0;
+    std::uint64_t adaptive_window = 0;
+
+    DecodeKey() = default;
+
+    /// @brief Settings that do not apply to @p threshold mode are left out, so they do not
+    /// cause misses
+    DecodeKey(util::FileIdentity const& file, std::uint64_t width, std::uint64_t height,
+              ThresholdOptions const& threshold);
+
+    bool operator==(DecodeKey const&) const = default;
+
+    std::uint64_t Hash() const;
+};
+
+/// @brief @c DecodeCache settings
+struct DecodeCacheOptions {
+    // Decoded rasters kept in memory (bytes). Least recently used ones are evicted
+    std::size_t memory_budget = std::size_t{256} << 20;
+    // Directory for persistent entries (created if needed). Empty means memory only
+    std::string directory{};
+};
+
+struct DecodeCacheStats {
+    std::size_t memory_hits = 0;
+    std::size_t disk_hits = 0;
+    std::size_t misses = 0;
+    std::size_t evictions = 0;
+    std::size_t invalidations = 0;
+};
+
+/// @brief Cache of decoded rasters, shared by readers (see @c ReaderOptions::decode_cache).
+/// Entries are keyed by file identity (device, inode, size and modification time) and threshold
+/// settings, so input files are never read to look them up. Writes that keep size and land within
+/// the modification time granularity are not seen by the key, so whoever writes a file calls
+/// @c Invalidate (@c BMPReader::SaveBMP and @c ImageEditor::SaveBMP do).
+/// On disk every entry is a file of 128-byte header and raw bit-packed scans, aligned to be mapped
+/// and copied as is. Entries of one input file share a subdirectory. Files are written to
+/// temporary name and renamed, so several processes may share directory. Thread-safe
+class DecodeCache {
+private:
+    struct Entry {
+        DecodeKey key;
+        BinaryImage image;
+    };
+
+    struct KeyHash {
+        std::size_t operator()(DecodeKey const& key) const {
+            return key.Hash();
+        }
+    };
+
+    DecodeCacheOptions options_;
+    mutable std::mutex mutex_;
+    // Most recently used first
+    std::list<Entry> entries_;
+    std::unordered_map<DecodeKey, std::list<Entry>::iterator, KeyHash> index_;
+    std::size_t memory_used_ = 0;
+    DecodeCacheStats stats_;
+
+    /// @brief Subdirectory of all entries of @p file (device and inode)
+    std::string GetFileDirectory(util::FileIdentity const& file) const;
+    std::string GetEntryPath(DecodeKey const& key) const;
+    bool LoadFromDisk(DecodeKey const& key, BinaryImage& image) const;
+    void SaveToDisk(DecodeKey const& key, BinaryImage const& image) const;
+    /// @brief Keep @p image in memory and evict entries that do not fit. Lock must be held
+    void Remember(DecodeKey const& key, BinaryImage const& image);
+
+public:
+    /// @throw IOError if directory cannot be created
+    explicit DecodeCache(DecodeCacheOptions options = {});
+
+    /// @brief Copy cached raster into @p image (allocation of @p image is reused)
+    /// @return @c false if there is no such entry
+    bool Lookup(DecodeKey const& key, BinaryImage& image);
+
+    /// @brief Add or replace entry. Failures to write disk entry are ignored: cache stays
+    /// correct, just colder
+    void Insert(DecodeKey const& key, BinaryImage const& image);
+
+    /// @brief Remove entries of @p file (device and inode, whatever its size and modification
+    /// time), in memory and on disk. Called after the file is written
+    void Invalidate(util::FileIdentity const& file);
+
+    DecodeCacheStats GetStats() const;
+
+    /// @brief Bytes of rasters kept in memory
+    std::size_t GetMemoryUsed() const;
+};
+}  // namespace bmp
@@ -0,0 +1,13 @@
+#include "decoded_image.h"
+
+#include "bmp_reader.h"
+
+namespace bmp {
+std::shared_ptr<DecodedImage const> DecodedImage::Decode(std::string const& filename,
+                                                         ReaderOptions const& options) {
+    BMPReader reader{filename, options};
+    reader.ReadHeaders();
+    reader.ReadData();
+    return reader.ReleaseImage();
+}
+}  // namespace bmp
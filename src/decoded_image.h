@@ -0,0 +1,98 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <string>
+
+#include "binary_image.h"
+#include "header_reader.h"
+#include "important_fields.h"
+#include "reader_options.h"
+#include "util/field_types.h"
+#include "util/file_identity.h"
+
+namespace bmp {
+/// @brief Decoded BMP that never changes: headers, color table, pixel data and a copy of the
+/// original file contents. Every method is const and the only state that changes is whether the
+/// source file was saved over (atomic flag), so any number of threads may read one image without
+/// locks. Images are shared with @c std::shared_ptr and annotated with
+/// @c ImageEditor, which copies only the rows it changes
+class DecodedImage {
+private:
+    friend class BMPReader;
+    friend class ImageEditor;
+
+    ImportantFields imp_fields_;
+    Palette palette_;
+    Byte black_index_ = 0;
+    BinaryImage pixel_data_;
+    // Original BMP. Never a mapping of the file: writes to the file would show through it
+    std::pmr::vector<Byte> contents_;
+    // File the image was decoded from, and whether contents were drawn on before release
+    util::FileIdentity source_;
+    bool source_modified_ = false;
+    // Set by the first editor that saves over the source file: the file no longer holds contents
+    mutable std::atomic<bool> source_written_ = false;
+    // Cache the image was decoded with (ReaderOptions::decode_cache). Editors invalidate entries
+    // of the files they save
+    DecodeCache* decode_cache_ = nullptr;
+
+    /// @brief Images are made by @c BMPReader::ReleaseImage
+    DecodedImage() = default;
+
+public:
+    DecodedImage(DecodedImage const&) = delete;
+    DecodedImage& operator=(DecodedImage const&) = delete;
+
+    /// @brief Read and decode @p filename
+    /// @throw IOError if file cannot be read
+    /// @throw InvalidBMPError if file is not a valid BMP
+    static std::shared_ptr<DecodedImage const> Decode(std::string const& filename,
+                                                      ReaderOptions const& options = {});
+
+    ImportantFields const& GetImportantFields() const {
+        return imp_fields_;
+    }
+
+    /// @brief Color table of 1, 4 and 8-bit BMPs
+    Palette const& GetPalette() const {
+        return palette_;
+    }
+
+    /// @brief Palette entry that is drawn as black
+    Byte GetBlackIndex() const {
+        return black_index_;
+    }
+
+    /// @brief Decoded image (top-down), @c true is black
+    BinaryImage const& GetPixelData() const {
+        return pixel_data_;
+    }
+
+    /// @brief Whole original BMP
+    Byte const* GetContents() const {
+        return contents_.data();
+    }
+
+    std::size_t GetContentsSize() const {
+        return contents_.size();
+    }
+
+    /// @brief Identity of the file the image was decoded from
+    util::FileIdentity const& GetSourceIdentity() const {
+        return source_;
+    }
+
+    /// @brief Whether contents differ from the source file (reader drew on them before release)
+    bool IsSourceModified() const {
+        return source_modified_;
+    }
+
+    /// @brief Scan @p scan_num (file order) of uncompressed BMP, including padding
+    Byte const* GetScan(std::size_t scan_num) const {
+        return GetContents() + imp_fields_.offset + scan_num * imp_fields_.GetFullScanSize();
+    }
+};
+}  // namespace bmp
@@ -0,0 +1,118 @@
+#include "draw_list.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "util/bitmap_info_header.h"
+#include "util/line_rasterizer.h"
+
+namespace bmp {
+
+namespace {
+/// @brief Set pixels <tt>[x_begin, x_end)</tt> of 1, 4 or 8-bit scan to palette entry @p index
+void FillIndices(Byte* scan, Word bit_count, std::size_t x_begin, std::size_t x_end, Byte index) {
+    std::size_t const pixels_per_byte = 8 / bit_count;
+    Byte const index_mask = (1u << bit_count) - 1;
+    // Byte, all pixels of which are index
+    Byte const pattern = index * (0xFF / index_mask);
+    std::size_t x = x_begin;
+    while (x < x_end) {
+        if (x % pixels_per_byte == 0 && x_end - x >= pixels_per_byte) {
+            std::size_t const bytes = (x_end - x) / pixels_per_byte;
+            std::memset(scan + x / pixels_per_byte, pattern, bytes);
+            x += bytes * pixels_per_byte;
+            continue;
+        }
+        // Pixels are stored from the highest bits
+        std::size_t const shift = 8 - bit_count * (x % pixels_per_byte + 1);
+        Byte& byte = scan[x / pixels_per_byte];
+        byte = (byte & ~(index_mask << shift)) | (index << shift);
+        ++x;
+    }
+}
+
+/// @brief Collects spans, dropping everything that is outside of image
+class SpanCollector {
+private:
+    DWord width_;
+    DWord height_;
+    std::vector<DrawList::Span>& spans_;
+
+public:
+    SpanCollector(DWord width, DWord height, std::vector<DrawList::Span>& spans)
+        : width_(width), height_(height), spans_(spans) {}
+
+    /// @brief Add pixels [x1, x2] of row y
+    void AddSpan(DWord y, DWord x1, DWord x2) {
+        if (x1 > x2) {
+            std::swap(x1, x2);
+        }
+        if (y >= height_ || x1 >= width_) {
+            return;
+        }
+        spans_.push_back({y, x1, std::min(x2, width_ - 1) + 1});
+    }
+
+    void AddPixel(DWord x, DWord y) {
+        AddSpan(y, x, x);
+    }
+
+    void AddLine(DWord x1, DWord y1, DWord x2, DWord y2) {
+        // Rasterizer clips runs itself
+        util::RasterizeLine(x1, y1, x2, y2, width_, height_,
+                            [this](std::int64_t y, std::int64_t x_begin, std::int64_t x_end) {
+                                spans_.push_back({static_cast<DWord>(y),
+                                                  static_cast<DWord>(x_begin),
+                                                  static_cast<DWord>(x_end)});
+                            });
+    }
+};
+
+}  // namespace
+
+std::vector<DrawList::Span> DrawList::Rasterize(DWord width, DWord height) const {
+    std::vector<Span> spans;
+    SpanCollector collector{width, height, spans};
+    for (auto const& p : primitives_) {
+        switch (p.kind) {
+            case Kind::kPoint:
+                collector.AddPixel(p.x1, p.y1);
+                break;
+            case Kind::kLine:
+                collector.AddLine(p.x1, p.y1, p.x2, p.y2);
+                break;
+            case Kind::kRect:
+                collector.AddSpan(p.y1, p.x1, p.x2);
+                collector.AddSpan(p.y2, p.x1, p.x2);
+                collector.AddLine(p.x1, p.y1, p.x1, p.y2);
+                collector.AddLine(p.x2, p.y1, p.x2, p.y2);
+                break;
+            case Kind::kFilledRect: {
+                auto const [y_min, y_max] = std::minmax(p.y1, p.y2);
+                for (auto y = y_min; y <= y_max && y < height; ++y) {
+                    collector.AddSpan(y, p.x1, p.x2);
+                }
+                break;
+            }
+        }
+    }
+
+    // Rows are then visited in the order they are stored in memory
+    std::sort(spans.begin(), spans.end(), [](Span const& a, Span const& b) {
+        return a.y < b.y || (a.y == b.y && a.x_begin < b.x_begin);
+    });
+    return spans;
+}
+
+void FillScan(Byte* scan, ImportantFields const& imp_fields, std::size_t x_begin,
+              std::size_t x_end, Byte black_index) {
+    if (util::IsIndexed(imp_fields.bit_count)) {
+        FillIndices(scan, imp_fields.bit_count, x_begin, x_end, black_index);
+    } else {
+        std::memset(scan + x_begin * imp_fields.byte_count, 0,
+                    (x_end - x_begin) * imp_fields.byte_count);
+    }
+}
+}  // namespace bmp
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "important_fields.h"
+#include "util/field_types.h"
+
+namespace bmp {
+/// @brief Queue of primitives that are drawn in black.
+/// Primitives are turned into horizontal spans, which are applied to image in one pass.
+/// @note Bottom-up coordinates are used (i. e. bottom-left corner is 0). Ends are inclusive
+class DrawList {
+public:
+    /// @brief Pixels <tt>[x_begin, x_end)</tt> of row @c y
+    struct Span {
+        DWord y;
+        DWord x_begin;
+        DWord x_end;
+
+        bool operator==(Span const&) const = default;
+    };
+
+private:
+    enum class Kind { kPoint, kLine, kRect, kFilledRect };
+
+    struct Primitive {
+        Kind kind;
+        DWord x1, y1, x2, y2;
+    };
+
+    std::vector<Primitive> primitives_;
+
+public:
+    void AddPoint(DWord x, DWord y) {
+        primitives_.push_back({Kind::kPoint, x, y, x, y});
+    }
+
+    void AddLine(DWord x1, DWord y1, DWord x2, DWord y2) {
+        primitives_.push_back({Kind::kLine, x1, y1, x2, y2});
+    }
+
+    /// @brief "X" inside of rectangle with corners (x1, y1) and (x2, y2)
+    void AddCross(DWord x1, DWord y1, DWord x2, DWord y2) {
+        AddLine(x1, y1, x2, y2);
+        AddLine(x1, y2, x2, y1);
+    }
+
+    /// @brief Outline of rectangle with corners (x1, y1) and (x2, y2)
+    void AddRect(DWord x1, DWord y1, DWord x2, DWord y2) {
+        primitives_.push_back({Kind::kRect, x1, y1, x2, y2});
+    }
+
+    void AddFilledRect(DWord x1, DWord y1, DWord x2, DWord y2) {
+        primitives_.push_back({Kind::kFilledRect, x1, y1, x2, y2});
+    }
+
+    std::size_t GetSize() const {
+        return primitives_.size();
+    }
+
+    bool IsEmpty() const {
+        return primitives_.empty();
+    }
+
+    void Clear() {
+        primitives_.clear();
+    }
+
+    /// @brief Turn all primitives into spans, clipped to @p width x @p height image.
+    /// Spans are sorted by row, then by @c x_begin. They may overlap
+    std::vector<Span> Rasterize(DWord width, DWord height) const;
+};
+
+/// @brief Paint pixels <tt>[x_begin, x_end)</tt> of uncompressed BMP scan black. Black is all
+/// zeros in 16, 24 and 32-bit BMPs, indexed BMPs use palette entry @p black_index
+void FillScan(Byte* scan, ImportantFields const& imp_fields, std::size_t x_begin,
+              std::size_t x_end, Byte black_index);
+}  // namespace bmp
@@ -0,0 +1,254 @@
+#include "header_reader.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <istream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "util/bitmap_file_header.h"
+#include "util/bitfields_kernel.h"
+#include "util/bitmap_info_header.h"
+#include "util/invalid_bmp_error.h"
+#include "util/io_error.h"
+#include "util/ms_constants.h"
+#include "util/span_stream_buf.h"
+
+namespace bmp {
+
+using namespace util;
+
+namespace {
+// Standard masks of 32-bit BMPs
+constexpr DWord kStandRMask = 0x00FF0000;
+constexpr DWord kStandGMask = 0x0000FF00;
+constexpr DWord kStandBMask = 0x000000FF;
+// Masks of 16-bit BMPs without BITFIELDS compression (5 bits per channel)
+constexpr DWord k555RMask = 0x7C00;
+constexpr DWord k555GMask = 0x03E0;
+constexpr DWord k555BMask = 0x001F;
+
+/// @brief Read masks that follow version 3 info header or belong to newer headers
+void ReadMasks(std::istream& is, DWord h_size, ImportantFields& imp_fields) {
+    DWord masks[4] = {};
+    // Alpha mask is present in headers starting from 56-byte one
+    std::size_t const count =
+            h_size >= 56 || imp_fields.compression == Compression::ALPHABITFIELDS ? 4 : 3;
+    if (!is.read(reinterpret_cast<char*>(masks), count * sizeof(DWord))) {
+        throw IOError("cannot read bit mask");
+    }
+    imp_fields.red_mask = masks[0];
+    imp_fields.green_mask = masks[1];
+    imp_fields.blue_mask = masks[2];
+    imp_fields.alpha_mask = masks[3];
+
+    DWord const pixel_mask =
+            imp_fields.bit_count >= 32 ? ~DWord{0} : (DWord{1} << imp_fields.bit_count) - 1;
+    for (DWord mask : {masks[0], masks[1], masks[2]}) {
+        InvalidBMPError::Assert(IsContiguousMask(mask) && (mask & ~pixel_mask) == 0,
+                                [&] { return "invalid bit mask: " + std::to_string(mask); });
+    }
+    InvalidBMPError::Assert(
+            (masks[0] & masks[1]) == 0 && (masks[0] & masks[2]) == 0 && (masks[1] & masks[2]) == 0,
+            "bit masks overlap");
+}
+
+void ReadFileHeader(std::istream& is, std::uint64_t file_size, ImportantFields& imp_fields) {
+    util::BitmapFileHeader file_header;
+    is >> file_header;
+
+    // Size of files larger than 4 GiB does not fit into the header, writers truncate it or put
+    // anything else there
+    if (file_size > 0 && file_size <= std::numeric_limits<DWord>::max()) {
+        InvalidBMPError::Assert(file_header.file_size == file_size, [&] {
+            return "invalid file size: requested " + std::to_string(file_size) +
+                   ", header says " + std::to_string(file_header.file_size);
+        });
+    }
+    imp_fields.offset = file_header.offset;
+}
+
+void ReadCoreInfoHeader(std::istream& is, ImportantFields& imp_fields) {
+    util::BitmapCoreHeader core_header;
+    is >> core_header;
+
+    imp_fields.width = core_header.width;
+    imp_fields.height = core_header.height;
+    imp_fields.byte_count = core_header.bit_count / 8;
+    imp_fields.bit_count = core_header.bit_count;
+    // CORE color table consists of RGBTRIPLEs and is always full
+    if (IsIndexed(core_header.bit_count)) {
+        imp_fields.palette_size = 1u << core_header.bit_count;
+        imp_fields.palette_entry_size = 3;
+    }
+}
+
+void ReadNewInfoHeader(std::istream& is, DWord h_size, ImportantFields& imp_fields) {
+    util::BitmapInfoHeader info_header;
+    is >> info_header;
+
+    imp_fields.width = info_header.width;
+    // Negated in 64 bits: -INT32_MIN does not fit into Long
+    imp_fields.height = static_cast<DWord>(std::abs(std::int64_t{info_header.height}));
+    imp_fields.bottom_up = info_header.height > 0;
+    imp_fields.byte_count = info_header.bit_count / 8;
+    imp_fields.bit_count = info_header.bit_count;
+    imp_fields.compression = static_cast<Compression>(info_header.compression);
+    // If size_image is 0, it will be calculated later
+    imp_fields.size_image = info_header.size_image;
+    if (info_header.clr_used > 0) {
+        imp_fields.palette_used = true;
+        imp_fields.palette_important = info_header.clr_important;
+    }
+    if (IsIndexed(info_header.bit_count)) {
+        // Indices past the end of color table cannot be used anyway
+        DWord const max_palette_size = 1u << info_header.bit_count;
+        imp_fields.palette_size = info_header.clr_used > 0
+                                          ? std::min(info_header.clr_used, max_palette_size)
+                                          : max_palette_size;
+    }
+
+    // Masks of newer headers are ignored unless compression says otherwise
+    if (imp_fields.compression == Compression::BITFIELDS ||
+        imp_fields.compression == Compression::ALPHABITFIELDS) {
+        ReadMasks(is, h_size, imp_fields);
+    }
+}
+
+void ReadInfoHeader(std::istream& is, ImportantFields& imp_fields) {
+    DWord h_size;
+    if (!is.read(reinterpret_cast<char*>(&h_size), sizeof(h_size))) {
+        throw IOError("cannot read info header size");
+    }
+    // Color table follows info header (and bit masks of version 3 header)
+    imp_fields.palette_offset = sizeof(BitmapFileHeader) + h_size;
+
+    if (h_size == 12) {
+        ReadCoreInfoHeader(is, imp_fields);
+        // 52, 54 and 56-bit headers are not documented by Microsoft, but are used sometimes
+    } else if (h_size == 40 || h_size == 52 || h_size == 54 || h_size == 56 || h_size == 108 ||
+               h_size == 124) {
+        ReadNewInfoHeader(is, h_size, imp_fields);
+        if (h_size == 40 && imp_fields.compression == Compression::BITFIELDS) {
+            imp_fields.palette_offset += 3 * sizeof(DWord);
+        } else if (h_size == 40 && imp_fields.compression == Compression::ALPHABITFIELDS) {
+            imp_fields.palette_offset += 4 * sizeof(DWord);
+        }
+    } else {
+        throw InvalidBMPError("invalid info header size: " + std::to_string(h_size));
+    }
+}
+}  // namespace
+
+ImportantFields ReadImportantFields(std::istream& is, std::uint64_t file_size) {
+    ImportantFields imp_fields;
+    ReadFileHeader(is, file_size, imp_fields);
+    ReadInfoHeader(is, imp_fields);
+
+    if (imp_fields.red_mask == 0 && imp_fields.bit_count == 16) {
+        imp_fields.red_mask = k555RMask;
+        imp_fields.green_mask = k555GMask;
+        imp_fields.blue_mask = k555BMask;
+    } else if (imp_fields.red_mask == 0 && imp_fields.bit_count == 32) {
+        imp_fields.red_mask = kStandRMask;
+        imp_fields.green_mask = kStandGMask;
+        imp_fields.blue_mask = kStandBMask;
+    }
+
+    // Scans are aligned to 32 bits
+    std::size_t const scan_size = (std::size_t{imp_fields.width} * imp_fields.bit_count + 7) / 8;
+    imp_fields.padding_bytes = (4 - scan_size % 4) % 4;
+
+    // Width and height are 31-bit, so scan size cannot overflow, but data size can
+    std::uint64_t const full_scan = imp_fields.GetFullScanSize();
+    InvalidBMPError::Assert(imp_fields.height <= std::numeric_limits<std::uint64_t>::max() /
+                                                         full_scan,
+                            "pixel data size overflows");
+    std::uint64_t const data_size = full_scan * imp_fields.height;
+    if (imp_fields.size_image == 0) {
+        imp_fields.size_image = data_size;
+    }
+    bool const compressed = imp_fields.compression == Compression::RLE8 ||
+                            imp_fields.compression == Compression::RLE4;
+    if (file_size > 0 && !compressed) {
+        InvalidBMPError::Assert(imp_fields.offset <= file_size &&
+                                        data_size <= file_size - imp_fields.offset,
+                                [&] {
+                                    return "pixel data does not fit into the file: " +
+                                           std::to_string(data_size) + " bytes at offset " +
+                                           std::to_string(imp_fields.offset);
+                                });
+    }
+
+    if (imp_fields.palette_size > 0) {
+        InvalidBMPError::Assert(imp_fields.palette_offset +
+                                                imp_fields.palette_size *
+                                                        imp_fields.palette_entry_size <=
+                                        imp_fields.offset,
+                                "color table overlaps pixel data");
+    } else {
+        imp_fields.palette_offset = 0;
+    }
+    return imp_fields;
+}
+
+ImportantFields ReadImportantFields(File const& file, std::uint64_t file_size) {
+    Byte headers[kMaxHeadersSize];
+    std::size_t const size =
+            std::min<std::uint64_t>(kMaxHeadersSize, file_size > 0 ? file_size : file.GetSize());
+    file.ReadAt(headers, size, 0);
+
+    SpanStreamBuf buf{headers, size};
+    std::istream is{&buf};
+    return ReadImportantFields(is, file_size);
+}
+
+void ReadPalette(Byte const* contents, std::size_t size, ImportantFields const& imp_fields,
+                 Palette& palette) {
+    std::size_t const palette_bytes =
+            std::size_t{imp_fields.palette_size} * imp_fields.palette_entry_size;
+    if (imp_fields.palette_offset > size || size - imp_fields.palette_offset < palette_bytes) {
+        throw IOError("cannot read color table");
+    }
+
+    // Entries are BGR, followed by reserved byte unless header is CORE
+    palette.resize(imp_fields.palette_size);
+    Byte const* entry = contents + imp_fields.palette_offset;
+    for (auto& color : palette) {
+        color = {entry[0], entry[1], entry[2]};
+        entry += imp_fields.palette_entry_size;
+    }
+}
+
+Palette ReadPalette(Byte const* contents, std::size_t size, ImportantFields const& imp_fields) {
+    Palette palette;
+    ReadPalette(contents, size, imp_fields, palette);
+    return palette;
+}
+
+void ReadPalette(File const& file, ImportantFields const& imp_fields, Palette& palette) {
+    if (imp_fields.palette_size == 0) {
+        palette.clear();
+        return;
+    }
+    // Entries take at most 4 bytes
+    std::array<Byte, kMaxPaletteSize * 4> table;
+    std::size_t const palette_bytes =
+            std::size_t{imp_fields.palette_size} * imp_fields.palette_entry_size;
+    InvalidBMPError::Assert(palette_bytes <= table.size(), "color table is too large");
+    file.ReadAt(table.data(), palette_bytes, imp_fields.palette_offset);
+
+    ImportantFields table_fields = imp_fields;
+    table_fields.palette_offset = 0;
+    ReadPalette(table.data(), palette_bytes, table_fields, palette);
+}
+
+Palette ReadPalette(File const& file, ImportantFields const& imp_fields) {
+    Palette palette;
+    ReadPalette(file, imp_fields, palette);
+    return palette;
+}
+}  // namespace bmp
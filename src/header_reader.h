@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <memory_resource>
+#include <vector>
+
+#include "important_fields.h"
+#include "util/color.h"
+#include "util/field_types.h"
+#include "util/file.h"
+
+namespace bmp {
+/// @brief Color table of 1, 4 and 8-bit BMPs
+using Palette = std::pmr::vector<util::RGBColor>;
+
+/// @brief Largest color table (8-bit BMPs)
+constexpr std::size_t kMaxPaletteSize = 256;
+
+/// @brief Read and check BMP headers.
+/// @param is -- stream, positioned at the beginning of BMP
+/// @param file_size -- actual file size, used to check headers. 0 disables the check
+/// @throw InvalidBMPError if headers are invalid, or pixel data size overflows or does not fit
+/// into the file
+ImportantFields ReadImportantFields(std::istream& is, std::uint64_t file_size);
+
+/// @brief Largest headers that describe pixel data: file header and V5 info header (bytes)
+constexpr std::size_t kMaxHeadersSize = 14 + 124;
+
+/// @brief Read and check BMP headers with one positional read of at most
+/// @c kMaxHeadersSize bytes
+/// @param file_size -- actual file size, used to check headers. 0 disables the check
+ImportantFields ReadImportantFields(util::File const& file, std::uint64_t file_size);
+
+/// @brief Read color table, described by @p imp_fields (empty if there is none)
+/// @param contents -- whole BMP or at least its headers and color table
+Palette ReadPalette(Byte const* contents, std::size_t size, ImportantFields const& imp_fields);
+
+/// @brief Same, but into @p palette. Its allocation is reused
+void ReadPalette(Byte const* contents, std::size_t size, ImportantFields const& imp_fields,
+                 Palette& palette);
+
+/// @brief Read color table with one positional read
+Palette ReadPalette(util::File const& file, ImportantFields const& imp_fields);
+
+/// @brief Same, but into @p palette. Its allocation is reused
+void ReadPalette(util::File const& file, ImportantFields const& imp_fields, Palette& palette);
+}  // namespace bmp
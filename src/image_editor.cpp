@@ -0,0 +1,157 @@
+#include "image_editor.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+#include "decode_cache.h"
+#include "util/file.h"
+#include "util/file_identity.h"
+#include "util/invalid_bmp_error.h"
+#include "util/ms_constants.h"
+
+namespace bmp {
+
+using namespace util;
+
+namespace {
+// Pixel data is saved by blocks of whole scans of about this size
+constexpr std::size_t kSaveBlockBytes = 1 << 20;
+}  // namespace
+
+ImageEditor::ImageEditor(std::shared_ptr<DecodedImage const> image)
+    : image_(std::move(image)),
+      tiles_per_row_((image_->GetImportantFields().width + kTileWidth - 1) / kTileWidth) {}
+
+std::pair<std::size_t, std::size_t> ImageEditor::GetTileBytes(std::size_t tile) const {
+    ImportantFields const& imp_fields = image_->GetImportantFields();
+    std::size_t const x_begin = tile * kTileWidth;
+    std::size_t const x_end = std::min<std::size_t>(x_begin + kTileWidth, imp_fields.width);
+    // Tiles start at whole bytes even in 1 and 4-bit scans
+    return {x_begin * imp_fields.bit_count / 8, (x_end * imp_fields.bit_count + 7) / 8};
+}
+
+ImageEditor::EditedTile& ImageEditor::GetEditedTile(std::size_t scan_num, std::size_t tile) {
+    auto [it, inserted] = tiles_.try_emplace(std::uint64_t{scan_num} * tiles_per_row_ + tile);
+    if (inserted) {
+        it->second.pixels = image_->GetPixelData().GetRow(GetPixelDataRow(scan_num))[tile];
+        auto const [begin, end] = GetTileBytes(tile);
+        std::memcpy(it->second.scan.data(), image_->GetScan(scan_num) + begin, end - begin);
+    }
+    return it->second;
+}
+
+void ImageEditor::Draw(DrawList const& draw_list) {
+    ImportantFields const& imp_fields = image_->GetImportantFields();
+    // Runs would have to be re-encoded, and scans could change their sizes
+    if (imp_fields.compression == Compression::RLE8 ||
+        imp_fields.compression == Compression::RLE4) {
+        throw InvalidBMPError("drawing on RLE BMPs is not supported");
+    }
+    for (auto const& span : draw_list.Rasterize(imp_fields.width, imp_fields.height)) {
+        std::size_t const scan_num =
+                imp_fields.bottom_up ? span.y : imp_fields.height - span.y - 1;
+        for (std::size_t tile = span.x_begin / kTileWidth; tile * kTileWidth < span.x_end;
+             ++tile) {
+            std::size_t const tile_x = tile * kTileWidth;
+            // Offsets inside of the tile
+            std::size_t const begin = std::max<std::size_t>(span.x_begin, tile_x) - tile_x;
+            std::size_t const end = std::min<std::size_t>(span.x_end, tile_x + kTileWidth) - tile_x;
+            EditedTile& edited = GetEditedTile(scan_num, tile);
+            // Spans are never empty
+            edited.pixels |= ~BinaryImage::BitWord{0} >> (kTileWidth - (end - begin)) << begin;
+            FillScan(edited.scan.data(), imp_fields, begin, end, image_->GetBlackIndex());
+        }
+    }
+}
+
+bool ImageEditor::Get(std::size_t x, std::size_t y) const {
+    std::size_t const scan_num = GetPixelDataRow(y);
+    auto const it = tiles_.find(std::uint64_t{scan_num} * tiles_per_row_ + x / kTileWidth);
+    if (it != tiles_.end()) {
+        return (it->second.pixels >> (x % kTileWidth)) & 1;
+    }
+    return image_->GetPixelData().Get(x, y);
+}
+
+BinaryImage ImageEditor::GetPixelData() const {
+    BinaryImage pixel_data = image_->GetPixelData();
+    for (auto const& [key, tile] : tiles_) {
+        pixel_data.GetRow(GetPixelDataRow(key / tiles_per_row_))[key % tiles_per_row_] =
+                tile.pixels;
+    }
+    return pixel_data;
+}
+
+bool ImageEditor::IsSourceFile(std::string const& filename) const {
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    FileIdentity const output = FileIdentity::FromStat(st);
+    FileIdentity const& source = image_->GetSourceIdentity();
+    return output.device == source.device && output.inode == source.inode;
+}
+
+void ImageEditor::SaveBMP(std::string const& filename, SaveMode mode) const {
+    ImportantFields const& imp_fields = image_->GetImportantFields();
+    std::size_t const full_scan = imp_fields.GetFullScanSize();
+    // Source file is never truncated: readers may have it mapped
+    bool const to_source = IsSourceFile(filename);
+    // Source holds contents until an editor of this image saves over it. Then every edited tile of
+    // that editor would have to be undone, so the whole pixel data is rewritten
+    bool const in_place = to_source ? !image_->IsSourceModified() &&
+                                              !image_->source_written_.exchange(true)
+                                    : mode == SaveMode::kInPlace;
+    if (in_place) {
+        File const output{filename, O_WRONLY};
+        for (auto const& [key, tile] : tiles_) {
+            auto const [begin, end] = GetTileBytes(key % tiles_per_row_);
+            output.WriteAt(tile.scan.data(), end - begin,
+                           imp_fields.offset + key / tiles_per_row_ * full_scan + begin);
+        }
+        InvalidateCache(output);
+        return;
+    }
+
+    // Source that differs from contents is rewritten in place
+    File const output{filename, to_source ? O_WRONLY : O_WRONLY | O_CREAT | O_TRUNC};
+    // Including RLE BMPs, which cannot be edited
+    if (tiles_.empty()) {
+        output.WriteAt(image_->GetContents(), image_->GetContentsSize(), 0);
+        InvalidateCache(output);
+        return;
+    }
+    // Headers and everything after pixel data are written as is, scans are patched block by
+    // block
+    output.WriteAt(image_->GetContents(), imp_fields.offset, 0);
+    std::size_t const block_scans =
+            std::clamp<std::size_t>(kSaveBlockBytes / full_scan, 1, imp_fields.height);
+    std::vector<Byte> block(block_scans * full_scan);
+    auto tile = tiles_.begin();
+    for (std::size_t first = 0; first < imp_fields.height; first += block_scans) {
+        std::size_t const count = std::min(block_scans, imp_fields.height - first);
+        std::memcpy(block.data(), image_->GetScan(first), count * full_scan);
+        for (; tile != tiles_.end() && tile->first / tiles_per_row_ < first + count; ++tile) {
+            auto const [begin, end] = GetTileBytes(tile->first % tiles_per_row_);
+            std::size_t const scan = tile->first / tiles_per_row_ - first;
+            std::memcpy(block.data() + scan * full_scan + begin, tile->second.scan.data(),
+                        end - begin);
+        }
+        output.WriteAt(block.data(), count * full_scan, imp_fields.offset + first * full_scan);
+    }
+    std::size_t const data_end = imp_fields.offset + imp_fields.height * full_scan;
+    output.WriteAt(image_->GetContents() + data_end, image_->GetContentsSize() - data_end,
+                   data_end);
+    InvalidateCache(output);
+}
+
+void ImageEditor::InvalidateCache(File const& output) const {
+    if (image_->decode_cache_ != nullptr) {
+        image_->decode_cache_->Invalidate(output.GetIdentity());
+    }
+}
+}  // namespace bmp
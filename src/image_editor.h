@@ -0,0 +1,102 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "binary_image.h"
+#include "decoded_image.h"
+#include "draw_list.h"
+#include "reader_options.h"
+#include "util/field_types.h"
+#include "util/file.h"
+
+namespace bmp {
+/// @brief Annotates shared @c DecodedImage without changing it.
+/// Image is split into tiles of @c kTileWidth pixels of one row. A tile is copied on first draw
+/// (both its decoded pixels and its bytes of file scan), everything else is read from the image.
+/// So N annotated variants of one BMP cost one decode and N small overlays, even if every row is
+/// drawn on. One editor is used by one thread at a time, editors of the same image may run
+/// concurrently
+class ImageEditor {
+public:
+    /// @brief Tile holds one word of decoded pixels
+    constexpr static std::size_t kTileWidth = BinaryImage::kBitsPerWord;
+
+private:
+    struct EditedTile {
+        BinaryImage::BitWord pixels;
+        // Bytes of file scan, at most 4 per pixel
+        std::array<Byte, kTileWidth * 4> scan;
+    };
+
+    std::shared_ptr<DecodedImage const> image_;
+    std::size_t tiles_per_row_;
+    // Copied tiles by <tt>scan_num * tiles_per_row_ + tile</tt>, i. e. in file order
+    std::map<std::uint64_t, EditedTile> tiles_;
+
+    /// @brief Scans are stored top-down in pixel data. Mapping is the same in both directions
+    std::size_t GetPixelDataRow(std::size_t scan_num) const {
+        ImportantFields const& imp_fields = image_->GetImportantFields();
+        return imp_fields.bottom_up ? imp_fields.height - scan_num - 1 : scan_num;
+    }
+
+    /// @brief Bytes <tt>[begin, end)</tt> of file scan that hold pixels of @p tile
+    std::pair<std::size_t, std::size_t> GetTileBytes(std::size_t tile) const;
+
+    /// @brief Get copy of @p tile of scan @p scan_num, making it on first call
+    EditedTile& GetEditedTile(std::size_t scan_num, std::size_t tile);
+
+    /// @brief Drop cached rasters of @p output, that was just written
+    void InvalidateCache(util::File const& output) const;
+
+    /// @brief Whether @p filename is the file image was decoded from (maybe by another path)
+    bool IsSourceFile(std::string const& filename) const;
+
+public:
+    /// @param image -- decoded BMP, see @c DecodedImage::Decode and @c BMPReader::ReleaseImage
+    explicit ImageEditor(std::shared_ptr<DecodedImage const> image);
+
+    DecodedImage const& GetImage() const {
+        return *image_;
+    }
+
+    /// @brief Draw all primitives of @p draw_list on copies of affected tiles
+    /// @throw InvalidBMPError if BMP is RLE-compressed
+    void Draw(DrawList const& draw_list);
+
+    /// @brief Draw "X" on BMP
+    /// @note Bottom-up coordinates are used (i. e. bottom-left corner is 0)
+    void DrawCross(DWord x1, DWord y1, DWord x2, DWord y2) {
+        DrawList draw_list;
+        draw_list.AddCross(x1, y1, x2, y2);
+        Draw(draw_list);
+    }
+
+    /// @brief Pixel of edited image, @p y is counted from the top as in @c BinaryImage
+    bool Get(std::size_t x, std::size_t y) const;
+
+    /// @brief Edited image as bit-packed image (top-down). The whole image is copied
+    BinaryImage GetPixelData() const;
+
+    /// @brief Number of tiles that were copied
+    std::size_t GetEditedTileCount() const {
+        return tiles_.size();
+    }
+
+    /// @brief Forget all edits
+    void Clear() {
+        tiles_.clear();
+    }
+
+    /// @brief Save edited BMP: original contents with edited tiles in place of the original ones
+    /// @param mode -- with @c SaveMode::kInPlace output must hold the original BMP already, only
+    /// edited tiles are written. Other modes write the whole BMP from memory. Source file of the
+    /// image is never truncated: only edited tiles are written while it holds the original BMP,
+    /// after any editor of the image saved over it the whole pixel data is rewritten
+    void SaveBMP(std::string const& filename, SaveMode mode = SaveMode::kFull) const;
+};
+}  // namespace bmp
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#include "util/field_types.h"
+#include "util/ms_constants.h"
+
+namespace bmp {
+/// @brief Holds header fields that are used by Reader
+/// "New version" fields are pre-initialized (except for size_image, that must be calculated)
+struct ImportantFields {
+    // Pixel data offset (bytes)
+    DWord offset = 0;
+    // Width and height
+    DWord width = 0;
+    DWord height = 0;
+    // Scans order (true is bottom-up, false is top-down)
+    bool bottom_up = true;
+    // Bytes per pixel (0 for 1 and 4-bit BMPs)
+    Word byte_count = 0;
+    // Bits per pixel
+    Word bit_count = 0;
+    util::Compression compression = util::Compression::RGB;
+    // Data size (bytes). CANNOT be zero. 64-bit, since uncompressed images larger than 4 GiB
+    // leave the header field zero
+    std::uint64_t size_image = 0;
+    // Palette
+    bool palette_used = false;
+    DWord palette_important = 0;
+    // Color table of 1, 4 and 8-bit BMPs: offset (bytes), number of entries and entry size
+    // (3 bytes for CORE header, 4 bytes otherwise)
+    DWord palette_offset = 0;
+    DWord palette_size = 0;
+    Word palette_entry_size = 4;
+    // Scans must be aligned to 32 bits
+    Word padding_bytes = 0;
+    // Bit masks of 16 and 32-bit BMPs. Implicit masks are set when compression is RGB
+    DWord red_mask = 0;
+    DWord green_mask = 0;
+    DWord blue_mask = 0;
+    DWord alpha_mask = 0;
+
+    /// @brief Size of scan in file (including padding)
+    std::size_t GetFullScanSize() const {
+        return (std::size_t{width} * bit_count + 7) / 8 + padding_bytes;
+    }
+};
+
+// This operator is useful in tests
+inline std::ostream& operator<<(std::ostream& os, ImportantFields const& imp_f) {
+    os << "{\n";
+    os << "\toffset: " << imp_f.offset << '\n';
+    os << "\twidth: " << imp_f.width << '\n';
+    os << "\theight: " << imp_f.height << '\n';
+    os << "\tbottom-up: " << std::boolalpha << imp_f.bottom_up << '\n';
+    os << "\tbyte count: " << imp_f.byte_count << '\n';
+    os << "\tbit count: " << imp_f.bit_count << '\n';
+    os << "\tcompression method: " << static_cast<Word>(imp_f.compression) << '\n';
+    os << "\timage size: " << imp_f.size_image << '\n';
+    os << "\tpalette used: " << std::boolalpha << imp_f.palette_used << '\n';
+    os << "\tpalette important fields: " << imp_f.palette_important << '\n';
+    os << "\tpalette offset: " << imp_f.palette_offset << '\n';
+    os << "\tpalette size: " << imp_f.palette_size << '\n';
+    os << "\tpalette entry size: " << imp_f.palette_entry_size << '\n';
+    os << "\tpadding bytes: " << imp_f.padding_bytes << '\n';
+    os << std::hex << "\tmasks: " << imp_f.red_mask << ' ' << imp_f.green_mask << ' '
+       << imp_f.blue_mask << ' ' << imp_f.alpha_mask << std::dec << '\n';
+    os << "}\n";
+    return os;
+}
+
+inline bool operator==(ImportantFields const& a, ImportantFields const& b) {
+    return a.offset == b.offset && a.width == b.width && a.height == b.height &&
+           a.bottom_up == b.bottom_up && a.byte_count == b.byte_count &&
+           a.bit_count == b.bit_count && a.compression == b.compression &&
+           a.size_image == b.size_image && a.palette_used == b.palette_used &&
+           a.palette_important == b.palette_important && a.palette_offset == b.palette_offset &&
+           a.palette_size == b.palette_size && a.palette_entry_size == b.palette_entry_size &&
+           a.padding_bytes == b.padding_bytes && a.red_mask == b.red_mask &&
+           a.green_mask == b.green_mask && a.blue_mask == b.blue_mask &&
+           a.alpha_mask == b.alpha_mask;
+}
+}  // namespace bmp
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+
+#include "util/field_types.h"
+
+namespace bmp {
+class DecodeCache;
+
+/// @brief How @c BMPReader accesses the input file
+enum class InputMode {
+    // Read file with positional reads, file contents are copied into memory
+    kStream,
+    // Map the file into memory. Headers and pixel data are parsed straight from the mapping,
+    // edits go to private (copy-on-write) pages and never reach the input file
+    kMapped,
+};
+
+/// @brief How stream mode overlaps reading of pixel data with decoding
+enum class ReadAhead {
+    // Block is read, then decoded
+    kNone,
+    // Next blocks are read with Linux io_uring while earlier ones are decoded.
+    // Falls back to kThread where io_uring is unavailable
+    kIOUring,
+    // Next blocks are read by background thread while earlier ones are decoded
+    kThread,
+};
+
+/// @brief How @c BMPReader::SaveBMP writes edited BMP
+enum class SaveMode {
+    // Write the whole BMP
+    kFull,
+    // Copy input file (reflink or in-kernel copy where possible), then write edited scans only
+    kIncremental,
+    // Output file already holds the original BMP: write edited scans only
+    kInPlace,
+};
+
+/// @brief How @c BMPReader decides which pixels are black
+enum class ThresholdMode {
+    // Black when red + green + blue <= max_black_sum
+    kFixed,
+    // Black when weighted luma (BT.601) <= max_black_luma
+    kLuma,
+    // Luma threshold is chosen by Otsu's method from histogram of the image
+    kOtsu,
+    // Black when luma is at least adaptive_percent percent lower than mean luma of the
+    // surrounding window (Bradley-Roth). Handles uneven lighting
+    kAdaptive,
+};
+
+/// @brief Black-and-white conversion settings
+struct ThresholdOptions {
+    ThresholdMode mode = ThresholdMode::kFixed;
+    unsigned max_black_sum = 122 * 3;
+    Byte max_black_luma = 122;
+    // Side of adaptive window (pixels). 0 means 1/8 of image width
+    std::size_t adaptive_window = 0;
+    unsigned adaptive_percent = 15;
+};
+
+/// @brief @c BMPReader settings
+struct ReaderOptions {
+    InputMode input_mode = InputMode::kStream;
+    // Number of threads that decode pixel data (0 means hardware concurrency).
+    // With more than one thread scans are split into chunks that are decoded independently
+    std::size_t thread_count = 1;
+    // Amount of pixel data (bytes) that is read by one call in stream mode. Whole scans are
+    // always read, so one block holds at least one scan
+    std::size_t block_size = 1 << 20;
+    // Sequential stream mode only: parallel reads overlap decoding anyway
+    ReadAhead read_ahead = ReadAhead::kNone;
+    // Number of block buffers with read-ahead: queue_depth - 1 blocks are read while one is
+    // decoded
+    std::size_t queue_depth = 4;
+    // Otsu and adaptive modes keep luma of the whole image (one byte per pixel) until it is
+    // thresholded. RLE images support fixed and luma modes only
+    ThresholdOptions threshold{};
+    // Cache of decoded rasters, see DecodeCache. It may be shared by several readers and must
+    // outlive them and images they release. ReadRegion does not use it, saves invalidate entries
+    // of the files they write
+    DecodeCache* decode_cache = nullptr;
+};
+}  // namespace bmp
@@ -0,0 +1,87 @@
+#include "reader_stats.h"
+
+#include <iomanip>
+#include <ios>
+
+namespace bmp {
+char const* GetPhaseName(Phase phase) {
+    switch (phase) {
+        case Phase::kReadHeaders:
+            return "ReadHeaders";
+        case Phase::kReadData:
+            return "ReadData";
+        case Phase::kReadRegion:
+            return "ReadRegion";
+        case Phase::kDraw:
+            return "Draw";
+        case Phase::kSaveBMP:
+            return "SaveBMP";
+    }
+    return "";
+}
+
+ReaderStats& ReaderStats::operator+=(ReaderStats const& other) {
+    for (std::size_t i = 0; i < kPhaseCount; ++i) {
+        phases[i].calls += other.phases[i].calls;
+        phases[i].wall_ns += other.phases[i].wall_ns;
+        phases[i].cpu_ns += other.phases[i].cpu_ns;
+        phases[i].allocations += other.phases[i].allocations;
+        phases[i].allocated_bytes += other.phases[i].allocated_bytes;
+    }
+    bytes_read += other.bytes_read;
+    read_calls += other.read_calls;
+    bytes_written += other.bytes_written;
+    write_calls += other.write_calls;
+    pixels_decoded += other.pixels_decoded;
+    return *this;
+}
+
+AllocationCounters& GetAllocationCounters() {
+    static AllocationCounters counters;
+    return counters;
+}
+
+namespace {
+void PrintJSON(std::ostream& os, ReaderStats const& stats) {
+    os << "{\"phases\": {";
+    for (std::size_t i = 0; i < kPhaseCount; ++i) {
+        PhaseStats const& phase = stats.phases[i];
+        os << (i == 0 ? "" : ", ") << '"' << GetPhaseName(static_cast<Phase>(i)) << "\": {"
+           << "\"calls\": " << phase.calls << ", \"wall_ns\": " << phase.wall_ns
+           << ", \"cpu_ns\": " << phase.cpu_ns << ", \"allocations\": " << phase.allocations
+           << ", \"allocated_bytes\": " << phase.allocated_bytes << '}';
+    }
+    os << "}, \"bytes_read\": " << stats.bytes_read << ", \"read_calls\": " << stats.read_calls
+       << ", \"bytes_written\": " << stats.bytes_written
+       << ", \"write_calls\": " << stats.write_calls
+       << ", \"pixels_decoded\": " << stats.pixels_decoded << "}\n";
+}
+
+void PrintTable(std::ostream& os, ReaderStats const& stats) {
+    std::ios::fmtflags const flags = os.flags();
+    os << std::left << std::setw(12) << "phase" << std::right << std::setw(7) << "calls"
+       << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms" << std::setw(10) << "allocs"
+       << std::setw(14) << "alloc bytes" << '\n';
+    os << std::fixed << std::setprecision(3);
+    for (std::size_t i = 0; i < kPhaseCount; ++i) {
+        PhaseStats const& phase = stats.phases[i];
+        os << std::left << std::setw(12) << GetPhaseName(static_cast<Phase>(i)) << std::right
+           << std::setw(7) << phase.calls << std::setw(12) << phase.wall_ns / 1e6
+           << std::setw(12) << phase.cpu_ns / 1e6 << std::setw(10) << phase.allocations
+           << std::setw(14) << phase.allocated_bytes << '\n';
+    }
+    os << "bytes read:     " << stats.bytes_read << " (" << stats.read_calls << " calls)\n"
+       << "bytes written:  " << stats.bytes_written << " (" << stats.write_calls << " calls)\n"
+       << "pixels decoded: " << stats.pixels_decoded << '\n';
+    os.flags(flags);
+}
+}  // namespace
+
+void PrintStats(std::ostream& os, ReaderStats const& stats, bool json) {
+    if (json) {
+        PrintJSON(os, stats);
+    } else {
+        PrintTable(os, stats);
+    }
+}
+}  // namespace bmp
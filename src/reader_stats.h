@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+
+// Statistics are collected when library is built with BMP_ENABLE_STATS (CMake option
+// ENABLE_STATS). Otherwise all counting code is discarded at compile time.
+
+namespace bmp {
+#ifdef BMP_ENABLE_STATS
+constexpr bool kStatsEnabled = true;
+#else
+constexpr bool kStatsEnabled = false;
+#endif
+
+/// @brief Public operations of @c BMPReader that are timed
+enum class Phase {
+    kReadHeaders,
+    kReadData,
+    kReadRegion,
+    kDraw,
+    kSaveBMP,
+};
+
+constexpr std::size_t kPhaseCount = 5;
+
+/// @brief Name of @p phase, as it is printed
+char const* GetPhaseName(Phase phase);
+
+struct PhaseStats {
+    std::size_t calls = 0;
+    std::uint64_t wall_ns = 0;
+    // CPU time of the whole process, so it includes decoding threads
+    std::uint64_t cpu_ns = 0;
+    // Heap allocations, see CountAllocation
+    std::uint64_t allocations = 0;
+    std::uint64_t allocated_bytes = 0;
+};
+
+/// @brief What @c BMPReader has done since it was created
+struct ReaderStats {
+    std::array<PhaseStats, kPhaseCount> phases{};
+    // File reads and writes, except headers
+    std::uint64_t bytes_read = 0;
+    std::size_t read_calls = 0;
+    std::uint64_t bytes_written = 0;
+    std::size_t write_calls = 0;
+    std::uint64_t pixels_decoded = 0;
+
+    PhaseStats& operator[](Phase phase) {
+        return phases[static_cast<std::size_t>(phase)];
+    }
+
+    PhaseStats const& operator[](Phase phase) const {
+        return phases[static_cast<std::size_t>(phase)];
+    }
+
+    /// @brief Add statistics of another reader
+    ReaderStats& operator+=(ReaderStats const& other);
+};
+
+/// @brief Print @p stats as aligned table or as JSON object
+void PrintStats(std::ostream& os, ReaderStats const& stats, bool json = false);
+
+/// @brief Process-wide heap allocation counters.
+/// The library cannot see allocations by itself: they are counted by replacement of global
+/// <tt>operator new</tt> in counting_new.cpp, that is linked into CLI and tests (target
+/// BMPReader_counting_new). Otherwise they stay zero. Allocations are counted only while
+/// counting is enabled, so that applications pay nothing for it unless statistics are requested
+struct AllocationCounters {
+    std::atomic<bool> enabled = false;
+    std::atomic<std::uint64_t> count = 0;
+    std::atomic<std::uint64_t> bytes = 0;
+};
+
+AllocationCounters& GetAllocationCounters();
+
+/// @brief Start or stop counting allocations (see @c AllocationCounters)
+inline void EnableAllocationCounting(bool enabled) noexcept {
+    GetAllocationCounters().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+/// @brief Called by replacement of global <tt>operator new</tt>
+inline void CountAllocation(std::size_t size) noexcept {
+    AllocationCounters& counters = GetAllocationCounters();
+    if (counters.enabled.load(std::memory_order_relaxed)) {
+        counters.count.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+/// @brief Adds time and allocations between construction and destruction to @p stats
+class PhaseTimer {
+private:
+    PhaseStats* stats_;
+    std::chrono::steady_clock::time_point wall_start_;
+    std::uint64_t cpu_start_ = 0;
+    std::uint64_t allocations_start_ = 0;
+    std::uint64_t allocated_bytes_start_ = 0;
+
+    static std::uint64_t GetCPUTime() {
+        timespec ts{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+        return static_cast<std::uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+    }
+
+public:
+    explicit PhaseTimer(PhaseStats& stats) : stats_(&stats) {
+        if constexpr (kStatsEnabled) {
+            AllocationCounters const& counters = GetAllocationCounters();
+            allocations_start_ = counters.count.load(std::memory_order_relaxed);
+            allocated_bytes_start_ = counters.bytes.load(std::memory_order_relaxed);
+            cpu_start_ = GetCPUTime();
+            wall_start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~PhaseTimer() {
+        if constexpr (kStatsEnabled) {
+            auto const wall = std::chrono::steady_clock::now() - wall_start_;
+            std::uint64_t const cpu_end = GetCPUTime();
+            AllocationCounters const& counters = GetAllocationCounters();
+            ++stats_->calls;
+            stats_->wall_ns +=
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count();
+            stats_->cpu_ns += cpu_end - cpu_start_;
+            stats_->allocations +=
+                    counters.count.load(std::memory_order_relaxed) - allocations_start_;
+            stats_->allocated_bytes +=
+                    counters.bytes.load(std::memory_order_relaxed) - allocated_bytes_start_;
+        }
+    }
+
+    PhaseTimer(PhaseTimer const&) = delete;
+    PhaseTimer& operator=(PhaseTimer const&) = delete;
+};
+}  // namespace bmp
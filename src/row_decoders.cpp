@@ -0,0 +1,75 @@
+#include "row_decoders.h"
+
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "util/bitmap_info_header.h"
+#include "util/invalid_bmp_error.h"
+#include "util/ms_constants.h"
+
+namespace bmp {
+
+using namespace util;
+
+namespace {
+ChannelMasks GetMasks(ImportantFields const& imp_fields) {
+    if (imp_fields.bit_count == 24) {
+        return {0x00FF0000, 0x0000FF00, 0x000000FF};
+    }
+    return {imp_fields.red_mask, imp_fields.green_mask, imp_fields.blue_mask};
+}
+
+ThresholdKernel GetKernel(ImportantFields const& imp_fields) {
+    bool const rgb24 = imp_fields.bit_count == 24 && imp_fields.compression == Compression::RGB;
+    if (rgb24 || imp_fields.bit_count == 16 || imp_fields.bit_count == 32) {
+        return GetBitfieldsKernel(imp_fields.byte_count, GetMasks(imp_fields));
+    }
+    return nullptr;
+}
+
+template <std::size_t... kIndices>
+RowDecoder MakeFirstAccepting(ImportantFields const& imp_fields, PaletteTables const& palette,
+                              unsigned max_black_sum, std::index_sequence<kIndices...>) {
+    std::optional<RowDecoder> decoder;
+    // Fold stops at the first decoder that accepts format
+    (void)((std::variant_alternative_t<kIndices, RowDecoder>::Accepts(imp_fields) &&
+            (decoder.emplace(std::in_place_index<kIndices>, imp_fields, palette, max_black_sum),
+             true)) ||
+           ...);
+    if (!decoder) {
+        throw InvalidBMPError("unsupported pixel format: " +
+                              std::to_string(imp_fields.bit_count) + "-bit, compression " +
+                              std::to_string(static_cast<int>(imp_fields.compression)));
+    }
+    return std::move(*decoder);
+}
+}  // namespace
+
+bool ThresholdRows::Accepts(ImportantFields const& imp_fields) {
+    return GetKernel(imp_fields) != nullptr;
+}
+
+ThresholdRows::ThresholdRows(ImportantFields const& imp_fields, PaletteTables const&,
+                             unsigned max_black_sum)
+    : kernel_(GetKernel(imp_fields)),
+      luma_(GetLumaKernel(imp_fields.byte_count, GetMasks(imp_fields))),
+      width_(imp_fields.width),
+      max_black_sum_(max_black_sum) {}
+
+bool BitfieldsRows::Accepts(ImportantFields const& imp_fields) {
+    return imp_fields.bit_count == 16 || imp_fields.bit_count == 32;
+}
+
+BitfieldsRows::BitfieldsRows(ImportantFields const& imp_fields, PaletteTables const&,
+                             unsigned max_black_sum)
+    : layout_(imp_fields.byte_count, GetMasks(imp_fields)),
+      width_(imp_fields.width),
+      max_black_sum_(max_black_sum) {}
+
+RowDecoder MakeRowDecoder(ImportantFields const& imp_fields, PaletteTables const& palette,
+                          unsigned max_black_sum) {
+    return MakeFirstAccepting(imp_fields, palette, max_black_sum,
+                              std::make_index_sequence<std::variant_size_v<RowDecoder>>{});
+}
+}  // namespace bmp
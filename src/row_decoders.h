@@ -0,0 +1,143 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <variant>
+
+#include "binary_image.h"
+#include "important_fields.h"
+#include "util/bitfields_kernel.h"
+#include "util/field_types.h"
+#include "util/threshold_kernel.h"
+
+// Row decoders turn one uncompressed scan into BinaryImage row or into luma. There is one decoder
+// per family of pixel formats, and each of them is specialized for its format when it is created.
+// Every decoder has:
+//   static bool Accepts(ImportantFields const&) -- decoder can handle the format;
+//   constructor (ImportantFields const&, PaletteTables const&, unsigned max_black_sum);
+//   void operator()(Byte const* scan, BinaryImage::BitWord* row) const;
+//   void Luma(Byte const* scan, Byte* out) const -- one byte per pixel.
+
+namespace bmp {
+/// @brief Thresholded palette of indexed images
+struct PaletteTables {
+    // Palette entry is black
+    std::array<bool, 256> black{};
+    std::array<Byte, 256> luma{};
+};
+
+/// @brief 24-bit pixels and masks that have compiled kernel
+class ThresholdRows {
+private:
+    util::ThresholdKernel kernel_;
+    util::LumaKernel luma_;
+    DWord width_;
+    unsigned max_black_sum_;
+
+public:
+    static bool Accepts(ImportantFields const& imp_fields);
+
+    ThresholdRows(ImportantFields const& imp_fields, PaletteTables const& palette,
+                  unsigned max_black_sum);
+
+    void operator()(Byte const* scan, BinaryImage::BitWord* row) const {
+        kernel_(scan, width_, max_black_sum_, row);
+    }
+
+    void Luma(Byte const* scan, Byte* out) const {
+        luma_(scan, width_, out);
+    }
+};
+
+/// @brief 1, 4 and 8-bit pixels: palette is thresholded once, scans are decoded with table
+/// lookups, one byte at a time
+template <Word kBitCount>
+class IndexedRows {
+private:
+    constexpr static std::size_t kPixelsPerByte = 8 / kBitCount;
+    constexpr static std::size_t kBytesPerWord = BinaryImage::kBitsPerWord / kPixelsPerByte;
+
+    DWord width_;
+    // Byte of scan -> bits of its pixels (first pixel is the lowest bit)
+    std::array<Byte, 256> byte_lut_{};
+    std::array<Byte, 256> luma_{};
+
+public:
+    static bool Accepts(ImportantFields const& imp_fields) {
+        return imp_fields.bit_count == kBitCount;
+    }
+
+    IndexedRows(ImportantFields const& imp_fields, PaletteTables const& palette, unsigned)
+        : width_(imp_fields.width), luma_(palette.luma) {
+        // Pixels are stored from the highest bits of byte, but BinaryImage starts from the lowest
+        constexpr unsigned kIndexMask = (1u << kBitCount) - 1;
+        for (unsigned byte = 0; byte < byte_lut_.size(); ++byte) {
+            Byte bits = 0;
+            for (std::size_t pixel = 0; pixel < kPixelsPerByte; ++pixel) {
+                unsigned const index = (byte >> (8 - kBitCount * (pixel + 1))) & kIndexMask;
+                bits |= static_cast<Byte>(palette.black[index]) << pixel;
+            }
+            byte_lut_[byte] = bits;
+        }
+    }
+
+    void operator()(Byte const* scan, BinaryImage::BitWord* row) const {
+        std::size_t const scan_bytes = (width_ + kPixelsPerByte - 1) / kPixelsPerByte;
+        std::size_t const words = BinaryImage::WordsPerRow(width_);
+        for (std::size_t word = 0; word < words; ++word) {
+            std::size_t const begin = word * kBytesPerWord;
+            std::size_t const end = std::min(begin + kBytesPerWord, scan_bytes);
+            BinaryImage::BitWord bits = 0;
+            for (std::size_t i = begin; i < end; ++i) {
+                bits |= BinaryImage::BitWord{byte_lut_[scan[i]]} << (i - begin) * kPixelsPerByte;
+            }
+            row[word] = bits;
+        }
+        // Last byte may contain pixels past width
+        if (std::size_t const tail = width_ % BinaryImage::kBitsPerWord; tail > 0) {
+            row[words - 1] &= (BinaryImage::BitWord{1} << tail) - 1;
+        }
+    }
+
+    void Luma(Byte const* scan, Byte* out) const {
+        constexpr unsigned kIndexMask = (1u << kBitCount) - 1;
+        for (std::size_t x = 0; x < width_; ++x) {
+            std::size_t const shift = 8 - kBitCount * (x % kPixelsPerByte + 1);
+            out[x] = luma_[(scan[x / kPixelsPerByte] >> shift) & kIndexMask];
+        }
+    }
+};
+
+/// @brief 16 and 32-bit pixels with any masks, decoded at runtime
+class BitfieldsRows {
+private:
+    util::BitfieldsLayout layout_;
+    DWord width_;
+    unsigned max_black_sum_;
+
+public:
+    static bool Accepts(ImportantFields const& imp_fields);
+
+    BitfieldsRows(ImportantFields const& imp_fields, PaletteTables const& palette,
+                  unsigned max_black_sum);
+
+    void operator()(Byte const* scan, BinaryImage::BitWord* row) const {
+        layout_.Threshold(scan, width_, max_black_sum_, row);
+    }
+
+    void Luma(Byte const* scan, Byte* out) const {
+        layout_.Luma(scan, width_, out);
+    }
+};
+
+/// @brief Registered row decoders, in order of priority. The first one that accepts format is
+/// used. New formats are added here; hot loops do not change
+using RowDecoder = std::variant<ThresholdRows, IndexedRows<1>, IndexedRows<4>, IndexedRows<8>,
+                                BitfieldsRows>;
+
+/// @brief Create decoder for uncompressed scans of @p imp_fields format
+/// @throw InvalidBMPError if no decoder accepts the format
+RowDecoder MakeRowDecoder(ImportantFields const& imp_fields, PaletteTables const& palette,
+                          unsigned max_black_sum);
+}  // namespace bmp
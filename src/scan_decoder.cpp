@@ -0,0 +1,139 @@
+#include "scan_decoder.h"
+
+#include <algorithm>
+
+#include "util/bitmap_info_header.h"
+#include "util/invalid_bmp_error.h"
+
+namespace bmp {
+
+using namespace util;
+
+namespace {
+unsigned GetSum(RGBColor const& color) {
+    return unsigned{color.red} + color.green + color.blue;
+}
+
+PaletteTables GetPaletteTables(Palette const& palette, ThresholdOptions const& threshold) {
+    PaletteTables tables{};
+    tables.luma.fill(255);
+    std::size_t const entries = std::min<std::size_t>(palette.size(), tables.black.size());
+    for (std::size_t index = 0; index < entries; ++index) {
+        RGBColor const& color = palette[index];
+        tables.luma[index] = GetLuma(color.red, color.green, color.blue);
+        tables.black[index] = threshold.mode == ThresholdMode::kFixed
+                                      ? GetSum(color) <= threshold.max_black_sum
+                                      : tables.luma[index] <= threshold.max_black_luma;
+    }
+    return tables;
+}
+}  // namespace
+
+ScanDecoder::ScanDecoder(ImportantFields const& imp_fields, Palette const& palette,
+                         ThresholdOptions const& threshold)
+    : width_(imp_fields.width),
+      bit_count_(imp_fields.bit_count),
+      palette_(GetPaletteTables(palette, threshold)),
+      rows_(MakeRowDecoder(imp_fields, palette_, threshold.max_black_sum)),
+      // Indexed pixels are thresholded with palette
+      luma_threshold_(threshold.mode == ThresholdMode::kLuma && !IsIndexed(bit_count_)),
+      max_black_luma_(threshold.max_black_luma) {}
+
+void ScanDecoder::DecodeRLE(Byte const* data, std::size_t size, BinaryImage& image) const {
+    bool const rle4 = bit_count_ == 4;
+    std::size_t const height = image.GetHeight();
+    std::size_t pos = 0;
+    std::size_t x = 0;
+    // Scans go from bottom to top
+    std::size_t scan = 0;
+
+    // Called for every command, so message is not built unless it is needed
+    auto require = [&](std::size_t bytes) {
+        if (pos + bytes > size) {
+            throw InvalidBMPError("unexpected end of RLE data");
+        }
+    };
+    BinaryImage::BitWord* row = image.GetRow(height - 1);
+    // Pixels are set without branches: content of glyph-like images is hard to predict
+    auto set_pixel = [&](bool black) {
+        if (x < width_) {
+            row[x / BinaryImage::kBitsPerWord] |= BinaryImage::BitWord{black}
+                                                  << (x % BinaryImage::kBitsPerWord);
+        }
+        ++x;
+    };
+    auto fill = [&](std::size_t count, bool black) {
+        if (black && x < width_) {
+            image.Fill(height - 1 - scan, x, std::min<std::size_t>(x + count, width_));
+        }
+        x += count;
+    };
+    auto next_scans = [&](std::size_t count) {
+        scan += count;
+        if (scan < height) {
+            row = image.GetRow(height - 1 - scan);
+        }
+    };
+
+    // End of bitmap marker is optional at the very end of data
+    while (scan < height && pos < size) {
+        require(2);
+        std::size_t const count = data[pos];
+        Byte const value = data[pos + 1];
+        pos += 2;
+
+        if (count > 0) {
+            // Encoded mode: RLE4 runs alternate two indices
+            bool const first = palette_.black[rle4 ? value >> 4 : value];
+            bool const second = palette_.black[rle4 ? value & 0xF : value];
+            if (count == 1) {
+                set_pixel(first);
+            } else if (first == second) {
+                fill(count, first);
+            } else {
+                for (std::size_t i = 0; i < count; ++i) {
+                    set_pixel(i % 2 == 0 ? first : second);
+                }
+            }
+            continue;
+        }
+
+        switch (value) {
+            case 0:
+                // End of line
+                x = 0;
+                next_scans(1);
+                break;
+            case 1:
+                // End of bitmap
+                return;
+            case 2:
+                // Delta: skipped pixels stay white
+                require(2);
+                x += data[pos];
+                next_scans(data[pos + 1]);
+                pos += 2;
+                break;
+            default: {
+                // Absolute mode: value is number of pixels, data is padded to 16 bits
+                std::size_t const bytes = rle4 ? (value + 1) / 2 : value;
+                require(bytes);
+                for (std::size_t i = 0; i < value; ++i) {
+                    Byte const index = rle4 ? (data[pos + i / 2] >> (i % 2 == 0 ? 4 : 0)) & 0xF
+                                            : data[pos + i];
+                    set_pixel(palette_.black[index]);
+                }
+                pos += bytes + bytes % 2;
+                break;
+            }
+        }
+    }
+}
+
+Byte ScanDecoder::GetDarkestIndex(Palette const& palette) {
+    auto const darkest = std::min_element(
+            palette.begin(), palette.end(),
+            [](RGBColor const& lhs, RGBColor const& rhs) { return GetSum(lhs) < GetSum(rhs); });
+    return static_cast<Byte>(darkest - palette.begin());
+}
+}  // namespace bmp
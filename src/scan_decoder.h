@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <variant>
+#include <vector>
+
+#include "binary_image.h"
+#include "header_reader.h"
+#include "important_fields.h"
+#include "reader_options.h"
+#include "row_decoders.h"
+#include "threshold.h"
+#include "util/field_types.h"
+
+namespace bmp {
+/// @brief Turns raw scans of one image into black-and-white rows or luma.
+/// Row decoder is selected and specialized once, when decoder is created (see row_decoders.h),
+/// and it is dispatched once per block of scans. Palette (if any) is thresholded once too
+class ScanDecoder {
+private:
+    DWord width_;
+    Word bit_count_;
+    PaletteTables palette_;
+    RowDecoder rows_;
+    // Color pixels are converted to luma, then thresholded with max_black_luma_
+    bool luma_threshold_ = false;
+    Byte max_black_luma_;
+
+public:
+    /// @param palette -- color table of 1, 4 and 8-bit BMPs. Missing entries are white
+    /// @param threshold -- fixed and luma modes are applied by @c DecodeScans. Other modes need
+    /// luma of the whole image, see @c DecodeLuma
+    explicit ScanDecoder(ImportantFields const& imp_fields, Palette const& palette = {},
+                         ThresholdOptions const& threshold = {});
+
+    /// @brief Decode @p count scans (as they are stored in file) into rows of @c BinaryImage.
+    /// Row order and padding are handled by strides, so the loop over scans does not branch
+    /// @param scan_size -- distance between scans (bytes)
+    /// @param row_stride -- distance between rows of consecutive scans (words). Negative for
+    /// bottom-up images
+    void DecodeScans(Byte const* scans, std::size_t count, std::size_t scan_size,
+                     BinaryImage::BitWord* first_row, std::ptrdiff_t row_stride) const {
+        std::visit(
+                [&](auto const& decode_row) {
+                    if (luma_threshold_) {
+                        // Grows to the widest image once per thread
+                        thread_local std::vector<Byte> luma;
+                        luma.resize(std::max<std::size_t>(luma.size(), width_));
+                        BinaryImage::BitWord* row = first_row;
+                        for (std::size_t i = 0; i < count; ++i, row += row_stride) {
+                            decode_row.Luma(scans + i * scan_size, luma.data());
+                            ThresholdLumaRow(luma.data(), width_, max_black_luma_, row);
+                        }
+                        return;
+                    }
+                    for (std::size_t i = 0; i < count; ++i) {
+                        decode_row(scans + i * scan_size,
+                                   first_row + static_cast<std::ptrdiff_t>(i) * row_stride);
+                    }
+                },
+                rows_);
+    }
+
+    /// @brief Convert @p count scans into luma rows of @c width bytes, adding them to
+    /// @p histogram (if it is not null) in the same pass
+    /// @param row_stride -- distance between luma rows of consecutive scans (bytes)
+    void DecodeLuma(Byte const* scans, std::size_t count, std::size_t scan_size, Byte* first_row,
+                    std::ptrdiff_t row_stride, LumaHistogram* histogram) const {
+        std::visit(
+                [&](auto const& decode_row) {
+                    for (std::size_t i = 0; i < count; ++i) {
+                        Byte* row = first_row + static_cast<std::ptrdiff_t>(i) * row_stride;
+                        decode_row.Luma(scans + i * scan_size, row);
+                        if (histogram) {
+                            AddToHistogram(row, width_, *histogram);
+                        }
+                    }
+                },
+                rows_);
+    }
+
+    /// @brief Decode one scan into @c BinaryImage row
+    void Decode(Byte const* scan, BinaryImage::BitWord* row) const {
+        DecodeScans(scan, 1, 0, row, 0);
+    }
+
+    /// @brief Decode whole RLE8 or RLE4 pixel data into @p image, that must be white.
+    /// Runs of black pixels are filled as spans
+    void DecodeRLE(Byte const* data, std::size_t size, BinaryImage& image) const;
+
+    /// @brief Index of palette entry that is the closest to black
+    static Byte GetDarkestIndex(Palette const& palette);
+};
+}  // namespace bmp
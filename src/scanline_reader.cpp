@@ -0,0 +1,60 @@
+#include "scanline_reader.h"
+
+#include <algorithm>
+
+#include "header_reader.h"
+#include "util/invalid_bmp_error.h"
+#include "util/ms_constants.h"
+
+namespace bmp {
+
+ScanlineReader::ScanlineReader(std::string const& filename, std::size_t batch_scans)
+    : file_(filename),
+      file_size_(file_.GetSize()),
+      batch_scans_(std::max<std::size_t>(batch_scans, 1)) {}
+
+void ScanlineReader::ReadHeaders() {
+    imp_fields_ = ReadImportantFields(file_, file_size_);
+    // Position of RLE scan is not known until all previous scans are decoded
+    if (imp_fields_.compression == util::Compression::RLE8 ||
+        imp_fields_.compression == util::Compression::RLE4) {
+        throw InvalidBMPError("RLE BMPs cannot be read by scans, use BMPReader");
+    }
+    decoder_.emplace(imp_fields_, ReadPalette(file_, imp_fields_));
+
+    std::size_t const batch_scans = std::min<std::size_t>(batch_scans_, imp_fields_.height);
+    raw_batch_.resize(batch_scans * imp_fields_.GetFullScanSize());
+    batch_ = BinaryImage(imp_fields_.width, batch_scans);
+    next_row_ = 0;
+}
+
+std::size_t ScanlineReader::ReadNextBatch() {
+    std::size_t const count = std::min(batch_.GetHeight(), imp_fields_.height - next_row_);
+    if (count == 0) {
+        return 0;
+    }
+
+    // Rows [next_row_, next_row_ + count) are stored as one contiguous range of scans
+    std::size_t const first_scan =
+            imp_fields_.bottom_up ? imp_fields_.height - next_row_ - count : next_row_;
+    std::size_t const full_scan = imp_fields_.GetFullScanSize();
+    file_.ReadAt(raw_batch_.data(), count * full_scan,
+                 imp_fields_.offset + first_scan * full_scan);
+
+    auto const stride = static_cast<std::ptrdiff_t>(batch_.GetStride());
+    decoder_->DecodeScans(raw_batch_.data(), count, full_scan,
+                          batch_.GetRow(imp_fields_.bottom_up ? count - 1 : 0),
+                          imp_fields_.bottom_up ? -stride : stride);
+    batch_first_row_ = next_row_;
+    next_row_ += count;
+    return count;
+}
+
+void ScanlineReader::ForEachRow(RowSink const& sink) {
+    while (std::size_t const count = ReadNextBatch()) {
+        for (std::size_t i = 0; i < count; ++i) {
+            sink(batch_first_row_ + i, batch_[i]);
+        }
+    }
+}
+}  // namespace bmp
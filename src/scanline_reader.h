@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "binary_image.h"
+#include "important_fields.h"
+#include "scan_decoder.h"
+#include "util/field_types.h"
+#include "util/file.h"
+
+namespace bmp {
+/// @brief Decodes BMP in small batches of scans using fixed-size buffers, so memory usage does
+/// not depend on image height. Rows are produced top-down, bottom-up files are read backwards
+class ScanlineReader {
+public:
+    /// @brief Receives decoded rows one by one. @p y is row number (top-down)
+    using RowSink = std::function<void(std::size_t y, BinaryImage::ConstRowView row)>;
+
+    constexpr static std::size_t kDefaultBatchScans = 16;
+
+private:
+    util::File file_;
+    std::uint64_t file_size_;
+    std::size_t batch_scans_;
+
+    ImportantFields imp_fields_;
+    std::optional<ScanDecoder> decoder_;
+    // Raw scans of current batch (file order)
+    std::vector<Byte> raw_batch_;
+    // Decoded rows of current batch (top-down)
+    BinaryImage batch_;
+    std::size_t batch_first_row_ = 0;
+    std::size_t next_row_ = 0;
+
+public:
+    /// @param filename -- BMP filename
+    /// @param batch_scans -- number of scans that are read and decoded at once
+    explicit ScanlineReader(std::string const& filename,
+                            std::size_t batch_scans = kDefaultBatchScans);
+
+    /// @brief Read and check BMP metadata, allocate buffers.
+    /// Must be called before any other operations
+    void ReadHeaders();
+
+    /// @brief Decode next batch of rows.
+    /// @return Number of decoded rows (0 when all rows were read). They are stored in
+    /// @c GetBatch(), the first of them is row @c GetBatchFirstRow() of the image
+    std::size_t ReadNextBatch();
+
+    /// @brief Decode all remaining rows, passing them to @p sink
+    void ForEachRow(RowSink const& sink);
+
+    /// @brief Start over from the top row
+    void Rewind() {
+        next_row_ = 0;
+    }
+
+    BinaryImage const& GetBatch() const {
+        return batch_;
+    }
+
+    std::size_t GetBatchFirstRow() const {
+        return batch_first_row_;
+    }
+
+    ImportantFields const& GetImportantFields() const {
+        return imp_fields_;
+    }
+};
+}  // namespace bmp
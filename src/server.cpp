@@ -0,0 +1,440 @@
+#include "server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+
+#include "bmp_reader.h"
+#include "util/io_error.h"
+
+namespace bmp {
+
+namespace {
+// Client that does not read for this long is disconnected, even if its queue is not full
+constexpr timeval kSendTimeout{.tv_sec = 10, .tv_usec = 0};
+
+[[noreturn]] void ThrowErrno(std::string const& what) {
+    throw IOError(what + ": " + std::strerror(errno));
+}
+
+sockaddr_un MakeAddress(std::string const& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        throw IOError("invalid socket path \"" + socket_path + '"');
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return address;
+}
+
+bool SendAll(int fd, char const* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t const n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool ReceiveAll(int fd, char* data, std::size_t size) {
+    while (size > 0) {
+        ssize_t const n = recv(fd, data, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void AppendJSONString(std::string& out, std::string_view str) {
+    out += '"';
+    for (char const c : str) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out += escape;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+std::string MakeResponse(std::uint64_t id, JobResult const& result) {
+    std::string response = "{\"id\": " + std::to_string(id);
+    if (result.error.empty()) {
+        response += ", \"ok\": true, \"wall_ns\": " + std::to_string(result.wall_ns) +
+                    ", \"pixels\": " + std::to_string(result.pixels);
+    } else {
+        response += ", \"ok\": false, \"error\": ";
+        AppendJSONString(response, result.error);
+    }
+    response += '}';
+    return response;
+}
+}  // namespace
+
+bool WriteFrame(int fd, std::string_view payload) {
+    auto const size = static_cast<std::uint32_t>(payload.size());
+    char const header[4] = {static_cast<char>(size), static_cast<char>(size >> 8),
+                            static_cast<char>(size >> 16), static_cast<char>(size >> 24)};
+    return SendAll(fd, header, sizeof(header)) && SendAll(fd, payload.data(), payload.size());
+}
+
+bool ReadFrame(int fd, std::string& payload) {
+    unsigned char header[4];
+    if (!ReceiveAll(fd, reinterpret_cast<char*>(header), sizeof(header))) {
+        return false;
+    }
+    std::uint32_t const size = header[0] | header[1] << 8 | header[2] << 16 |
+                               static_cast<std::uint32_t>(header[3]) << 24;
+    if (size > kMaxFrameSize) {
+        return false;
+    }
+    payload.resize(size);
+    return ReceiveAll(fd, payload.data(), size);
+}
+
+struct Server::Connection {
+    int fd;
+    std::size_t max_queued_responses;
+    std::mutex mutex;
+    // Signalled when a response is queued, a task is finished or the connection is finishing
+    std::condition_variable cv;
+    // Responses are queued by workers and sent by the writer thread
+    std::deque<std::string> responses;
+    // Tasks of this connection that are queued or running
+    std::size_t pending = 0;
+    // No more requests are read
+    bool finishing = false;
+    // Client went away or stopped reading. Responses are dropped
+    bool broken = false;
+    std::atomic<bool> closed = false;
+
+    Connection(int fd, std::size_t max_queued_responses)
+        : fd(fd), max_queued_responses(std::max<std::size_t>(max_queued_responses, 1)) {}
+
+    ~Connection() {
+        close(fd);
+    }
+
+    /// @brief Queue response, never blocks
+    void Respond(std::uint64_t id, JobResult const& result) {
+        std::string response = MakeResponse(id, result);
+        {
+            std::lock_guard lock{mutex};
+            if (broken) {
+                return;
+            }
+            if (responses.size() >= max_queued_responses) {
+                Break();
+                return;
+            }
+            responses.push_back(std::move(response));
+        }
+        cv.notify_all();
+    }
+
+    void BeginTask() {
+        std::lock_guard lock{mutex};
+        ++pending;
+    }
+
+    void EndTask() {
+        {
+            std::lock_guard lock{mutex};
+            --pending;
+        }
+        cv.notify_all();
+    }
+
+    /// @brief Send queued responses until connection is finished or broken
+    void WriteResponses() {
+        std::unique_lock lock{mutex};
+        while (true) {
+            cv.wait(lock, [this] {
+                return broken || !responses.empty() || (finishing && pending == 0);
+            });
+            if (broken || responses.empty()) {
+                return;
+            }
+            std::string const response = std::move(responses.front());
+            responses.pop_front();
+            lock.unlock();
+            bool const sent = WriteFrame(fd, response);
+            lock.lock();
+            if (!sent) {
+                Break();
+                return;
+            }
+        }
+    }
+
+    /// @brief Drop queued responses and wake both threads of the connection. Lock must be held
+    void Break() {
+        broken = true;
+        responses.clear();
+        shutdown(fd, SHUT_RDWR);
+        cv.notify_all();
+    }
+};
+
+Server::Server(ServerOptions options) : options_(std::move(options)) {
+    sockaddr_un const address = MakeAddress(options_.socket_path);
+    try {
+        if (pipe2(stop_pipe_, O_CLOEXEC | O_NONBLOCK) != 0) {
+            ThrowErrno("cannot create pipe");
+        }
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            ThrowErrno("cannot create socket");
+        }
+        // Socket file is left behind by a server that was killed
+        struct stat st;
+        if (lstat(options_.socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+            unlink(options_.socket_path.c_str());
+        }
+        if (bind(listen_fd_, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0) {
+            ThrowErrno("cannot bind " + options_.socket_path);
+        }
+        if (listen(listen_fd_, SOMAXCONN) != 0) {
+            ThrowErrno("cannot listen on " + options_.socket_path);
+        }
+    } catch (...) {
+        for (int const fd : {listen_fd_, stop_pipe_[0], stop_pipe_[1]}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+        throw;
+    }
+
+    std::size_t thread_count = options_.thread_count;
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(thread_count);
+    for (std::size_t i = 0; i < thread_count; ++i) {
+        workers_.emplace_back(&Server::WorkerLoop, this);
+    }
+}
+
+Server::~Server() {
+    // Run may have exited by exception
+    CloseConnections();
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+    }
+    task_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+    close(listen_fd_);
+    unlink(options_.socket_path.c_str());
+    close(stop_pipe_[0]);
+    close(stop_pipe_[1]);
+}
+
+void Server::Stop() noexcept {
+    char const byte = 0;
+    // Only async-signal-safe calls here. If the pipe is full, Run is woken already
+    [[maybe_unused]] ssize_t const n = write(stop_pipe_[1], &byte, 1);
+}
+
+void Server::WorkerLoop() {
+    // Buffers of the reader are reused by all jobs of this thread
+    BMPReader reader{options_.job_options.reader_options};
+    while (true) {
+        Task task;
+        {
+            std::unique_lock lock{mutex_};
+            task_cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        space_cv_.notify_all();
+
+        task.connection->Respond(task.id, RunJob(reader, task.job, options_.job_options));
+        task.connection->EndTask();
+        task.connection.reset();
+        {
+            std::lock_guard lock{mutex_};
+            --pending_;
+        }
+        space_cv_.notify_all();
+    }
+}
+
+void Server::Submit(Task&& task) {
+    Connection& connection = *task.connection;
+    connection.BeginTask();
+    // Task that is not queued is not finished by a worker
+    struct TaskGuard {
+        Connection& connection;
+        bool queued = false;
+
+        ~TaskGuard() {
+            if (!queued) {
+                connection.EndTask();
+            }
+        }
+    } guard{connection};
+    {
+        std::unique_lock lock{mutex_};
+        space_cv_.wait(lock, [this] { return tasks_.size() < std::max<std::size_t>(
+                                                                      options_.max_queued, 1); });
+        tasks_.push_back(std::move(task));
+        ++pending_;
+    }
+    guard.queued = true;
+    task_cv_.notify_one();
+}
+
+void Server::ReadRequests(std::shared_ptr<Connection> connection) {
+    std::thread writer{&Connection::WriteResponses, connection.get()};
+    try {
+        std::string payload;
+        for (std::uint64_t id = 0; ReadFrame(connection->fd, payload); ++id) {
+            // Failed request is answered with error, the connection goes on
+            try {
+                Submit({connection, id, ParseJob(payload)});
+            } catch (std::exception const& e) {
+                connection->Respond(id, {.error = e.what()});
+            }
+        }
+    } catch (...) {
+        // Connection that cannot be served any more is closed, the server goes on
+    }
+    // Writer sends responses of requests that are already received, then exits
+    {
+        std::lock_guard lock{connection->mutex};
+        connection->finishing = true;
+    }
+    connection->cv.notify_all();
+    writer.join();
+    connection->closed = true;
+}
+
+void Server::ReapConnections() {
+    for (auto it = connections_.begin(); it != connections_.end();) {
+        if (it->connection->closed) {
+            it->thread.join();
+            it = connections_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void Server::Run() {
+    pollfd fds[2] = {{listen_fd_, POLLIN, 0}, {stop_pipe_[0], POLLIN, 0}};
+    while (true) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ThrowErrno("poll failed");
+        }
+        if (fds[1].revents != 0) {
+            char byte;
+            while (read(stop_pipe_[0], &byte, 1) > 0) {
+            }
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            int const fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+            // Client may disconnect before it is accepted, that is not an error of the server
+            if (fd < 0) {
+                continue;
+            }
+            setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &kSendTimeout, sizeof(kSendTimeout));
+            ReapConnections();
+            if (connections_.size() >= std::max<std::size_t>(options_.max_connections, 1)) {
+                // The only frame of a new socket fits its buffer
+                WriteFrame(fd, MakeResponse(0, {.error = "too many connections"}));
+                close(fd);
+                continue;
+            }
+            auto connection = std::make_shared<Connection>(fd, options_.max_queued_responses);
+            connections_.push_back(
+                    {connection, std::thread(&Server::ReadRequests, this, connection)});
+        }
+    }
+
+    // Requests that are already received are answered, then connections are closed
+    CloseConnections();
+    std::unique_lock lock{mutex_};
+    space_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void Server::CloseConnections() noexcept {
+    for (auto& [connection, thread] : connections_) {
+        shutdown(connection->fd, SHUT_RD);
+    }
+    for (auto& [connection, thread] : connections_) {
+        thread.join();
+    }
+    connections_.clear();
+}
+
+ServerClient::ServerClient(std::string const& socket_path) {
+    sockaddr_un const address = MakeAddress(socket_path);
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+        ThrowErrno("cannot create socket");
+    }
+    if (connect(fd_, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0) {
+        int const error = errno;
+        close(fd_);
+        errno = error;
+        ThrowErrno("cannot connect to " + socket_path);
+    }
+}
+
+ServerClient::~ServerClient() {
+    close(fd_);
+}
+
+void ServerClient::Send(std::string_view request) {
+    if (!WriteFrame(fd_, request)) {
+        ThrowErrno("cannot send request");
+    }
+}
+
+std::string ServerClient::Receive() {
+    std::string response;
+    if (!ReadFrame(fd_, response)) {
+        throw IOError("connection to server is closed");
+    }
+    return response;
+}
+}  // namespace bmp
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "batch.h"
+
+// Server protocol. Both requests and responses are frames: payload size (4 bytes, little-endian)
+// followed by payload. Request payload is one job, as a manifest line (see ParseJob). Response
+// payload is JSON object:
+//     {"id": 0, "ok": true, "wall_ns": 1234, "pixels": 10000}
+//     {"id": 1, "ok": false, "error": "..."}
+// where id is the number of the request on its connection, starting from 0. Requests of one
+// connection may be pipelined: they run in parallel and responses are sent as jobs finish, so
+// they may come out of order.
+
+namespace bmp {
+/// @brief Largest frame payload (bytes). Connection that sends larger frame is closed
+constexpr std::uint32_t kMaxFrameSize = 1 << 20;
+
+/// @brief @c Server settings
+struct ServerOptions {
+    // Path of Unix domain socket. Stale socket file is replaced
+    std::string socket_path;
+    // Number of worker threads (0 means hardware concurrency)
+    std::size_t thread_count = 0;
+    // Requests that are accepted but not started yet. Connections stop being read when the
+    // queue is full
+    std::size_t max_queued = 1024;
+    // Connections that are served at once. Clients over the limit get an error response (id 0)
+    // and are disconnected
+    std::size_t max_connections = 64;
+    // Responses of one connection that wait to be sent. Client that stops reading fills the
+    // queue and is disconnected, so workers never wait for clients
+    std::size_t max_queued_responses = 1024;
+    // Settings of every job, jobs may override some of them
+    BatchOptions job_options{};
+};
+
+/// @brief Long-running process that runs jobs sent over Unix domain socket.
+/// Worker threads are started once and every one of them reuses one @c BMPReader, so a request
+/// costs as much as the job itself. Every connection is read by its own thread and written by
+/// another one, up to @c ServerOptions::max_connections of them
+class Server {
+private:
+    struct Connection;
+
+    struct Task {
+        std::shared_ptr<Connection> connection;
+        std::uint64_t id;
+        BatchJob job;
+    };
+
+    ServerOptions options_;
+    int listen_fd_ = -1;
+    // Stop writes to stop_pipe_[1], Run polls stop_pipe_[0]
+    int stop_pipe_[2] = {-1, -1};
+
+    std::mutex mutex_;
+    // Signalled when a task is queued or stop_ is set
+    std::condition_variable task_cv_;
+    // Signalled when a task is taken or finished
+    std::condition_variable space_cv_;
+    std::deque<Task> tasks_;
+    // Tasks that are queued or running
+    std::size_t pending_ = 0;
+    bool stop_ = false;
+    std::vector<std::thread> workers_;
+
+    struct ConnectionThread {
+        std::shared_ptr<Connection> connection;
+        std::thread thread;
+    };
+
+    std::list<ConnectionThread> connections_;
+
+    void WorkerLoop();
+    void ReadRequests(std::shared_ptr<Connection> connection);
+    /// @brief Block while the queue is full, then queue @p task
+    void Submit(Task&& task);
+    /// @brief Join threads of closed connections
+    void ReapConnections();
+    /// @brief Stop reading all connections and join their threads
+    void CloseConnections() noexcept;
+
+public:
+    /// @brief Start worker threads, create and bind the socket. Clients may connect as soon as
+    /// constructor returns, their requests are served when @c Run is called
+    /// @throw IOError
+    explicit Server(ServerOptions options);
+    ~Server();
+
+    Server(Server const&) = delete;
+    Server& operator=(Server const&) = delete;
+
+    /// @brief Accept connections and serve requests until @c Stop is called. After stop, requests
+    /// that were already received are finished and answered
+    void Run();
+
+    /// @brief Make @c Run return. May be called from any thread and from a signal handler
+    void Stop() noexcept;
+
+    std::size_t GetThreadCount() const {
+        return workers_.size();
+    }
+};
+
+/// @brief Blocking client of @c Server
+class ServerClient {
+private:
+    int fd_ = -1;
+
+public:
+    /// @throw IOError
+    explicit ServerClient(std::string const& socket_path);
+    ~ServerClient();
+
+    ServerClient(ServerClient const&) = delete;
+    ServerClient& operator=(ServerClient const&) = delete;
+
+    /// @brief Send request (one job, see @c ParseJob) without waiting for response
+    /// @throw IOError
+    void Send(std::string_view request);
+
+    /// @brief Wait for the next response
+    /// @throw IOError if connection is closed
+    std::string Receive();
+};
+
+/// @brief Write one frame to @p fd
+/// @return @c false if connection is broken
+bool WriteFrame(int fd, std::string_view payload);
+
+/// @brief Read one frame from @p fd into @p payload
+/// @return @c false on end of stream, broken connection or frame larger than @c kMaxFrameSize
+bool ReadFrame(int fd, std::string& payload);
+}  // namespace bmp
@@ -0,0 +1,145 @@
+#include "threshold.h"
+
+#include <algorithm>
+#include <memory_resource>
+#include <vector>
+
+namespace bmp {
+void AddToHistogram(Byte const* luma, std::size_t width, LumaHistogram& histogram) {
+    for (std::size_t x = 0; x < width; ++x) {
+        ++histogram[luma[x]];
+    }
+}
+
+Byte GetOtsuThreshold(LumaHistogram const& histogram) {
+    std::uint64_t total = 0;
+    double total_sum = 0;
+    for (std::size_t value = 0; value < histogram.size(); ++value) {
+        total += histogram[value];
+        total_sum += static_cast<double>(value) * histogram[value];
+    }
+
+    std::uint64_t dark_count = 0;
+    double dark_sum = 0;
+    double best_variance = -1;
+    Byte best = 0;
+    for (std::size_t value = 0; value + 1 < histogram.size(); ++value) {
+        dark_count += histogram[value];
+        dark_sum += static_cast<double>(value) * histogram[value];
+        std::uint64_t const light_count = total - dark_count;
+        if (dark_count == 0 || light_count == 0) {
+            continue;
+        }
+        double const mean_diff = dark_sum / static_cast<double>(dark_count) -
+                                 (total_sum - dark_sum) / static_cast<double>(light_count);
+        double const variance = static_cast<double>(dark_count) *
+                                static_cast<double>(light_count) * mean_diff * mean_diff;
+        if (variance > best_variance) {
+            best_variance = variance;
+            best = static_cast<Byte>(value);
+        }
+    }
+    return best;
+}
+
+namespace {
+BinaryImage::BitWord PackBlack(Byte const* luma, std::size_t count, Byte max_black) {
+    BinaryImage::BitWord bits = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        bits |= BinaryImage::BitWord{luma[i] <= max_black} << i;
+    }
+    return bits;
+}
+}  // namespace
+
+void ThresholdLumaRow(Byte const* luma, std::size_t width, Byte max_black,
+                      BinaryImage::BitWord* row) {
+    std::size_t x = 0;
+    // Constant trip count lets compiler vectorize full words
+    for (; x + BinaryImage::kBitsPerWord <= width; x += BinaryImage::kBitsPerWord, ++row) {
+        *row = PackBlack(luma + x, BinaryImage::kBitsPerWord, max_black);
+    }
+    if (x < width) {
+        *row = PackBlack(luma + x, width - x, max_black);
+    }
+}
+
+void ThresholdLuma(Byte const* luma, Byte max_black, BinaryImage& image) {
+    std::size_t const width = image.GetWidth();
+    for (std::size_t y = 0; y < image.GetHeight(); ++y) {
+        ThresholdLumaRow(luma + y * width, width, max_black, image.GetRow(y));
+    }
+}
+
+void ThresholdAdaptive(Byte const* luma, ThresholdOptions const& options, BinaryImage& image,
+                       std::pmr::memory_resource* resource) {
+    std::size_t const width = image.GetWidth();
+    std::size_t const height = image.GetHeight();
+    std::size_t const window = options.adaptive_window != 0
+                                       ? options.adaptive_window
+                                       : std::max<std::size_t>(width / 8, 1);
+    std::size_t const half = window / 2;
+    std::uint64_t const keep_percent = 100 - std::min(options.adaptive_percent, 100u);
+
+    // Sums of rows [first_row, last_row] of every column. 32 bits hold 16M rows of 255
+    std::pmr::vector<std::uint32_t> column_sums(width, 0, resource);
+    // prefix[x] is sum of column_sums[0, x)
+    std::pmr::vector<std::uint64_t> prefix(width + 1, 0, resource);
+    // Window columns are the same for all rows
+    std::pmr::vector<std::uint32_t> first_cols(width, resource), last_cols(width, resource);
+    std::pmr::vector<std::uint64_t> window_widths(width, resource);
+    for (std::size_t x = 0; x < width; ++x) {
+        first_cols[x] = static_cast<std::uint32_t>(x > half ? x - half : 0);
+        last_cols[x] = static_cast<std::uint32_t>(std::min(x + half, width - 1));
+        window_widths[x] = last_cols[x] - first_cols[x] + 1;
+    }
+    std::pmr::vector<Byte> black(width, resource);
+    auto add_row = [&](std::size_t y) {
+        Byte const* row = luma + y * width;
+        for (std::size_t x = 0; x < width; ++x) {
+            column_sums[x] += row[x];
+        }
+    };
+    auto remove_row = [&](std::size_t y) {
+        Byte const* row = luma + y * width;
+        for (std::size_t x = 0; x < width; ++x) {
+            column_sums[x] -= row[x];
+        }
+    };
+
+    std::size_t last_row = std::min(half, height - 1);
+    for (std::size_t y = 0; y <= last_row; ++y) {
+        add_row(y);
+    }
+    for (std::size_t y = 0; y < height; ++y) {
+        if (y > 0 && y + half < height) {
+            add_row(y + half);
+            last_row = y + half;
+        }
+        if (y > half) {
+            remove_row(y - half - 1);
+        }
+        std::size_t const first_row = y > half ? y - half : 0;
+        std::uint64_t const rows = last_row - first_row + 1;
+
+        for (std::size_t x = 0; x < width; ++x) {
+            prefix[x + 1] = prefix[x] + column_sums[x];
+        }
+        Byte const* row = luma + y * width;
+        for (std::size_t x = 0; x < width; ++x) {
+            // Both sides are scaled by 100 * window area
+            black[x] = row[x] * rows * window_widths[x] * 100 <=
+                       (prefix[last_cols[x] + 1] - prefix[first_cols[x]]) * keep_percent;
+        }
+        BinaryImage::BitWord* out = image.GetRow(y);
+        for (std::size_t x = 0; x < width; x += BinaryImage::kBitsPerWord, ++out) {
+            std::size_t const count = std::min(BinaryImage::kBitsPerWord, width - x);
+            BinaryImage::BitWord bits = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                bits |= BinaryImage::BitWord{black[x + i]} << i;
+            }
+            *out = bits;
+        }
+    }
+}
+}  // namespace bmp
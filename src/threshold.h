@@ -0,0 +1,37 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "binary_image.h"
+#include "reader_options.h"
+#include "util/field_types.h"
+
+// Thresholding of luma images: rows are top-down, one byte per pixel, without padding.
+
+namespace bmp {
+/// @brief Number of pixels of every luma value
+using LumaHistogram = std::array<std::uint64_t, 256>;
+
+/// @brief Add luma of @p width pixels to @p histogram
+void AddToHistogram(Byte const* luma, std::size_t width, LumaHistogram& histogram);
+
+/// @brief Otsu's method: threshold that maximizes between-class variance
+/// @return the greatest luma of dark class
+Byte GetOtsuThreshold(LumaHistogram const& histogram);
+
+/// @brief Pack row of luma into @c BinaryImage row: pixel is black when luma <= @p max_black
+void ThresholdLumaRow(Byte const* luma, std::size_t width, Byte max_black,
+                      BinaryImage::BitWord* row);
+
+/// @brief Threshold whole luma image with global @p max_black
+void ThresholdLuma(Byte const* luma, Byte max_black, BinaryImage& image);
+
+/// @brief Bradley-Roth adaptive thresholding. Window sums come from running column sums and their
+/// prefix sums (integral image rows), so memory usage is O(width) and luma is read in one pass
+/// @param resource -- where row buffers are allocated
+void ThresholdAdaptive(Byte const* luma, ThresholdOptions const& options, BinaryImage& image,
+                       std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+}  // namespace bmp
@@ -0,0 +1,56 @@
+#include "util/arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace bmp::util {
+
+void ArenaResource::AddBlock(std::size_t min_size) {
+    // Blocks grow geometrically until the arena settles down to one block
+    std::size_t size = std::max({min_size + kHeaderSize, kMinBlockSize,
+                                 blocks_ != nullptr ? blocks_->size * 2 : std::size_t{0}});
+    size = (size + kBlockAlignment - 1) / kBlockAlignment * kBlockAlignment;
+    auto* block = static_cast<Block*>(upstream_->allocate(size, kBlockAlignment));
+    *block = {blocks_, size};
+    blocks_ = block;
+    used_ = kHeaderSize;
+}
+
+void ArenaResource::FreeBlocks() noexcept {
+    while (blocks_ != nullptr) {
+        Block* next = blocks_->next;
+        upstream_->deallocate(blocks_, blocks_->size, kBlockAlignment);
+        blocks_ = next;
+    }
+    used_ = 0;
+}
+
+std::size_t ArenaResource::GetAlignedOffset(std::size_t alignment) const {
+    auto const base = reinterpret_cast<std::uintptr_t>(blocks_);
+    return (base + used_ + alignment - 1) / alignment * alignment - base;
+}
+
+void* ArenaResource::do_allocate(std::size_t bytes, std::size_t alignment) {
+    // Padding may differ in another block, so the worst case is counted
+    demand_ += bytes + alignment - 1;
+    if (blocks_ == nullptr || GetAlignedOffset(alignment) + bytes > blocks_->size) {
+        AddBlock(bytes + alignment - 1);
+    }
+    std::size_t const begin = GetAlignedOffset(alignment);
+    used_ = begin + bytes;
+    return reinterpret_cast<std::uint8_t*>(blocks_) + begin;
+}
+
+void ArenaResource::Reset() {
+    peak_demand_ = std::max(peak_demand_, demand_);
+    demand_ = 0;
+    bool const single_block = blocks_ != nullptr && blocks_->next == nullptr;
+    if (!single_block || blocks_->size < peak_demand_ + kHeaderSize) {
+        FreeBlocks();
+        if (peak_demand_ > 0) {
+            AddBlock(peak_demand_);
+        }
+    }
+    used_ = blocks_ != nullptr ? kHeaderSize : 0;
+}
+}  // namespace bmp::util
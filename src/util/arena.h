@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+namespace bmp::util {
+/// @brief Bump allocator for scratch buffers that live until @c Reset.
+/// Memory is taken from upstream resource in blocks, deallocation is a no-op. On @c Reset blocks
+/// are merged into one block of the peak size, so after warm-up repeating the same work makes no
+/// upstream allocations. Not thread-safe
+class ArenaResource : public std::pmr::memory_resource {
+private:
+    // Placed at the beginning of every block
+    struct Block {
+        Block* next;
+        std::size_t size;
+    };
+
+    // Blocks are aligned to cache line, data starts after the header
+    constexpr static std::size_t kBlockAlignment = 64;
+    constexpr static std::size_t kHeaderSize = kBlockAlignment;
+    constexpr static std::size_t kMinBlockSize = 64 << 10;
+
+    std::pmr::memory_resource* upstream_;
+    // The newest block first, allocations are made from it
+    Block* blocks_ = nullptr;
+    std::size_t used_ = 0;
+    // Worst-case space that allocations since Reset take in one block
+    std::size_t demand_ = 0;
+    std::size_t peak_demand_ = 0;
+
+    void AddBlock(std::size_t min_size);
+    /// @brief Offset of the first free byte of the newest block, aligned to @p alignment
+    std::size_t GetAlignedOffset(std::size_t alignment) const;
+    void FreeBlocks() noexcept;
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit ArenaResource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+        : upstream_(upstream) {}
+
+    ~ArenaResource() override {
+        FreeBlocks();
+    }
+
+    ArenaResource(ArenaResource const&) = delete;
+    ArenaResource& operator=(ArenaResource const&) = delete;
+
+    /// @brief Forget all allocations. Memory is kept for reuse
+    /// @note Nothing that was allocated from the arena may be used after this
+    void Reset();
+
+    /// @brief Return all memory to upstream resource
+    void Release() noexcept {
+        FreeBlocks();
+        demand_ = peak_demand_ = 0;
+    }
+
+    std::pmr::memory_resource* GetUpstream() const {
+        return upstream_;
+    }
+};
+}  // namespace bmp::util
@@ -0,0 +1,209 @@
+#include "util/bitfields_kernel.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "util/color.h"
+
+namespace bmp::util {
+namespace {
+using BitWord = std::uint64_t;
+constexpr std::size_t kBitsPerWord = 64;
+
+// Standard masks of 32-bit BMPs
+constexpr ChannelMasks kStandMasks{0x00FF0000, 0x0000FF00, 0x000000FF};
+
+/// @brief Scale @p value in <tt>[0, max]</tt> to <tt>[0, 255]</tt>, rounding to nearest
+constexpr unsigned Scale(std::uint64_t value, std::uint64_t max) {
+    return static_cast<unsigned>((value * 255 + max / 2) / max);
+}
+
+/// @brief Load pixel with loads of its own width. Copying 2 or 3 bytes into zeroed DWord and
+/// reading it back stalls on store forwarding
+template <std::size_t kBytes>
+inline DWord LoadPixel(Byte const* px) {
+    // BMP is little-endian, and so is every target of this library
+    if constexpr (kBytes == 2) {
+        Word pixel;
+        std::memcpy(&pixel, px, sizeof(pixel));
+        return pixel;
+    } else if constexpr (kBytes == 3) {
+        return px[0] | DWord{px[1]} << 8 | DWord{px[2]} << 16;
+    } else {
+        DWord pixel;
+        std::memcpy(&pixel, px, sizeof(pixel));
+        return pixel;
+    }
+}
+
+DWord LoadPixel(Byte const* px, Word byte_count) {
+    switch (byte_count) {
+        case 2:
+            return LoadPixel<2>(px);
+        case 3:
+            return LoadPixel<3>(px);
+        default:
+            return LoadPixel<4>(px);
+    }
+}
+
+template <DWord kMax>
+constexpr std::array<Byte, kMax + 1> MakeScaleTable() {
+    std::array<Byte, kMax + 1> table{};
+    for (DWord value = 0; value <= kMax; ++value) {
+        table[value] = static_cast<Byte>(Scale(value, kMax));
+    }
+    return table;
+}
+
+template <DWord kMask>
+struct Channel {
+    constexpr static unsigned kShift = std::countr_zero(kMask);
+    constexpr static DWord kMax = kMask >> kShift;
+
+    static unsigned Get(DWord pixel) {
+        if constexpr (kMax == 0xFF) {
+            return (pixel >> kShift) & kMax;
+        } else {
+            // Channels of the specialized layouts have at most 10 bits, so tables are small
+            constexpr static auto kTable = MakeScaleTable<kMax>();
+            return kTable[(pixel >> kShift) & kMax];
+        }
+    }
+};
+
+template <std::size_t kBytes, DWord kRed, DWord kGreen, DWord kBlue>
+inline BitWord MaskedBits(Byte const* px, std::size_t count, unsigned max_black_sum) {
+    BitWord bits = 0;
+    for (std::size_t i = 0; i < count; ++i, px += kBytes) {
+        DWord const pixel = LoadPixel<kBytes>(px);
+        unsigned const sum = Channel<kRed>::Get(pixel) + Channel<kGreen>::Get(pixel) +
+                             Channel<kBlue>::Get(pixel);
+        bits |= BitWord{sum <= max_black_sum} << i;
+    }
+    return bits;
+}
+
+template <std::size_t kBytes, DWord kRed, DWord kGreen, DWord kBlue>
+void ThresholdMasked(Byte const* scan, std::size_t width, unsigned max_black_sum, BitWord* out) {
+    constexpr auto kBits = MaskedBits<kBytes, kRed, kGreen, kBlue>;
+    std::size_t x = 0;
+    // Constant trip count lets compiler unroll full words
+    for (; x + kBitsPerWord <= width; x += kBitsPerWord, ++out) {
+        *out = kBits(scan + x * kBytes, kBitsPerWord, max_black_sum);
+    }
+    if (x < width) {
+        *out = kBits(scan + x * kBytes, width - x, max_black_sum);
+    }
+}
+
+template <std::size_t kBytes, DWord kRed, DWord kGreen, DWord kBlue>
+void LumaMasked(Byte const* scan, std::size_t width, Byte* out) {
+    for (std::size_t x = 0; x < width; ++x, scan += kBytes) {
+        DWord const pixel = LoadPixel<kBytes>(scan);
+        out[x] = GetLuma(Channel<kRed>::Get(pixel), Channel<kGreen>::Get(pixel),
+                         Channel<kBlue>::Get(pixel));
+    }
+}
+
+struct KernelEntry {
+    Word byte_count;
+    ChannelMasks masks;
+    ThresholdKernel kernel;
+    LumaKernel luma;
+};
+
+template <std::size_t kBytes, DWord kRed, DWord kGreen, DWord kBlue>
+constexpr KernelEntry MakeEntry() {
+    return {kBytes, {kRed, kGreen, kBlue}, &ThresholdMasked<kBytes, kRed, kGreen, kBlue>,
+            &LumaMasked<kBytes, kRed, kGreen, kBlue>};
+}
+
+constexpr KernelEntry kKernels[] = {
+        // BGR and BGRX: threshold kernels of these are SIMD ones
+        MakeEntry<3, 0x00FF0000, 0x0000FF00, 0x000000FF>(),
+        MakeEntry<4, 0x00FF0000, 0x0000FF00, 0x000000FF>(),
+        // RGB565 and RGB555 (the latter is also the layout of 16-bit RGB BMPs)
+        MakeEntry<2, 0xF800, 0x07E0, 0x001F>(),
+        MakeEntry<2, 0x7C00, 0x03E0, 0x001F>(),
+        // BGR565
+        MakeEntry<2, 0x001F, 0x07E0, 0xF800>(),
+        // XBGR (red is the lowest byte) and RGBX (alpha or padding is the lowest byte)
+        MakeEntry<4, 0x000000FF, 0x0000FF00, 0x00FF0000>(),
+        MakeEntry<4, 0xFF000000, 0x00FF0000, 0x0000FF00>(),
+        // 10:10:10:2, both channel orders
+        MakeEntry<4, 0x3FF00000, 0x000FFC00, 0x000003FF>(),
+        MakeEntry<4, 0x000003FF, 0x000FFC00, 0x3FF00000>(),
+};
+
+KernelEntry const* FindEntry(Word byte_count, ChannelMasks const& masks) {
+    for (auto const& entry : kKernels) {
+        if (entry.byte_count == byte_count && entry.masks == masks) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+}  // namespace
+
+ThresholdKernel GetBitfieldsKernel(Word byte_count, ChannelMasks const& masks) {
+    if ((byte_count == 3 || byte_count == 4) && masks == kStandMasks) {
+        return GetThresholdKernel(byte_count);
+    }
+    KernelEntry const* entry = FindEntry(byte_count, masks);
+    return entry ? entry->kernel : nullptr;
+}
+
+LumaKernel GetLumaKernel(Word byte_count, ChannelMasks const& masks) {
+    KernelEntry const* entry = FindEntry(byte_count, masks);
+    return entry ? entry->luma : nullptr;
+}
+
+BitfieldsLayout::BitfieldsLayout(Word byte_count, ChannelMasks const& masks)
+    : byte_count_(byte_count) {
+    std::array<DWord, 3> const channel_masks{masks.red, masks.green, masks.blue};
+    for (std::size_t i = 0; i < channel_masks.size(); ++i) {
+        shifts_[i] = std::countr_zero(channel_masks[i]);
+        maxes_[i] = channel_masks[i] >> shifts_[i];
+        if (maxes_[i] <= kMaxTableChannel) {
+            tables_[i].resize(maxes_[i] + 1);
+            for (DWord value = 0; value <= maxes_[i]; ++value) {
+                tables_[i][value] = static_cast<Byte>(Scale(value, maxes_[i]));
+            }
+        }
+    }
+}
+
+unsigned BitfieldsLayout::GetChannel(DWord pixel, std::size_t channel) const {
+    DWord const value = (pixel >> shifts_[channel]) & maxes_[channel];
+    return tables_[channel].empty() ? Scale(value, maxes_[channel]) : tables_[channel][value];
+}
+
+void BitfieldsLayout::Luma(Byte const* scan, std::size_t width, Byte* out) const {
+    for (std::size_t x = 0; x < width; ++x, scan += byte_count_) {
+        DWord const pixel = LoadPixel(scan, byte_count_);
+        out[x] = GetLuma(static_cast<Byte>(GetChannel(pixel, 0)),
+                         static_cast<Byte>(GetChannel(pixel, 1)),
+                         static_cast<Byte>(GetChannel(pixel, 2)));
+    }
+}
+
+void BitfieldsLayout::Threshold(Byte const* scan, std::size_t width, unsigned max_black_sum,
+                                BitWord* out) const {
+    for (std::size_t x = 0; x < width; x += kBitsPerWord, ++out) {
+        std::size_t const count = std::min(kBitsPerWord, width - x);
+        Byte const* px = scan + x * byte_count_;
+        BitWord bits = 0;
+        for (std::size_t i = 0; i < count; ++i, px += byte_count_) {
+            DWord const pixel = LoadPixel(px, byte_count_);
+            unsigned sum = 0;
+            for (std::size_t c = 0; c < shifts_.size(); ++c) {
+                sum += GetChannel(pixel, c);
+            }
+            bits |= BitWord{sum <= max_black_sum} << i;
+        }
+        *out = bits;
+    }
+}
+}  // namespace bmp::util
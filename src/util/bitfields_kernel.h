@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "util/field_types.h"
+#include "util/threshold_kernel.h"
+
+// Decoders for 16 and 32-bit BITFIELDS pixels. Each channel is extracted with its mask and scaled
+// to 0..255 (rounding to nearest), then thresholded as usual or converted to luma.
+
+namespace bmp::util {
+/// @brief Red, green and blue masks
+struct ChannelMasks {
+    DWord red;
+    DWord green;
+    DWord blue;
+};
+
+inline bool operator==(ChannelMasks const& a, ChannelMasks const& b) {
+    return a.red == b.red && a.green == b.green && a.blue == b.blue;
+}
+
+/// @brief Mask is not zero and its bits are contiguous
+inline bool IsContiguousMask(DWord mask) {
+    if (mask == 0) {
+        return false;
+    }
+    DWord const low = mask & -mask;
+    return ((mask + low) & mask) == 0;
+}
+
+/// @brief Convert @p width pixels of @p scan into luma, one byte per pixel
+using LumaKernel = void (*)(Byte const* scan, std::size_t width, Byte* out);
+
+/// @brief Get kernel that is compiled for @p masks.
+/// Standard 8-bit channels use SIMD kernels; RGB565, RGB555, XBGR, RGBX and 10:10:10 layouts have
+/// template instances with constexpr shifts and scales.
+/// @return nullptr if there is no such kernel; use @c BitfieldsLayout then
+ThresholdKernel GetBitfieldsKernel(Word byte_count, ChannelMasks const& masks);
+
+/// @brief Same as @c GetBitfieldsKernel, for luma. Standard masks of 24-bit pixels are supported
+/// too
+LumaKernel GetLumaKernel(Word byte_count, ChannelMasks const& masks);
+
+/// @brief Any masks, decoded at runtime
+class BitfieldsLayout {
+private:
+    Word byte_count_ = 0;
+    // Channel = (pixel >> shift) & max
+    std::array<unsigned, 3> shifts_{};
+    std::array<DWord, 3> maxes_{};
+    // Scaled values of channels up to 16 bits wide; wider channels are scaled on the fly
+    constexpr static DWord kMaxTableChannel = 0xFFFF;
+    std::array<std::vector<Byte>, 3> tables_;
+
+    /// @brief Channel @p channel (0 is red) of @p pixel, scaled to 0..255
+    unsigned GetChannel(DWord pixel, std::size_t channel) const;
+
+public:
+    BitfieldsLayout() = default;
+
+    /// @param masks -- must be contiguous
+    BitfieldsLayout(Word byte_count, ChannelMasks const& masks);
+
+    /// @brief Same as @c ThresholdKernel
+    void Threshold(Byte const* scan, std::size_t width, unsigned max_black_sum,
+                   std::uint64_t* out) const;
+
+    /// @brief Same as @c LumaKernel
+    void Luma(Byte const* scan, std::size_t width, Byte* out) const;
+};
+}  // namespace bmp::util
@@ -32,9 +32,9 @@ inline std::istream& operator>>(std::istream& is, BitmapFileHeader& file_header)
     }
 
     // 4D42 is "BM"
-    InvalidBMPError::Assert(
-            file_header.signature == 0x4D42,
-            "invalid magic: must be 4D42, got " + std::to_string(file_header.signature));
+    InvalidBMPError::Assert(file_header.signature == 0x4D42, [&] {
+        return "invalid magic: must be 4D42, got " + std::to_string(file_header.signature);
+    });
     InvalidBMPError::Assert(file_header.file_size > 0, "file size cannot be 0");
     InvalidBMPError::Assert(file_header.reserved1 == 0 && file_header.reserved2 == 0,
                             "one of reserved fields is not zero");
@@ -12,6 +12,15 @@
 // Size of info header is saved in a separate field of type DWord.
 
 namespace bmp::util {
+/// @brief Pixels are palette indices
+inline bool IsIndexed(Word bit_count) {
+    return bit_count == 1 || bit_count == 4 || bit_count == 8;
+}
+
+inline bool IsSupportedBitCount(Word bit_count) {
+    return IsIndexed(bit_count) || bit_count == 16 || bit_count == 24 || bit_count == 32;
+}
+
 #pragma pack(push, 1)
 
 /// @brief Old (16-bit) info header
@@ -34,11 +43,13 @@ inline std::istream& operator>>(std::istream& is, BitmapCoreHeader& core_header)
 
     InvalidBMPError::Assert(core_header.width > 0 && core_header.height > 0,
                             "width and height must be positive");
-    InvalidBMPError::Assert(core_header.planes == 1,
-                            "plains must be 1, got " + std::to_string(core_header.planes));
+    InvalidBMPError::Assert(core_header.planes == 1, [&] {
+        return "plains must be 1, got " + std::to_string(core_header.planes);
+    });
     // 32-bit CORE is not documented by Microsoft, but isn't impossible
-    InvalidBMPError::Assert(core_header.bit_count == 24 || core_header.bit_count == 32,
-                            std::to_string(core_header.bit_count) + "-bit BMPs are not supported");
+    InvalidBMPError::Assert(IsSupportedBitCount(core_header.bit_count), [&] {
+        return std::to_string(core_header.bit_count) + "-bit BMPs are not supported";
+    });
     return is;
 }
 
@@ -68,8 +79,41 @@ struct BitmapInfoHeader {
     DWord clr_important;
 };
 
+/// @brief Version 4 info header: version 3 header with bit masks and color space
+struct BitmapV4Header {
+    BitmapInfoHeader info;
+    // Bit masks (used only if compression is BITFIELDS or ALPHABITFIELDS)
+    DWord red_mask;
+    DWord green_mask;
+    DWord blue_mask;
+    DWord alpha_mask;
+    // Color space (see ColorSpace enum)
+    DWord cs_type;
+    // CIEXYZ coordinates of red, green and blue endpoints (FXPT2DOT30)
+    Long endpoints[9];
+    // Gamma for each channel (16.16)
+    DWord gamma_red;
+    DWord gamma_green;
+    DWord gamma_blue;
+};
+
+/// @brief Version 5 info header: version 4 header with rendering intent and ICC profile
+struct BitmapV5Header {
+    BitmapV4Header v4;
+    DWord intent;
+    // ICC profile offset (from the beginning of info header) and size (bytes)
+    DWord profile_data;
+    DWord profile_size;
+    DWord reserved;
+};
+
 #pragma pack(pop)
 
+static_assert(sizeof(BitmapCoreHeader) + sizeof(DWord) == 12);
+static_assert(sizeof(BitmapInfoHeader) + sizeof(DWord) == 40);
+static_assert(sizeof(BitmapV4Header) + sizeof(DWord) == 108);
+static_assert(sizeof(BitmapV5Header) + sizeof(DWord) == 124);
+
 inline std::istream& operator>>(std::istream& is, BitmapInfoHeader& info_header) {
     if (!is.read(reinterpret_cast<char*>(&info_header), sizeof(info_header))) {
         throw IOError("cannot read info header");
@@ -77,16 +121,37 @@ inline std::istream& operator>>(std::istream& is, BitmapInfoHeader& info_header)
 
     InvalidBMPError::Assert(info_header.width > 0, "width must be positive");
     InvalidBMPError::Assert(info_header.height != 0, "height cannot be zero");
-    InvalidBMPError::Assert(info_header.planes == 1,
-                            "planes must be 1, got " + std::to_string(info_header.planes));
-    InvalidBMPError::Assert(info_header.bit_count == 24 || info_header.bit_count == 32,
-                            std::to_string(info_header.bit_count) + "-bit BMPs are not supported");
-    InvalidBMPError::Assert(
-            info_header.compression == static_cast<DWord>(Compression::RGB) ||
-                    info_header.compression == static_cast<DWord>(Compression::BITFIELDS) ||
-                    info_header.compression == static_cast<DWord>(Compression::ALPHABITFIELDS),
-            "invalid compression for 24 or 32-bit BMPs: " +
-                    std::to_string(info_header.compression));
+    InvalidBMPError::Assert(info_header.planes == 1, [&] {
+        return "planes must be 1, got " + std::to_string(info_header.planes);
+    });
+    InvalidBMPError::Assert(IsSupportedBitCount(info_header.bit_count), [&] {
+        return std::to_string(info_header.bit_count) + "-bit BMPs are not supported";
+    });
+    auto const compression = static_cast<Compression>(info_header.compression);
+    if (IsIndexed(info_header.bit_count)) {
+        InvalidBMPError::Assert(
+                compression == Compression::RGB ||
+                        (compression == Compression::RLE8 && info_header.bit_count == 8) ||
+                        (compression == Compression::RLE4 && info_header.bit_count == 4),
+                [&] {
+                    return "invalid compression for " + std::to_string(info_header.bit_count) +
+                           "-bit BMPs: " + std::to_string(info_header.compression);
+                });
+        // Scans of RLE bitmaps go from bottom to top
+        InvalidBMPError::Assert(compression == Compression::RGB || info_header.height > 0,
+                                "RLE BMPs cannot be top-down");
+    } else {
+        InvalidBMPError::Assert(compression == Compression::RGB ||
+                                        compression == Compression::BITFIELDS ||
+                                        compression == Compression::ALPHABITFIELDS,
+                                [&] {
+                                    return "invalid compression for 16, 24 or 32-bit BMPs: " +
+                                           std::to_string(info_header.compression);
+                                });
+        // Masks are defined for 16 and 32-bit pixels only
+        InvalidBMPError::Assert(compression == Compression::RGB || info_header.bit_count != 24,
+                                "BITFIELDS compression needs 16 or 32-bit pixels");
+    }
     InvalidBMPError::Assert(info_header.compression == static_cast<DWord>(Compression::RGB) ||
                                     info_header.size_image > 0,
                             "size image cannot be 0 when compression is not RGB");
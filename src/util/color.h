@@ -14,4 +14,9 @@ struct RGBColor {
 };
 
 #pragma pack(pop)
+
+/// @brief Weighted luma (ITU-R BT.601) in 8-bit fixed point
+constexpr Byte GetLuma(Byte red, Byte green, Byte blue) {
+    return static_cast<Byte>((77u * red + 150u * green + 29u * blue + 128) >> 8);
+}
 }  // namespace bmp::util
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "util/file_identity.h"
+#include "util/io_error.h"
+
+namespace bmp::util {
+/// @brief File descriptor. Positional reads and writes are safe to call from several threads
+class File {
+private:
+    int fd_ = -1;
+
+public:
+    File() = default;
+
+    /// @param flags -- @c open() flags. New files are created with 0644 permissions
+    explicit File(char const* filename, int flags = O_RDONLY)
+        : fd_(open(filename, flags | O_CLOEXEC, 0644)) {
+        if (fd_ < 0) {
+            throw IOError(std::string("cannot open ") + filename + ": " + std::strerror(errno));
+        }
+    }
+
+    explicit File(std::string const& filename, int flags = O_RDONLY)
+        : File(filename.c_str(), flags) {}
+
+    File(File const&) = delete;
+    File& operator=(File const&) = delete;
+
+    File(File&& other) noexcept : fd_(std::exchange(other.fd_, -1)) {}
+
+    File& operator=(File&& other) noexcept {
+        if (this != &other) {
+            if (fd_ >= 0) {
+                close(fd_);
+            }
+            fd_ = std::exchange(other.fd_, -1);
+        }
+        return *this;
+    }
+
+    ~File() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    int GetDescriptor() const {
+        return fd_;
+    }
+
+    std::uint64_t GetSize() const {
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            throw IOError(std::string("cannot stat file: ") + std::strerror(errno));
+        }
+        return st.st_size;
+    }
+
+    FileIdentity GetIdentity() const {
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            throw IOError(std::string("cannot stat file: ") + std::strerror(errno));
+        }
+        return FileIdentity::FromStat(st);
+    }
+
+    /// @brief Write exactly @p size bytes starting at @p offset
+    void WriteAt(void const* buf, std::size_t size, std::uint64_t offset) const {
+        auto const* src = static_cast<char const*>(buf);
+        while (size > 0) {
+            ssize_t const n = pwrite(fd_, src, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                throw IOError(std::string("cannot write file: ") + std::strerror(errno));
+            }
+            src += n;
+            size -= n;
+            offset += n;
+        }
+    }
+
+    /// @brief Read exactly @p size bytes starting at @p offset
+    void ReadAt(void* buf, std::size_t size, std::uint64_t offset) const {
+        auto* dst = static_cast<char*>(buf);
+        while (size > 0) {
+            ssize_t const n = pread(fd_, dst, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                throw IOError(std::string("cannot read file: ") + std::strerror(errno));
+            }
+            if (n == 0) {
+                throw IOError("unexpected end of file");
+            }
+            dst += n;
+            size -= n;
+            offset += n;
+        }
+    }
+};
+
+/// @brief Make @p dst (empty file) a copy of the first @p size bytes of @p src.
+/// Extents are shared (reflink) where filesystem supports it, otherwise data is copied inside
+/// of kernel. Plain read/write is the last resort
+inline void CopyFileContents(File const& src, File const& dst, std::uint64_t size) {
+    if (src.GetSize() == size && ioctl(dst.GetDescriptor(), FICLONE, src.GetDescriptor()) == 0) {
+        return;
+    }
+
+    loff_t src_offset = 0, dst_offset = 0;
+    while (static_cast<std::uint64_t>(src_offset) < size) {
+        ssize_t const n = copy_file_range(src.GetDescriptor(), &src_offset, dst.GetDescriptor(),
+                                          &dst_offset, size - src_offset, 0);
+        if (n > 0) {
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            throw IOError("unexpected end of file");
+        }
+        if (errno != EXDEV && errno != ENOSYS && errno != EINVAL && errno != EOPNOTSUPP) {
+            throw IOError(std::string("cannot copy file: ") + std::strerror(errno));
+        }
+
+        // Copying between these files is not supported by kernel
+        constexpr std::size_t kBufferSize = 1 << 20;
+        std::vector<char> buffer(kBufferSize);
+        for (std::uint64_t offset = src_offset; offset < size; offset += kBufferSize) {
+            std::size_t const count = std::min<std::uint64_t>(kBufferSize, size - offset);
+            src.ReadAt(buffer.data(), count, offset);
+            dst.WriteAt(buffer.data(), count, offset);
+        }
+        return;
+    }
+}
+}  // namespace bmp::util
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <sys/stat.h>
+
+namespace bmp::util {
+/// @brief What identifies file contents without reading them: file is the same if it is the same
+/// inode and neither its size nor its modification time has changed
+struct FileIdentity {
+    std::uint64_t device = 0;
+    std::uint64_t inode = 0;
+    std::uint64_t size = 0;
+    std::int64_t mtime_ns = 0;
+
+    bool operator==(FileIdentity const&) const = default;
+
+    static FileIdentity FromStat(struct stat const& st) {
+        return {static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino),
+                static_cast<std::uint64_t>(st.st_size),
+                static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+                        st.st_mtim.tv_nsec};
+    }
+};
+}  // namespace bmp::util
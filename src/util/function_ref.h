@@ -0,0 +1,32 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace bmp::util {
+template <typename Signature>
+class FunctionRef;
+
+/// @brief Non-owning reference to a callable. Unlike @c std::function it never allocates, so
+/// callable must outlive the reference (e. g. lambda that is passed as an argument)
+template <typename R, typename... Args>
+class FunctionRef<R(Args...)> {
+private:
+    void const* callable_;
+    R (*invoke_)(void const*, Args...);
+
+public:
+    template <typename F>
+        requires(!std::is_same_v<std::remove_cvref_t<F>, FunctionRef> &&
+                 std::is_invocable_r_v<R, F const&, Args...>)
+    FunctionRef(F const& callable)
+        : callable_(std::addressof(callable)), invoke_([](void const* f, Args... args) -> R {
+              return (*static_cast<F const*>(f))(std::forward<Args>(args)...);
+          }) {}
+
+    R operator()(Args... args) const {
+        return invoke_(callable_, std::forward<Args>(args)...);
+    }
+};
+}  // namespace bmp::util
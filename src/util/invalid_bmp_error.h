@@ -1,7 +1,9 @@
 #pragma once
 
+#include <concepts>
 #include <exception>
 #include <string>
+#include <utility>
 
 namespace bmp {
 /// @brief This error is thrown when BMP cannot be read due to invalid data, mainly in headers
@@ -22,5 +24,21 @@ public:
             throw InvalidBMPError(std::move(msg));
         }
     }
+
+    /// @brief Same, but message is not converted to @c std::string unless check fails
+    static void Assert(bool cond, char const* msg) {
+        if (!cond) {
+            throw InvalidBMPError(msg);
+        }
+    }
+
+    /// @brief Check condition @c cond, throw @c InvalidBMPError with message from @p make_msg if
+    /// it's not @c true. Message is built only on failure, so checks do not allocate
+    template <std::invocable MessageFn>
+    static void Assert(bool cond, MessageFn&& make_msg) {
+        if (!cond) {
+            throw InvalidBMPError(std::forward<MessageFn>(make_msg)());
+        }
+    }
 };
 }  // namespace bmp
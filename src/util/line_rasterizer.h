@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+// Bresenham line rasterizer that emits horizontal runs of pixels instead of single pixels.
+// Line is clipped to the image in advance: the range of Bresenham steps that stay inside of
+// the image is computed in closed form (Liang-Barsky style, but in integers), so clipped line
+// consists of exactly the same pixels as the unclipped one. Nothing is allocated.
+
+namespace bmp::util {
+namespace detail {
+inline std::int64_t FloorDiv(std::int64_t a, std::int64_t b) {
+    std::int64_t q = a / b;
+    return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+inline std::int64_t CeilDiv(std::int64_t a, std::int64_t b) {
+    return -FloorDiv(-a, b);
+}
+
+/// @brief Range of steps <tt>[first, last]</tt> of line along major axis.
+/// At step t minor offset is <tt>floor((2 * d_minor * t + d_major) / (2 * d_major))</tt>
+struct StepRange {
+    std::int64_t first;
+    std::int64_t last;
+};
+
+/// @brief Steps at which major coordinate is inside <tt>[0, major_size)</tt> and minor one is
+/// inside <tt>[0, minor_size)</tt>. Major coordinate increases, minor goes in @p minor_sign
+/// direction
+inline StepRange ClipSteps(std::int64_t major, std::int64_t minor, std::int64_t d_major,
+                           std::int64_t d_minor, std::int64_t minor_sign, std::int64_t major_size,
+                           std::int64_t minor_size) {
+    StepRange range{std::max<std::int64_t>(0, -major),
+                    std::min(d_major, major_size - 1 - major)};
+
+    // Allowed minor offsets
+    std::int64_t k_min = minor_sign > 0 ? -minor : minor - (minor_size - 1);
+    std::int64_t k_max = minor_sign > 0 ? minor_size - 1 - minor : minor;
+    k_min = std::max<std::int64_t>(k_min, 0);
+    k_max = std::min(k_max, d_minor);
+    if (k_min > k_max) {
+        return {1, 0};
+    }
+    if (d_minor > 0) {
+        range.first = std::max(range.first, CeilDiv(2 * d_major * k_min - d_major, 2 * d_minor));
+        range.last = std::min(range.last,
+                              FloorDiv(2 * d_major * (k_max + 1) - d_major - 1, 2 * d_minor));
+    }
+    return range;
+}
+}  // namespace detail
+
+/// @brief Rasterize segment between (x1, y1) and (x2, y2) (both inclusive), clipped to
+/// <tt>[0, width) x [0, height)</tt>.
+/// @p emit_run(y, x_begin, x_end) is called for every run of pixels <tt>[x_begin, x_end)</tt>
+/// of row y. Runs of one row never touch each other, rows go monotonically
+template <typename EmitRun>
+void RasterizeLine(std::int64_t x1, std::int64_t y1, std::int64_t x2, std::int64_t y2,
+                   std::int64_t width, std::int64_t height, EmitRun&& emit_run) {
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    std::int64_t dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    std::int64_t dy = y2 > y1 ? y2 - y1 : y1 - y2;
+
+    if (dx >= dy) {
+        // X is the major axis, every row gets one run
+        if (x1 > x2) {
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+        }
+        std::int64_t const sy = y2 >= y1 ? 1 : -1;
+        auto const range = detail::ClipSteps(x1, y1, dx, dy, sy, width, height);
+        if (range.first > range.last) {
+            return;
+        }
+        if (dx == 0) {
+            emit_run(y1, x1, x1 + 1);
+            return;
+        }
+
+        // err is kept in [0, 2 * dx), y moves when it overflows
+        std::int64_t const start = 2 * dy * range.first + dx;
+        std::int64_t err = start % (2 * dx);
+        std::int64_t y = y1 + sy * (start / (2 * dx));
+        std::int64_t x = x1 + range.first;
+        std::int64_t run_begin = x;
+        for (std::int64_t const x_last = x1 + range.last; x < x_last;) {
+            ++x;
+            err += 2 * dy;
+            if (err >= 2 * dx) {
+                err -= 2 * dx;
+                emit_run(y, run_begin, x);
+                run_begin = x;
+                y += sy;
+            }
+        }
+        emit_run(y, run_begin, x + 1);
+        return;
+    }
+
+    // Y is the major axis, every row gets exactly one pixel
+    if (y1 > y2) {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+    }
+    std::int64_t const sx = x2 >= x1 ? 1 : -1;
+    auto const range = detail::ClipSteps(y1, x1, dy, dx, sx, height, width);
+    if (range.first > range.last) {
+        return;
+    }
+
+    std::int64_t const start = 2 * dx * range.first + dy;
+    std::int64_t err = start % (2 * dy);
+    std::int64_t x = x1 + sx * (start / (2 * dy));
+    for (std::int64_t y = y1 + range.first, y_last = y1 + range.last;; ++y) {
+        emit_run(y, x, x + 1);
+        if (y == y_last) {
+            break;
+        }
+        err += 2 * dx;
+        if (err >= 2 * dy) {
+            err -= 2 * dy;
+            x += sx;
+        }
+    }
+}
+}  // namespace bmp::util
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <exception>
+#include <string>
+
+namespace bmp {
+/// @brief Thrown when batch manifest line cannot be parsed
+class ManifestError : public std::exception {
+private:
+    std::string msg_;
+
+public:
+    ManifestError(std::size_t line_num, std::string const& msg)
+        : msg_("Invalid manifest line " + std::to_string(line_num) + ": " + msg) {}
+
+    virtual char const* what() const noexcept override {
+        return msg_.c_str();
+    }
+};
+}  // namespace bmp
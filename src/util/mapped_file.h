@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#include "util/field_types.h"
+#include "util/file_identity.h"
+#include "util/io_error.h"
+
+namespace bmp::util {
+/// @brief Whole file mapped into memory.
+/// Pages are private: they may be written, but changes are never propagated to the file
+class MappedFile {
+private:
+    Byte* data_ = nullptr;
+    std::size_t size_ = 0;
+    FileIdentity identity_;
+
+    void Unmap() noexcept {
+        if (data_ != nullptr) {
+            munmap(data_, size_);
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+public:
+    MappedFile() = default;
+
+    /// @note Empty file is mapped to an empty range
+    explicit MappedFile(char const* filename) {
+        int fd = open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw IOError(std::string("cannot open ") + filename + ": " + std::strerror(errno));
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            int err = errno;
+            close(fd);
+            throw IOError(std::string("cannot stat ") + filename + ": " + std::strerror(err));
+        }
+        size_ = st.st_size;
+        identity_ = FileIdentity::FromStat(st);
+        if (size_ > 0) {
+            // Only pages that are drawn on are copied, so swap is not reserved for the whole
+            // file: otherwise images larger than RAM cannot be mapped
+            void* addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE,
+                              fd, 0);
+            if (addr == MAP_FAILED) {
+                int err = errno;
+                close(fd);
+                size_ = 0;
+                throw IOError(std::string("cannot map ") + filename + ": " + std::strerror(err));
+            }
+            data_ = static_cast<Byte*>(addr);
+        }
+        // Mapping stays valid after descriptor is closed
+        close(fd);
+    }
+
+    explicit MappedFile(std::string const& filename) : MappedFile(filename.c_str()) {}
+
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)),
+          identity_(other.identity_) {}
+
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            Unmap();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+            identity_ = other.identity_;
+        }
+        return *this;
+    }
+
+    ~MappedFile() {
+        Unmap();
+    }
+
+    Byte* GetData() noexcept {
+        return data_;
+    }
+
+    Byte const* GetData() const noexcept {
+        return data_;
+    }
+
+    std::size_t GetSize() const noexcept {
+        return size_;
+    }
+
+    /// @brief Identity of the file when it was mapped
+    FileIdentity const& GetIdentity() const noexcept {
+        return identity_;
+    }
+};
+}  // namespace bmp::util
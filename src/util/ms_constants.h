@@ -5,4 +5,12 @@
 namespace bmp::util {
 /// @brief BMP Compression method
 enum class Compression { RGB = 0, RLE8, RLE4, BITFIELDS, JPEG, PNG, ALPHABITFIELDS };
+
+/// @brief Color space of V4 and V5 headers
+enum class ColorSpace : unsigned {
+    CALIBRATED_RGB = 0,
+    // 'sRGB' and 'Win ' in little-endian
+    SRGB = 0x73524742,
+    WINDOWS_COLOR_SPACE = 0x57696E20,
+};
 }  // namespace bmp::util
@@ -0,0 +1,358 @@
+#include "util/read_ahead.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <linux/io_uring.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+#include "util/io_error.h"
+
+namespace bmp::util {
+
+namespace {
+/// @brief Reads are made with pread by one background thread
+class ThreadBackend : public ReadAheadQueue::Backend {
+private:
+    struct Request {
+        std::size_t slot;
+        Byte* buf;
+        std::size_t size;
+        std::uint64_t offset;
+    };
+
+    File const& file_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Request> requests_;
+    std::vector<bool> done_;
+    std::vector<std::exception_ptr> errors_;
+    bool stop_ = false;
+    std::thread worker_;
+
+    void WorkerLoop() {
+        while (true) {
+            Request request;
+            {
+                std::unique_lock lock{mutex_};
+                cv_.wait(lock, [this] { return stop_ || !requests_.empty(); });
+                if (stop_) {
+                    return;
+                }
+                request = requests_.front();
+                requests_.pop_front();
+            }
+            std::exception_ptr error;
+            try {
+                file_.ReadAt(request.buf, request.size, request.offset);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            {
+                std::lock_guard lock{mutex_};
+                done_[request.slot] = true;
+                errors_[request.slot] = error;
+            }
+            cv_.notify_all();
+        }
+    }
+
+public:
+    ThreadBackend(File const& file, std::size_t depth)
+        : file_(file), done_(depth, false), errors_(depth) {
+        worker_ = std::thread(&ThreadBackend::WorkerLoop, this);
+    }
+
+    ~ThreadBackend() override {
+        {
+            std::lock_guard lock{mutex_};
+            stop_ = true;
+        }
+        cv_.notify_all();
+        // Read that is being made is finished, queued ones are dropped
+        worker_.join();
+    }
+
+    void Submit(std::size_t slot, Byte* buf, std::size_t size, std::uint64_t offset) override {
+        {
+            std::lock_guard lock{mutex_};
+            done_[slot] = false;
+            requests_.push_back({slot, buf, size, offset});
+        }
+        cv_.notify_all();
+    }
+
+    void Wait(std::size_t slot) override {
+        std::unique_lock lock{mutex_};
+        cv_.wait(lock, [&] { return done_[slot]; });
+        if (errors_[slot]) {
+            std::rethrow_exception(std::exchange(errors_[slot], nullptr));
+        }
+    }
+};
+
+/// @brief Reads are submitted to io_uring. Raw system calls are used, so liburing is not needed
+class IOUringBackend : public ReadAheadQueue::Backend {
+private:
+    struct Request {
+        Byte* buf = nullptr;
+        std::size_t size = 0;
+        std::uint64_t offset = 0;
+        bool pending = false;
+        // Negative errno, 0 on success
+        int error = 0;
+    };
+
+    int fd_ = -1;
+    int file_fd_;
+    std::vector<Request> requests_;
+    std::size_t pending_count_ = 0;
+
+    void* sq_ring_ = MAP_FAILED;
+    std::size_t sq_ring_size_ = 0;
+    void* cq_ring_ = MAP_FAILED;
+    std::size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqes_size_ = 0;
+
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    static unsigned* RingField(void* ring, unsigned offset) {
+        return reinterpret_cast<unsigned*>(static_cast<char*>(ring) + offset);
+    }
+
+    int Enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return static_cast<int>(
+                syscall(__NR_io_uring_enter, fd_, to_submit, min_complete, flags, nullptr, 0));
+    }
+
+    /// @brief Put read of the rest of request @p slot into submission queue and submit it
+    void Enqueue(std::size_t slot) {
+        Request const& request = requests_[slot];
+        unsigned const tail = *sq_tail_;
+        unsigned const index = tail & sq_mask_;
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file_fd_;
+        sqe.addr = reinterpret_cast<std::uint64_t>(request.buf);
+        // Reads are split into 1 GiB parts, the rest is read on completion
+        sqe.len = static_cast<unsigned>(std::min<std::size_t>(request.size, 1u << 30));
+        sqe.off = request.offset;
+        sqe.user_data = slot;
+        sq_array_[index] = index;
+        std::atomic_ref<unsigned>{*sq_tail_}.store(tail + 1, std::memory_order_release);
+
+        while (true) {
+            int const submitted = Enter(1, 0, 0);
+            if (submitted >= 0) {
+                return;
+            }
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                throw IOError(std::string("cannot submit read: ") + std::strerror(errno));
+            }
+        }
+    }
+
+    /// @brief Handle completion of read that was made for @p slot
+    void Complete(std::size_t slot, int result) {
+        Request& request = requests_[slot];
+        if (result == -EINTR || result == -EAGAIN) {
+            Enqueue(slot);
+            return;
+        }
+        if (result == 0) {
+            result = -ENODATA;
+        }
+        if (result < 0) {
+            request.error = result;
+        } else if (static_cast<std::size_t>(result) < request.size) {
+            // Short read: the rest is requested again
+            request.buf += result;
+            request.size -= result;
+            request.offset += result;
+            Enqueue(slot);
+            return;
+        }
+        request.pending = false;
+        --pending_count_;
+    }
+
+    /// @brief Handle all available completions
+    /// @return whether any completion was handled
+    bool Reap() {
+        unsigned head = *cq_head_;
+        unsigned const tail = std::atomic_ref<unsigned>{*cq_tail_}.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        for (; head != tail; ++head) {
+            io_uring_cqe const& cqe = cqes_[head & cq_mask_];
+            std::size_t const slot = cqe.user_data;
+            int const result = cqe.res;
+            // Entry is released before it is handled: handling may submit new reads
+            std::atomic_ref<unsigned>{*cq_head_}.store(head + 1, std::memory_order_release);
+            Complete(slot, result);
+        }
+        return true;
+    }
+
+    void WaitFor(auto&& is_done) {
+        while (!is_done()) {
+            if (Reap()) {
+                continue;
+            }
+            if (Enter(0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+                throw IOError(std::string("cannot wait for read: ") + std::strerror(errno));
+            }
+        }
+    }
+
+    void Release() noexcept {
+        if (sqes_ != MAP_FAILED) {
+            munmap(sqes_, sqes_size_);
+        }
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) {
+            munmap(cq_ring_, cq_ring_size_);
+        }
+        if (sq_ring_ != MAP_FAILED) {
+            munmap(sq_ring_, sq_ring_size_);
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+public:
+    /// @throw IOError if io_uring cannot be set up (old kernel, seccomp filters, limits)
+    IOUringBackend(File const& file, std::size_t depth)
+        : file_fd_(file.GetDescriptor()), requests_(depth) {
+        io_uring_params params{};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(depth), &params));
+        if (fd_ < 0) {
+            throw IOError(std::string("cannot set up io_uring: ") + std::strerror(errno));
+        }
+        if ((params.features & IORING_FEAT_RW_CUR_POS) == 0) {
+            // IORING_OP_READ appeared in the same kernel (5.6)
+            Release();
+            throw IOError("io_uring is too old");
+        }
+
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool const single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ != MAP_FAILED) {
+            cq_ring_ = single_mmap ? sq_ring_
+                                   : mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        }
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        if (cq_ring_ != MAP_FAILED) {
+            sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                                    MAP_SHARED | MAP_POPULATE, fd_,
+                                                    IORING_OFF_SQES));
+        }
+        if (sqes_ == MAP_FAILED) {
+            int const err = errno;
+            Release();
+            throw IOError(std::string("cannot map io_uring: ") + std::strerror(err));
+        }
+
+        sq_tail_ = RingField(sq_ring_, params.sq_off.tail);
+        sq_mask_ = *RingField(sq_ring_, params.sq_off.ring_mask);
+        sq_array_ = RingField(sq_ring_, params.sq_off.array);
+        cq_head_ = RingField(cq_ring_, params.cq_off.head);
+        cq_tail_ = RingField(cq_ring_, params.cq_off.tail);
+        cq_mask_ = *RingField(cq_ring_, params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(static_cast<char*>(cq_ring_) +
+                                                params.cq_off.cqes);
+    }
+
+    ~IOUringBackend() override {
+        // Kernel must not write into buffers after they are freed
+        try {
+            WaitFor([this] { return pending_count_ == 0; });
+        } catch (IOError const&) {
+            // Closing the ring cancels the rest
+        }
+        Release();
+    }
+
+    void Submit(std::size_t slot, Byte* buf, std::size_t size, std::uint64_t offset) override {
+        requests_[slot] = {.buf = buf, .size = size, .offset = offset, .pending = true};
+        ++pending_count_;
+        Enqueue(slot);
+    }
+
+    void Wait(std::size_t slot) override {
+        WaitFor([&] { return !requests_[slot].pending; });
+        if (int const error = std::exchange(requests_[slot].error, 0); error != 0) {
+            throw IOError(error == -ENODATA ? std::string("unexpected end of file")
+                                            : std::string("cannot read file: ") +
+                                                      std::strerror(-error));
+        }
+    }
+};
+}  // namespace
+
+ReadAheadQueue::ReadAheadQueue(File const& file, std::size_t depth, std::size_t buffer_size,
+                               bool use_io_uring)
+    : depth_(std::max<std::size_t>(depth, 1)),
+      buffer_size_(buffer_size),
+      buffers_(depth_ * buffer_size) {
+    if (use_io_uring) {
+        try {
+            backend_ = std::make_unique<IOUringBackend>(file, depth_);
+            uses_io_uring_ = true;
+        } catch (IOError const&) {
+            // Thread is used instead
+        }
+    }
+    if (!backend_) {
+        backend_ = std::make_unique<ThreadBackend>(file, depth_);
+    }
+}
+
+ReadAheadQueue::~ReadAheadQueue() {
+    // Backend waits for reads in flight, so it is destroyed before buffers
+    backend_.reset();
+}
+
+void ReadAheadQueue::Push(std::uint64_t offset, std::size_t size) {
+    std::size_t const slot = (first_ + in_flight_) % depth_;
+    backend_->Submit(slot, buffers_.data() + slot * buffer_size_, std::min(size, buffer_size_),
+                     offset);
+    ++in_flight_;
+}
+
+Byte const* ReadAheadQueue::Pop() {
+    std::size_t const slot = first_;
+    // Held buffer is released even if read fails
+    first_ = (first_ + 1) % depth_;
+    --in_flight_;
+    held_ = true;
+    backend_->Wait(slot);
+    return buffers_.data() + slot * buffer_size_;
+}
+}  // namespace bmp::util
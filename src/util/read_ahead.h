@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "util/field_types.h"
+#include "util/file.h"
+
+namespace bmp::util {
+/// @brief Ring of reusable buffers that are filled by reads running ahead of the consumer.
+/// Reads are started by @c Push and finished by @c Pop in the same order.
+/// Reads go through Linux io_uring where it is available, otherwise through background thread
+class ReadAheadQueue {
+public:
+    /// @brief Asynchronous positional reads into buffer slots
+    class Backend {
+    public:
+        virtual ~Backend() = default;
+
+        /// @brief Start reading exactly @p size bytes at @p offset into @p buf
+        virtual void Submit(std::size_t slot, Byte* buf, std::size_t size,
+                            std::uint64_t offset) = 0;
+
+        /// @brief Wait until read into @p slot is finished
+        /// @throw IOError if read has failed
+        virtual void Wait(std::size_t slot) = 0;
+    };
+
+private:
+    std::size_t depth_;
+    std::size_t buffer_size_;
+    std::vector<Byte> buffers_;
+    std::unique_ptr<Backend> backend_;
+    bool uses_io_uring_ = false;
+    // Slot of the oldest unfinished read
+    std::size_t first_ = 0;
+    std::size_t in_flight_ = 0;
+    // Slot before first_ is held by consumer until the next Pop
+    bool held_ = false;
+
+public:
+    /// @param depth -- number of buffers, i. e. reads in flight plus the buffer being consumed
+    /// @param buffer_size -- size of every buffer (bytes)
+    /// @param use_io_uring -- try io_uring first, background thread is used if it is unavailable
+    ReadAheadQueue(File const& file, std::size_t depth, std::size_t buffer_size,
+                   bool use_io_uring = true);
+    /// @brief Waits for reads in flight, their errors are ignored
+    ~ReadAheadQueue();
+
+    ReadAheadQueue(ReadAheadQueue const&) = delete;
+    ReadAheadQueue& operator=(ReadAheadQueue const&) = delete;
+
+    bool UsesIOUring() const {
+        return uses_io_uring_;
+    }
+
+    /// @brief Whether there is a free buffer for @c Push
+    bool CanPush() const {
+        return in_flight_ + held_ < depth_;
+    }
+
+    bool Empty() const {
+        return in_flight_ == 0;
+    }
+
+    /// @brief Start reading @p size bytes (at most buffer size) at @p offset into a free buffer
+    void Push(std::uint64_t offset, std::size_t size);
+
+    /// @brief Wait for the oldest read.
+    /// Returned buffer stays valid until the next @c Pop, so next reads may be pushed meanwhile
+    /// @throw IOError if read has failed
+    Byte const* Pop();
+};
+}  // namespace bmp::util
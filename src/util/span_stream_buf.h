@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <ios>
+#include <streambuf>
+
+#include "util/field_types.h"
+
+namespace bmp::util {
+/// @brief Read-only stream buffer over memory range that is owned by someone else.
+/// Allows to use @c operator>> on headers without copying data
+class SpanStreamBuf : public std::streambuf {
+public:
+    SpanStreamBuf() = default;
+
+    SpanStreamBuf(Byte const* data, std::size_t size) {
+        Reset(data, size);
+    }
+
+    void Reset(Byte const* data, std::size_t size) {
+        // Get area is never written through, so casting const away is safe
+        auto* begin = reinterpret_cast<char*>(const_cast<Byte*>(data));
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which = std::ios_base::in) override {
+        if (!(which & std::ios_base::in)) {
+            return pos_type(off_type(-1));
+        }
+        off_type base = 0;
+        if (dir == std::ios_base::cur) {
+            base = gptr() - eback();
+        } else if (dir == std::ios_base::end) {
+            base = egptr() - eback();
+        }
+        off_type const pos = base + off;
+        if (pos < 0 || pos > egptr() - eback()) {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), eback() + pos, egptr());
+        return pos_type(pos);
+    }
+
+    pos_type seekpos(pos_type pos,
+                     std::ios_base::openmode which = std::ios_base::in) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+}  // namespace bmp::util
@@ -0,0 +1,100 @@
+#include "util/thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace bmp::util {
+
+ThreadPool::ThreadPool(std::size_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers_.reserve(thread_count - 1);
+    for (std::size_t i = 1; i < thread_count; ++i) {
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock{mutex_};
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::WorkerLoop() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock lock{mutex_};
+            cv_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::ParallelFor(std::size_t count, std::size_t chunk_size,
+                             std::function<void(std::size_t, std::size_t)> const& fn) {
+    chunk_size = std::max<std::size_t>(chunk_size, 1);
+    std::size_t const chunk_count = (count + chunk_size - 1) / chunk_size;
+    if (chunk_count == 0) {
+        return;
+    }
+
+    std::atomic<std::size_t> next_chunk = 0;
+    std::exception_ptr error;
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    std::size_t running = 0;
+
+    auto run_chunks = [&] {
+        for (auto chunk = next_chunk++; chunk < chunk_count; chunk = next_chunk++) {
+            auto const begin = chunk * chunk_size;
+            try {
+                fn(begin, std::min(begin + chunk_size, count));
+            } catch (...) {
+                std::lock_guard lock{done_mutex};
+                if (!error) {
+                    error = std::current_exception();
+                }
+                next_chunk = chunk_count;
+            }
+        }
+    };
+
+    std::size_t const helpers = std::min(workers_.size(), chunk_count - 1);
+    if (helpers > 0) {
+        running = helpers;
+        {
+            std::lock_guard lock{mutex_};
+            for (std::size_t i = 0; i < helpers; ++i) {
+                tasks_.emplace_back([&] {
+                    run_chunks();
+                    std::lock_guard done_lock{done_mutex};
+                    if (--running == 0) {
+                        done_cv.notify_one();
+                    }
+                });
+            }
+        }
+        cv_.notify_all();
+    }
+
+    run_chunks();
+    std::unique_lock lock{done_mutex};
+    done_cv.wait(lock, [&] { return running == 0; });
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+}  // namespace bmp::util
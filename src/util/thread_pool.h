@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bmp::util {
+/// @brief Fixed set of worker threads
+class ThreadPool {
+private:
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> tasks_;
+    bool stop_ = false;
+
+    void WorkerLoop();
+
+public:
+    /// @param thread_count -- number of threads that execute tasks, including the caller of
+    /// @c ParallelFor. 0 means hardware concurrency
+    explicit ThreadPool(std::size_t thread_count);
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    /// @brief Number of threads, including the caller
+    std::size_t GetThreadCount() const {
+        return workers_.size() + 1;
+    }
+
+    /// @brief Call @p fn(begin, end) for chunks of <tt>[0, count)</tt> of size @p chunk_size
+    /// (the last one may be shorter). Chunks are handed out dynamically, the calling thread
+    /// takes part in the work. Blocks until all chunks are done.
+    /// If @p fn throws, remaining chunks are skipped and the first exception is rethrown
+    void ParallelFor(std::size_t count, std::size_t chunk_size,
+                     std::function<void(std::size_t, std::size_t)> const& fn);
+};
+}  // namespace bmp::util
@@ -0,0 +1,219 @@
+#include "util/threshold_kernel.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BMP_X86_KERNELS
+#endif
+
+namespace bmp::util {
+namespace {
+using BitWord = std::uint64_t;
+constexpr std::size_t kBitsPerWord = 64;
+
+/// @brief Threshold @p count (< 64) pixels, one by one
+template <std::size_t kBytes>
+BitWord ScalarBits(Byte const* px, std::size_t count, unsigned max_black_sum) {
+    BitWord bits = 0;
+    for (std::size_t i = 0; i < count; ++i, px += kBytes) {
+        bits |= BitWord{unsigned{px[0]} + px[1] + px[2] <= max_black_sum} << i;
+    }
+    return bits;
+}
+
+template <std::size_t kBytes>
+void ThresholdScalar(Byte const* scan, std::size_t width, unsigned max_black_sum, BitWord* out) {
+    for (std::size_t x = 0; x < width; x += kBitsPerWord, ++out) {
+        *out = ScalarBits<kBytes>(scan + x * kBytes, std::min(kBitsPerWord, width - x),
+                                  max_black_sum);
+    }
+}
+
+#ifdef BMP_X86_KERNELS
+// Vector loads of 3-byte pixels read up to 4 bytes past the last pixel of a block.
+// Number of pixels that can be processed by vector blocks without reading past the scan:
+template <std::size_t kBytes>
+std::size_t VectorWidth(std::size_t width) {
+    if constexpr (kBytes == 3) {
+        return width > 2 ? width - 2 : 0;
+    } else {
+        return width;
+    }
+}
+
+// Every Block*() function thresholds kLanes pixels and returns mask with bit i set when pixel i
+// is black. 3-byte pixels are first expanded to 4-byte lanes: BGR -> BGR0.
+
+inline DWord Load32(Byte const* px) {
+    DWord raw;
+    std::memcpy(&raw, px, sizeof(raw));
+    return raw;
+}
+
+template <std::size_t kBytes>
+__attribute__((target("sse2"))) inline unsigned BlockSSE2(Byte const* px, __m128i max) {
+    __m128i v;
+    if constexpr (kBytes == 3) {
+        v = _mm_setr_epi32(Load32(px), Load32(px + 3), Load32(px + 6), Load32(px + 9));
+    } else {
+        v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(px));
+    }
+    __m128i const byte_mask = _mm_set1_epi32(0xFF);
+    __m128i sum = _mm_and_si128(v, byte_mask);
+    sum = _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(v, 8), byte_mask));
+    sum = _mm_add_epi32(sum, _mm_and_si128(_mm_srli_epi32(v, 16), byte_mask));
+    __m128i const white = _mm_cmpgt_epi32(sum, max);
+    return ~_mm_movemask_ps(_mm_castsi128_ps(white)) & 0xF;
+}
+
+template <std::size_t kBytes>
+__attribute__((target("avx2"))) inline unsigned BlockAVX2(Byte const* px, __m256i max) {
+    __m256i v;
+    if constexpr (kBytes == 3) {
+        __m128i const lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(px));
+        __m128i const hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(px + 12));
+        v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        __m256i const expand = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                                -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10,
+                                                11, -1);
+        v = _mm256_shuffle_epi8(v, expand);
+    } else {
+        v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(px));
+    }
+    __m256i const byte_mask = _mm256_set1_epi32(0xFF);
+    __m256i sum = _mm256_and_si256(v, byte_mask);
+    sum = _mm256_add_epi32(sum, _mm256_and_si256(_mm256_srli_epi32(v, 8), byte_mask));
+    sum = _mm256_add_epi32(sum, _mm256_and_si256(_mm256_srli_epi32(v, 16), byte_mask));
+    __m256i const white = _mm256_cmpgt_epi32(sum, max);
+    return ~_mm256_movemask_ps(_mm256_castsi256_ps(white)) & 0xFF;
+}
+
+template <std::size_t kBytes>
+__attribute__((target("avx512f,avx512bw"))) inline unsigned BlockAVX512(Byte const* px,
+                                                                      __m512i max) {
+    __m512i v;
+    if constexpr (kBytes == 3) {
+        v = _mm512_castsi128_si512(_mm_loadu_si128(reinterpret_cast<__m128i const*>(px)));
+        v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<__m128i const*>(px + 12)), 1);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<__m128i const*>(px + 24)), 2);
+        v = _mm512_inserti32x4(v, _mm_loadu_si128(reinterpret_cast<__m128i const*>(px + 36)), 3);
+        __m512i const expand = _mm512_broadcast_i32x4(
+                _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+        v = _mm512_shuffle_epi8(v, expand);
+    } else {
+        v = _mm512_loadu_si512(px);
+    }
+    __m512i const byte_mask = _mm512_set1_epi32(0xFF);
+    __m512i sum = _mm512_and_si512(v, byte_mask);
+    sum = _mm512_add_epi32(sum, _mm512_and_si512(_mm512_srli_epi32(v, 8), byte_mask));
+    sum = _mm512_add_epi32(sum, _mm512_and_si512(_mm512_srli_epi32(v, 16), byte_mask));
+    return _mm512_cmple_epu32_mask(sum, max);
+}
+
+// Threshold drivers are spelled out per instruction set, so that blocks are inlined
+
+template <std::size_t kBytes>
+__attribute__((target("sse2"))) void ThresholdSSE2(Byte const* scan, std::size_t width,
+                                                   unsigned max_black_sum, BitWord* out) {
+    constexpr std::size_t kLanes = 4;
+    __m128i const max = _mm_set1_epi32(static_cast<int>(max_black_sum));
+    std::size_t const vector_width = VectorWidth<kBytes>(width);
+    for (std::size_t x = 0; x < width; x += kBitsPerWord, ++out) {
+        std::size_t const count = std::min(kBitsPerWord, width - x);
+        BitWord bits = 0;
+        std::size_t i = 0;
+        for (; i + kLanes <= count && x + i + kLanes <= vector_width; i += kLanes) {
+            bits |= BitWord{BlockSSE2<kBytes>(scan + (x + i) * kBytes, max)} << i;
+        }
+        if (i < count) {
+            bits |= ScalarBits<kBytes>(scan + (x + i) * kBytes, count - i, max_black_sum) << i;
+        }
+        *out = bits;
+    }
+}
+
+template <std::size_t kBytes>
+__attribute__((target("avx2"))) void ThresholdAVX2(Byte const* scan, std::size_t width,
+                                                   unsigned max_black_sum, BitWord* out) {
+    constexpr std::size_t kLanes = 8;
+    __m256i const max = _mm256_set1_epi32(static_cast<int>(max_black_sum));
+    std::size_t const vector_width = VectorWidth<kBytes>(width);
+    for (std::size_t x = 0; x < width; x += kBitsPerWord, ++out) {
+        std::size_t const count = std::min(kBitsPerWord, width - x);
+        BitWord bits = 0;
+        std::size_t i = 0;
+        for (; i + kLanes <= count && x + i + kLanes <= vector_width; i += kLanes) {
+            bits |= BitWord{BlockAVX2<kBytes>(scan + (x + i) * kBytes, max)} << i;
+        }
+        if (i < count) {
+            bits |= ScalarBits<kBytes>(scan + (x + i) * kBytes, count - i, max_black_sum) << i;
+        }
+        *out = bits;
+    }
+}
+
+template <std::size_t kBytes>
+__attribute__((target("avx512f,avx512bw"))) void ThresholdAVX512(Byte const* scan,
+                                                                 std::size_t width,
+                                                                 unsigned max_black_sum,
+                                                                 BitWord* out) {
+    constexpr std::size_t kLanes = 16;
+    __m512i const max = _mm512_set1_epi32(static_cast<int>(max_black_sum));
+    std::size_t const vector_width = VectorWidth<kBytes>(width);
+    for (std::size_t x = 0; x < width; x += kBitsPerWord, ++out) {
+        std::size_t const count = std::min(kBitsPerWord, width - x);
+        BitWord bits = 0;
+        std::size_t i = 0;
+        for (; i + kLanes <= count && x + i + kLanes <= vector_width; i += kLanes) {
+            bits |= BitWord{BlockAVX512<kBytes>(scan + (x + i) * kBytes, max)} << i;
+        }
+        if (i < count) {
+            bits |= ScalarBits<kBytes>(scan + (x + i) * kBytes, count - i, max_black_sum) << i;
+        }
+        *out = bits;
+    }
+}
+#endif
+
+template <std::size_t kBytes>
+ThresholdKernel SelectKernel(SimdLevel level) {
+    switch (level) {
+#ifdef BMP_X86_KERNELS
+        case SimdLevel::kAVX512:
+            return ThresholdAVX512<kBytes>;
+        case SimdLevel::kAVX2:
+            return ThresholdAVX2<kBytes>;
+        case SimdLevel::kSSE2:
+            return ThresholdSSE2<kBytes>;
+#endif
+        default:
+            return ThresholdScalar<kBytes>;
+    }
+}
+}  // namespace
+
+SimdLevel DetectSimdLevel() {
+    static SimdLevel const level = [] {
+#ifdef BMP_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+            return SimdLevel::kAVX512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::kAVX2;
+        }
+        if (__builtin_cpu_supports("sse2")) {
+            return SimdLevel::kSSE2;
+        }
+#endif
+        return SimdLevel::kScalar;
+    }();
+    return level;
+}
+
+ThresholdKernel GetThresholdKernel(Word byte_count, SimdLevel level) {
+    return byte_count == 3 ? SelectKernel<3>(level) : SelectKernel<4>(level);
+}
+}  // namespace bmp::util
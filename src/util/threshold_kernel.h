@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "util/field_types.h"
+
+// Kernels that turn BGR (24-bit) and BGRX (32-bit) scans into black-and-white bits.
+// Pixel is black when red + green + blue <= max_black_sum.
+// Output is packed the same way as in BinaryImage: pixel x is bit (x % 64) of word (x / 64).
+
+namespace bmp::util {
+/// @brief Instruction set used by kernel
+enum class SimdLevel { kScalar, kSSE2, kAVX2, kAVX512 };
+
+/// @brief Threshold @p width pixels of @p scan and write <tt>ceil(width / 64)</tt> words to @p out.
+/// Bits past @p width are cleared
+using ThresholdKernel = void (*)(Byte const* scan, std::size_t width, unsigned max_black_sum,
+                                 std::uint64_t* out);
+
+/// @brief Best instruction set supported by this CPU (detected once)
+SimdLevel DetectSimdLevel();
+
+/// @brief Get kernel for 3 or 4 bytes per pixel.
+/// @param level -- must not be greater than @c DetectSimdLevel()
+ThresholdKernel GetThresholdKernel(Word byte_count, SimdLevel level = DetectSimdLevel());
+}  // namespace bmp::util
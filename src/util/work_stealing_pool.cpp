@@ -0,0 +1,102 @@
+#include "util/work_stealing_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace bmp::util {
+
+namespace {
+struct TaskQueue {
+    std::mutex mutex;
+    std::deque<std::size_t> tasks;
+
+    std::optional<std::size_t> PopFront() {
+        std::lock_guard lock{mutex};
+        if (tasks.empty()) {
+            return std::nullopt;
+        }
+        std::size_t const task = tasks.front();
+        tasks.pop_front();
+        return task;
+    }
+
+    std::optional<std::size_t> PopBack() {
+        std::lock_guard lock{mutex};
+        if (tasks.empty()) {
+            return std::nullopt;
+        }
+        std::size_t const task = tasks.back();
+        tasks.pop_back();
+        return task;
+    }
+};
+}  // namespace
+
+WorkStealingPool::WorkStealingPool(std::size_t thread_count) : thread_count_(thread_count) {
+    if (thread_count_ == 0) {
+        thread_count_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+}
+
+void WorkStealingPool::Run(std::span<std::size_t const> tasks,
+                           FunctionRef<void(std::size_t, std::size_t)> fn) const {
+    std::size_t const thread_count = std::max<std::size_t>(
+            std::min(thread_count_, tasks.size()), 1);
+    // Tasks are pushed once and never added, so an empty queue stays empty
+    std::vector<TaskQueue> queues(thread_count);
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        queues[i % thread_count].tasks.push_back(tasks[i]);
+    }
+
+    std::atomic<bool> stop = false;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto run_tasks = [&](std::size_t thread) {
+        auto next_task = [&]() -> std::optional<std::size_t> {
+            if (auto task = queues[thread].PopFront()) {
+                return task;
+            }
+            for (std::size_t i = 1; i < thread_count; ++i) {
+                if (auto task = queues[(thread + i) % thread_count].PopBack()) {
+                    return task;
+                }
+            }
+            return std::nullopt;
+        };
+        while (!stop.load(std::memory_order_relaxed)) {
+            auto const task = next_task();
+            if (!task) {
+                return;
+            }
+            try {
+                fn(*task, thread);
+            } catch (...) {
+                std::lock_guard lock{error_mutex};
+                if (!error) {
+                    error = std::current_exception();
+                }
+                stop = true;
+            }
+        }
+    };
+
+    {
+        std::vector<std::jthread> helpers;
+        helpers.reserve(thread_count - 1);
+        for (std::size_t thread = 1; thread < thread_count; ++thread) {
+            helpers.emplace_back(run_tasks, thread);
+        }
+        run_tasks(0);
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+}  // namespace bmp::util
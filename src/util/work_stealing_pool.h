@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+
+#include "util/function_ref.h"
+
+namespace bmp::util {
+/// @brief Runs independent tasks of very different cost (e. g. one image per task) on a set of
+/// threads. Every thread has its own queue and takes tasks from its front; a thread whose queue
+/// is empty steals from the back of another queue, so threads stay busy until all tasks are done
+class WorkStealingPool {
+private:
+    std::size_t thread_count_;
+
+public:
+    /// @param thread_count -- number of threads, including the caller of @c Run. 0 means
+    /// hardware concurrency
+    explicit WorkStealingPool(std::size_t thread_count);
+
+    std::size_t GetThreadCount() const {
+        return thread_count_;
+    }
+
+    /// @brief Call @p fn(task, thread) for every task of @p tasks. Tasks are dealt round-robin,
+    /// so put the most expensive ones first. @c thread is in <tt>[0, GetThreadCount())</tt>, a
+    /// thread runs one task at a time, so per-thread state may be indexed by it.
+    /// Threads are started for the call, the calling thread takes part in the work.
+    /// If @p fn throws, remaining tasks are skipped and the first exception is rethrown
+    void Run(std::span<std::size_t const> tasks,
+             FunctionRef<void(std::size_t, std::size_t)> fn) const;
+};
+}  // namespace bmp::util
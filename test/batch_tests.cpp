@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "batch.h"
+#include "bmp_reader.h"
+#include "test_util.h"
+#include "util/manifest_error.h"
+#include "util/work_stealing_pool.h"
+
+using namespace bmp;
+
+namespace test {
+void ExpectJob(BatchJob const& job, std::string const& input, DWord x1, DWord y1, DWord x2,
+               DWord y2, std::string const& output) {
+    EXPECT_EQ(job.input, input);
+    EXPECT_EQ(job.x1, x1);
+    EXPECT_EQ(job.y1, y1);
+    EXPECT_EQ(job.x2, x2);
+    EXPECT_EQ(job.y2, y2);
+    EXPECT_EQ(job.output, output);
+}
+
+TEST(BatchTests, ParsesManifest) {
+    std::istringstream is{
+            "input,x1,y1,x2,y2,output\n"
+            "# comment\n"
+            "a.bmp, 1, 2, 3, 4, b.bmp\n"
+            "\n"
+            "\"dir, with comma/\"\"c\"\".bmp\",0,0,10,10,d.bmp\n"
+            "  {\"input\": \"e.bmp\", \"cross\": [5, 6, 7, 8], \"output\": \"f\\\\g.bmp\"}\n"
+            "{\"output\": \"i.bmp\", \"y2\": 4, \"x2\": 3, \"y1\": 2, \"x1\": 1, "
+            "\"input\": \"h.bmp\"}\n"};
+    std::vector<BatchJob> const jobs = ParseManifest(is);
+    ASSERT_EQ(jobs.size(), 4);
+    ExpectJob(jobs[0], "a.bmp", 1, 2, 3, 4, "b.bmp");
+    ExpectJob(jobs[1], "dir, with comma/\"c\".bmp", 0, 0, 10, 10, "d.bmp");
+    ExpectJob(jobs[2], "e.bmp", 5, 6, 7, 8, "f\\g.bmp");
+    ExpectJob(jobs[3], "h.bmp", 1, 2, 3, 4, "i.bmp");
+}
+
+TEST(BatchTests, ParsesJobOptions) {
+    BatchJob const job = ParseJob(
+            "{\"input\": \"a.bmp\", \"cross\": [1, 2, 3, 4], \"output\": \"b.bmp\", "
+            "\"input_mode\": \"mapped\", \"threshold\": \"adaptive\", "
+            "\"save_mode\": \"incremental\"}");
+    ExpectJob(job, "a.bmp", 1, 2, 3, 4, "b.bmp");
+    EXPECT_EQ(job.input_mode, InputMode::kMapped);
+    EXPECT_EQ(job.threshold, ThresholdMode::kAdaptive);
+    EXPECT_EQ(job.save_mode, SaveMode::kIncremental);
+    EXPECT_FALSE(ParseJob("a.bmp,1,2,3,4,b.bmp").threshold.has_value());
+    EXPECT_THROW(ParseJob("{\"input\": \"a.bmp\", \"cross\": [1, 2, 3, 4], "
+                          "\"output\": \"b.bmp\", \"threshold\": \"magic\"}"),
+                 ManifestError);
+}
+
+TEST(BatchTests, RejectsInvalidManifest) {
+    for (std::string const manifest : {
+                 "a.bmp,1,2,3,b.bmp",
+                 "a.bmp,1,2,3,-4,b.bmp",
+                 "a.bmp,1,2,3,4x,b.bmp",
+                 "\"a.bmp,1,2,3,4,b.bmp",
+                 "{\"input\": \"a.bmp\", \"cross\": [1, 2, 3], \"output\": \"b.bmp\"}",
+                 "{\"input\": \"a.bmp\", \"cross\": [1, 2, 3, 4]}",
+                 "{\"input\": \"a.bmp\", \"cross\": [1, 2, 3, 4], \"output\": \"b.bmp\"} x",
+                 "{\"input\": \"a.bmp\", \"x1\": 1, \"x1\": 1, \"y1\": 2, \"x2\": 3, \"y2\": 4, "
+                 "\"output\": \"b.bmp\"}",
+                 "{\"in\": \"a.bmp\"}",
+         }) {
+        std::istringstream is{"a.bmp,1,2,3,4,b.bmp\n" + manifest};
+        EXPECT_THROW(ParseManifest(is), ManifestError) << manifest;
+    }
+}
+
+TEST(BatchTests, PoolRunsEveryTaskOnce) {
+    std::vector<std::size_t> tasks(1000);
+    for (std::size_t i = 0; i < tasks.size(); ++i) {
+        tasks[i] = i;
+    }
+    util::WorkStealingPool const pool{4};
+    std::vector<std::atomic<int>> runs(tasks.size());
+    std::atomic<std::size_t> done = 0;
+    std::atomic<bool> first = true;
+    std::atomic<std::size_t> slow_thread = 0;
+    std::vector<std::atomic<int>> thread_tasks(pool.GetThreadCount());
+    pool.Run(tasks, [&](std::size_t task, std::size_t thread) {
+        ASSERT_LT(thread, pool.GetThreadCount());
+        ++runs[task];
+        ++thread_tasks[thread];
+        // The first task to start is the slowest: other threads must steal the rest of its queue
+        if (first.exchange(false)) {
+            slow_thread = thread;
+            while (done != tasks.size() - 1) {
+                std::this_thread::yield();
+            }
+        }
+        ++done;
+    });
+    EXPECT_TRUE(std::all_of(runs.begin(), runs.end(), [](auto const& r) { return r == 1; }));
+    EXPECT_EQ(thread_tasks[slow_thread], 1);
+}
+
+TEST(BatchTests, PoolRethrows) {
+    std::vector<std::size_t> const tasks{0, 1, 2, 3, 4, 5, 6, 7};
+    util::WorkStealingPool const pool{3};
+    EXPECT_THROW(pool.Run(tasks,
+                          [](std::size_t task, std::size_t) {
+                              if (task == 5) {
+                                  throw std::runtime_error("task failed");
+                              }
+                          }),
+                 std::runtime_error);
+}
+
+class BatchTest : public testing::TestWithParam<std::size_t> {};
+
+TEST_P(BatchTest, MatchesSingleReader) {
+    std::vector<BatchJob> jobs;
+    for (unsigned i = 0; i < 12; ++i) {
+        std::string const input = "test_batch_input_" + std::to_string(i) + ".bmp";
+        // Sizes differ a lot, as in real batches
+        DWord const size = i % 4 == 0 ? 600 : 20 + i;
+        WriteRandomBMP(input, size, i % 2 == 0 ? size : -Long(size), i % 3 == 0 ? 8 : 24, i);
+        jobs.push_back({input, i, 0, size - 1, size - 1 - i,
+                        "test_batch_output_" + std::to_string(i) + ".bmp"});
+    }
+    jobs.push_back({"test_batch_missing.bmp", 0, 0, 1, 1, "test_batch_missing_output.bmp"});
+
+    std::vector<JobResult> results(jobs.size());
+    std::vector<int> calls(jobs.size());
+    BatchSummary const summary = RunBatch(
+            jobs, {.thread_count = GetParam()}, [&](std::size_t job_num, JobResult const& result) {
+                ++calls[job_num];
+                results[job_num] = result;
+            });
+
+    EXPECT_EQ(summary.jobs, jobs.size());
+    EXPECT_EQ(summary.failed, 1);
+    EXPECT_FALSE(results.back().error.empty());
+    std::uint64_t pixels = 0;
+    for (std::size_t i = 0; i + 1 < jobs.size(); ++i) {
+        EXPECT_EQ(calls[i], 1);
+        EXPECT_TRUE(results[i].error.empty()) << results[i].error;
+        EXPECT_LT(results[i].thread, std::max<std::size_t>(GetParam(), 1));
+        pixels += results[i].pixels;
+
+        BMPReader expected{jobs[i].input};
+        expected.ReadHeaders();
+        expected.ReadData();
+        expected.DrawCross(jobs[i].x1, jobs[i].y1, jobs[i].x2, jobs[i].y2);
+        BMPReader saved{jobs[i].output};
+        saved.ReadHeaders();
+        saved.ReadData();
+        EXPECT_EQ(saved.GetPixelData(), expected.GetPixelData()) << jobs[i].input;
+        std::remove(jobs[i].input.c_str());
+        std::remove(jobs[i].output.c_str());
+    }
+    EXPECT_EQ(summary.pixels, pixels);
+    std::ostringstream os;
+    PrintBatchSummary(os, summary);
+    EXPECT_EQ(os.str().rfind("13 jobs, 1 failed", 0), 0) << os.str();
+
+    // Process-wide figures are measured once for the batch, not summed over concurrent jobs
+    if constexpr (kStatsEnabled) {
+        EXPECT_EQ(summary.batch_stats.calls, 1);
+        EXPECT_EQ(summary.stats[Phase::kReadData].calls, jobs.size() - 1);
+        EXPECT_EQ(summary.stats[Phase::kReadData].cpu_ns, 0);
+    }
+    std::ostringstream json;
+    PrintBatchStats(json, summary, true);
+    EXPECT_EQ(json.str().find('\n'), json.str().size() - 1) << json.str();
+    EXPECT_NE(json.str().find(", \"batch\": {\"wall_ns\": "), std::string::npos) << json.str();
+}
+
+INSTANTIATE_TEST_SUITE_P(BatchTests, BatchTest, testing::Values(1, 4));
+}  // namespace test
@@ -0,0 +1,76 @@
+#include <cstdint>
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "binary_image.h"
+
+namespace test {
+using bmp::BinaryImage;
+
+TEST(BinaryImageTests, Layout) {
+    BinaryImage image{130, 3};
+    EXPECT_EQ(image.GetWidth(), 130);
+    EXPECT_EQ(image.GetHeight(), 3);
+    EXPECT_EQ(image.GetStride(), 3);
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(image.GetRow(0)) % BinaryImage::kAlignment, 0);
+
+    image.Set(0, 0);
+    image.Set(64, 1);
+    image.Set(129, 2);
+    EXPECT_EQ(image.GetRow(0)[0], 1);
+    EXPECT_EQ(image.GetRow(1)[1], 1);
+    EXPECT_EQ(image.GetRow(2)[2], BinaryImage::BitWord{1} << 1);
+    EXPECT_TRUE(image.Get(129, 2));
+    EXPECT_FALSE(image.Get(128, 2));
+
+    image.Set(64, 1, false);
+    EXPECT_EQ(image.GetRow(1)[1], 0);
+}
+
+TEST(BinaryImageTests, BoolMatrixAdapter) {
+    BinaryImage image{3, 2};
+    image.Set(1, 0);
+    image.Set(2, 1);
+
+    std::vector<std::vector<bool>> const expected{{false, true, false}, {false, false, true}};
+    EXPECT_EQ(image.ToBoolMatrix(), expected);
+
+    std::vector<std::vector<bool>> iterated;
+    for (auto const& scan : image) {
+        iterated.emplace_back(scan.begin(), scan.end());
+    }
+    EXPECT_EQ(iterated, expected);
+}
+
+TEST(BinaryImageTests, Copy) {
+    BinaryImage image{70, 2};
+    image.Set(69, 1);
+    BinaryImage copy = image;
+    EXPECT_EQ(copy, image);
+    copy.Set(0, 0);
+    EXPECT_FALSE(copy == image);
+}
+
+TEST(BinaryImageTests, Region) {
+    BinaryImage image{200, 5};
+    for (std::size_t y = 0; y < 5; ++y) {
+        for (std::size_t x = 0; x < 200; ++x) {
+            image.Set(x, y, (x * 7 + y * 3) % 5 < 2);
+        }
+    }
+    for (std::size_t x : {0, 1, 63, 64, 100}) {
+        for (std::size_t width : {0, 1, 63, 64, 65, 99}) {
+            BinaryImage const region = image.GetRegion(x, 1, width, 3);
+            ASSERT_EQ(region.GetWidth(), width);
+            ASSERT_EQ(region.GetHeight(), 3);
+            BinaryImage expected{width, 3};
+            for (std::size_t y = 0; y < 3; ++y) {
+                for (std::size_t i = 0; i < width; ++i) {
+                    expected.Set(i, y, image.Get(x + i, y + 1));
+                }
+            }
+            EXPECT_EQ(region, expected) << "x " << x << ", width " << width;
+        }
+    }
+}
+}  // namespace test
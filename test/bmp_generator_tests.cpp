@@ -0,0 +1,291 @@
+#include <cstdio>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "binary_image.h"
+#include "bmp_generator.h"
+#include "bmp_reader.h"
+#include "util/color.h"
+#include "util/invalid_bmp_error.h"
+#include "util/ms_constants.h"
+
+using namespace bmp;
+
+namespace test {
+// Same threshold as reader uses
+constexpr static unsigned kMaxBlackSum = 122 * 3;
+
+struct GeneratorParams {
+    GeneratorOptions options;
+    Word expected_padding;
+};
+
+class GeneratorTest : public testing::TestWithParam<GeneratorParams> {};
+
+/// @brief Channel of @p pixel scaled to 0..255
+Byte GetChannel(DWord pixel, DWord mask) {
+    DWord const low = mask & -mask;
+    std::uint64_t const max = mask / low;
+    return static_cast<Byte>(((pixel & mask) / low * 255 + max / 2) / max);
+}
+
+/// @brief Threshold uncompressed rows of @p generator
+BinaryImage GetExpectedImage(BMPGenerator const& generator, GeneratorOptions const& options) {
+    BinaryImage image{options.width, options.height};
+    std::vector<Byte> scan(generator.GetFullScanSize());
+    for (std::size_t y = 0; y < options.height; ++y) {
+        generator.FillRow(y, scan.data());
+        for (std::size_t x = 0; x < options.width; ++x) {
+            util::RGBColor color;
+            if (options.bit_count <= 8) {
+                std::size_t const pixels_per_byte = 8 / options.bit_count;
+                std::size_t const shift = 8 - options.bit_count * (x % pixels_per_byte + 1);
+                std::size_t const index =
+                        (scan[x / pixels_per_byte] >> shift) & ((1 << options.bit_count) - 1);
+                color = generator.GetPalette()[index];
+            } else if (options.bit_count == 24) {
+                Byte const* pixel = scan.data() + x * 3;
+                color = {pixel[0], pixel[1], pixel[2]};
+            } else {
+                DWord pixel = 0;
+                std::memcpy(&pixel, scan.data() + x * options.bit_count / 8,
+                            options.bit_count / 8);
+                auto const& masks = generator.GetMasks();
+                color = {GetChannel(pixel, masks.blue), GetChannel(pixel, masks.green),
+                         GetChannel(pixel, masks.red)};
+            }
+            image.Set(x, y, unsigned{color.red} + color.green + color.blue <= kMaxBlackSum);
+        }
+    }
+    return image;
+}
+
+TEST_P(GeneratorTest, ReaderAcceptsOutput) {
+    auto const& param = GetParam();
+    std::string const filename = "test_generator_output.bmp";
+    BMPGenerator const generator{param.options};
+    generator.Write(filename);
+
+    BMPReader reader{filename};
+    reader.ReadHeaders();
+    auto const& fields = reader.GetImportantFields();
+    EXPECT_EQ(fields.offset, generator.GetHeaders().size());
+    EXPECT_EQ(fields.width, param.options.width);
+    EXPECT_EQ(fields.height, param.options.height);
+    EXPECT_EQ(fields.bottom_up, param.options.bottom_up);
+    EXPECT_EQ(fields.byte_count, param.options.bit_count / 8);
+    EXPECT_EQ(fields.padding_bytes, param.expected_padding);
+    EXPECT_EQ(fields.GetFullScanSize(), generator.GetFullScanSize());
+    if (param.options.bit_count == 16 || param.options.bit_count == 32) {
+        EXPECT_EQ(fields.red_mask, generator.GetMasks().red);
+        EXPECT_EQ(fields.green_mask, generator.GetMasks().green);
+        EXPECT_EQ(fields.blue_mask, generator.GetMasks().blue);
+    }
+
+    reader.ReadData();
+    EXPECT_EQ(reader.GetPixelData(), GetExpectedImage(generator, param.options));
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        GeneratorTests, GeneratorTest,
+        testing::Values(
+                // Every padding value
+                GeneratorParams{{.width = 12, .height = 5}, 0},
+                GeneratorParams{{.width = 13, .height = 5, .pattern = Pattern::kGlyphs}, 1},
+                GeneratorParams{{.width = 14, .height = 5, .pattern = Pattern::kGradient}, 2},
+                GeneratorParams{{.width = 15, .height = 5, .bottom_up = false}, 3},
+                // Header versions
+                GeneratorParams{{.width = 31,
+                                 .height = 17,
+                                 .header_version = HeaderVersion::kCore,
+                                 .pattern = Pattern::kGlyphs},
+                                3},
+                GeneratorParams{{.width = 31,
+                                 .height = 17,
+                                 .bit_count = 32,
+                                 .header_version = HeaderVersion::kV4,
+                                 .pattern = Pattern::kGradient},
+                                0},
+                GeneratorParams{{.width = 31,
+                                 .height = 17,
+                                 .bottom_up = false,
+                                 .header_version = HeaderVersion::kV5,
+                                 .seed = 3},
+                                3},
+                // Bit masks after V3 header and inside V5 header
+                GeneratorParams{{.width = 40,
+                                 .height = 9,
+                                 .bit_count = 32,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .pattern = Pattern::kGlyphs},
+                                0},
+                GeneratorParams{{.width = 40,
+                                 .height = 9,
+                                 .bit_count = 32,
+                                 .bottom_up = false,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .header_version = HeaderVersion::kV5},
+                                0},
+                // 16-bit: implicit RGB555 and BITFIELDS layouts
+                GeneratorParams{{.width = 21,
+                                 .height = 9,
+                                 .bit_count = 16,
+                                 .pattern = Pattern::kGradient},
+                                2},
+                GeneratorParams{{.width = 64,
+                                 .height = 9,
+                                 .bit_count = 16,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .pattern = Pattern::kGradient},
+                                0},
+                GeneratorParams{{.width = 65,
+                                 .height = 9,
+                                 .bit_count = 16,
+                                 .bottom_up = false,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .masks = {0x001F, 0x07E0, 0xF800},
+                                 .header_version = HeaderVersion::kV4,
+                                 .pattern = Pattern::kGlyphs},
+                                2},
+                GeneratorParams{{.width = 40,
+                                 .height = 9,
+                                 .bit_count = 16,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .masks = {0x7C00, 0x03E0, 0x001F},
+                                 .header_version = HeaderVersion::kV5},
+                                0},
+                // 32-bit: specialized and generic layouts
+                GeneratorParams{{.width = 70,
+                                 .height = 9,
+                                 .bit_count = 32,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .masks = {0x000000FF, 0x0000FF00, 0x00FF0000},
+                                 .pattern = Pattern::kGradient},
+                                0},
+                GeneratorParams{{.width = 70,
+                                 .height = 9,
+                                 .bit_count = 32,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .masks = {0xFF000000, 0x00FF0000, 0x0000FF00},
+                                 .header_version = HeaderVersion::kV4,
+                                 .pattern = Pattern::kGlyphs},
+                                0},
+                GeneratorParams{{.width = 70,
+                                 .height = 9,
+                                 .bit_count = 32,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .masks = {0x3FF00000, 0x000FFC00, 0x000003FF},
+                                 .header_version = HeaderVersion::kV5,
+                                 .pattern = Pattern::kGradient},
+                                0},
+                GeneratorParams{{.width = 70,
+                                 .height = 9,
+                                 .bit_count = 32,
+                                 .bottom_up = false,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .masks = {0x000003FF, 0x000FFC00, 0x3FF00000}},
+                                0},
+                GeneratorParams{{.width = 70,
+                                 .height = 9,
+                                 .bit_count = 32,
+                                 .compression = util::Compression::BITFIELDS,
+                                 .masks = {0x0001F800, 0x000007E0, 0x1FE00000},
+                                 .pattern = Pattern::kGradient},
+                                0},
+                // Indexed images: all packings and padding values
+                GeneratorParams{{.width = 33, .height = 7, .bit_count = 1}, 3},
+                GeneratorParams{{.width = 64,
+                                 .height = 20,
+                                 .bit_count = 1,
+                                 .header_version = HeaderVersion::kCore,
+                                 .pattern = Pattern::kGlyphs},
+                                0},
+                GeneratorParams{{.width = 9, .height = 11, .bit_count = 4, .bottom_up = false},
+                                3},
+                GeneratorParams{{.width = 70,
+                                 .height = 11,
+                                 .bit_count = 4,
+                                 .header_version = HeaderVersion::kV4,
+                                 .pattern = Pattern::kGradient},
+                                1},
+                GeneratorParams{{.width = 30, .height = 6, .bit_count = 8}, 2},
+                GeneratorParams{{.width = 129,
+                                 .height = 6,
+                                 .bit_count = 8,
+                                 .header_version = HeaderVersion::kCore,
+                                 .pattern = Pattern::kGradient},
+                                3},
+                // RLE: runs, absolute mode and short literals
+                GeneratorParams{{.width = 300,
+                                 .height = 40,
+                                 .bit_count = 8,
+                                 .compression = util::Compression::RLE8,
+                                 .pattern = Pattern::kGlyphs},
+                                0},
+                GeneratorParams{{.width = 301,
+                                 .height = 13,
+                                 .bit_count = 8,
+                                 .compression = util::Compression::RLE8},
+                                3},
+                GeneratorParams{{.width = 77,
+                                 .height = 30,
+                                 .bit_count = 4,
+                                 .compression = util::Compression::RLE4,
+                                 .header_version = HeaderVersion::kV5,
+                                 .pattern = Pattern::kGradient},
+                                1},
+                GeneratorParams{{.width = 300,
+                                 .height = 9,
+                                 .bit_count = 4,
+                                 .compression = util::Compression::RLE4},
+                                2}));
+
+TEST(GeneratorTests, SameOptionsSameContent) {
+    GeneratorOptions const options{.width = 100, .height = 3, .seed = 42};
+    std::vector<Byte> first(BMPGenerator{options}.GetFullScanSize());
+    std::vector<Byte> second(first.size());
+    BMPGenerator{options}.FillRow(1, first.data());
+    BMPGenerator{options}.FillRow(1, second.data());
+    EXPECT_EQ(first, second);
+
+    BMPGenerator{{.width = 100, .height = 3, .seed = 43}}.FillRow(1, second.data());
+    EXPECT_NE(first, second);
+}
+
+TEST(GeneratorTests, RejectsImpossibleOptions) {
+    EXPECT_THROW(BMPGenerator({.width = 10, .height = 10, .bit_count = 12}), InvalidBMPError);
+    EXPECT_THROW(BMPGenerator({.width = 10,
+                               .height = 10,
+                               .bit_count = 16,
+                               .compression = util::Compression::BITFIELDS,
+                               .masks = {0x1F0000, 0x07E0, 0x001F}}),
+                 InvalidBMPError);
+    EXPECT_THROW(BMPGenerator({.width = 10,
+                               .height = 10,
+                               .bit_count = 32,
+                               .compression = util::Compression::BITFIELDS,
+                               .masks = {0xFF00, 0x0FF0, 0x000F}}),
+                 InvalidBMPError);
+    EXPECT_THROW(BMPGenerator({.width = 10,
+                               .height = 10,
+                               .bit_count = 4,
+                               .compression = util::Compression::RLE8}),
+                 InvalidBMPError);
+    EXPECT_THROW(BMPGenerator({.width = 10,
+                               .height = 10,
+                               .compression = util::Compression::BITFIELDS}),
+                 InvalidBMPError);
+    EXPECT_THROW(BMPGenerator({.width = 10,
+                               .height = 10,
+                               .bottom_up = false,
+                               .header_version = HeaderVersion::kCore}),
+                 InvalidBMPError);
+    EXPECT_THROW(BMPGenerator({.width = 70000,
+                               .height = 10,
+                               .header_version = HeaderVersion::kCore}),
+                 InvalidBMPError);
+}
+}  // namespace test
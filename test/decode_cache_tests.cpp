@@ -0,0 +1,231 @@
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <sys/stat.h>
+
+#include "binary_image.h"
+#include "bmp_reader.h"
+#include "decode_cache.h"
+#include "decoded_image.h"
+#include "image_editor.h"
+#include "reader_options.h"
+#include "test_util.h"
+
+using namespace bmp;
+
+namespace test {
+struct DecodeCacheParams {
+    InputMode input_mode;
+    ThresholdMode threshold_mode;
+    Word bit_count;
+};
+
+class DecodeCacheTest : public testing::TestWithParam<DecodeCacheParams> {
+protected:
+    std::string const filename_ = "test_decode_cache_input.bmp";
+    std::string const directory_ = "test_decode_cache_dir";
+
+    void SetUp() override {
+        WriteRandomBMP(filename_, 150, 70, GetParam().bit_count, 5);
+    }
+
+    void TearDown() override {
+        std::remove(filename_.c_str());
+        std::filesystem::remove_all(directory_);
+    }
+
+    ReaderOptions GetOptions(DecodeCache* cache) const {
+        return {.input_mode = GetParam().input_mode,
+                .threshold = {.mode = GetParam().threshold_mode},
+                .decode_cache = cache};
+    }
+
+    BinaryImage Read(DecodeCache* cache) const {
+        BMPReader reader{filename_, GetOptions(cache)};
+        reader.ReadHeaders();
+        reader.ReadData();
+        return reader.GetPixelData();
+    }
+};
+
+TEST_P(DecodeCacheTest, HitMatchesDecoding) {
+    BinaryImage const expected = Read(nullptr);
+    DecodeCache cache;
+    EXPECT_EQ(Read(&cache), expected);
+    EXPECT_EQ(cache.GetStats().misses, 1);
+
+    BMPReader reader{filename_, GetOptions(&cache)};
+    reader.ReadHeaders();
+    reader.ReadData();
+    EXPECT_EQ(reader.GetPixelData(), expected);
+    EXPECT_EQ(cache.GetStats().memory_hits, 1);
+    if constexpr (kStatsEnabled) {
+        EXPECT_EQ(reader.GetStats().pixels_decoded, 0);
+    }
+
+    // Drawing changes reader's copy only
+    reader.DrawCross(0, 0, 149, 69);
+    EXPECT_EQ(Read(&cache), expected);
+}
+
+TEST_P(DecodeCacheTest, EditedDataIsNotCached) {
+    BinaryImage const expected = Read(nullptr);
+    DecodeCache cache{{.directory = directory_}};
+    {
+        BMPReader reader{filename_, GetOptions(&cache)};
+        reader.ReadHeaders();
+        reader.DrawCross(0, 0, 149, 69);
+        reader.ReadData();
+    }
+    EXPECT_EQ(cache.GetStats().memory_hits + cache.GetStats().misses, 0);
+    EXPECT_EQ(Read(&cache), expected);
+    EXPECT_EQ(cache.GetStats().misses, 1);
+}
+
+TEST_P(DecodeCacheTest, PersistsOnDisk) {
+    BinaryImage const expected = Read(nullptr);
+    {
+        DecodeCache cache{{.directory = directory_}};
+        Read(&cache);
+    }
+    DecodeCache cache{{.directory = directory_}};
+    EXPECT_EQ(Read(&cache), expected);
+    EXPECT_EQ(cache.GetStats().disk_hits, 1);
+    EXPECT_EQ(Read(&cache), expected);
+    EXPECT_EQ(cache.GetStats().memory_hits, 1);
+}
+
+TEST_P(DecodeCacheTest, SavesInvalidateEntries) {
+    DecodeCache cache{{.directory = directory_}};
+    // Saves keep size. Modification time is set back, as if they were within its granularity
+    struct stat st;
+    ASSERT_EQ(stat(filename_.c_str(), &st), 0);
+    timespec const times[2] = {st.st_atim, st.st_mtim};
+
+    Read(&cache);
+    {
+        BMPReader reader{filename_, GetOptions(&cache)};
+        reader.ReadHeaders();
+        reader.DrawCross(0, 0, 149, 69);
+        reader.SaveBMP(filename_);
+    }
+    ASSERT_EQ(utimensat(AT_FDCWD, filename_.c_str(), times, 0), 0);
+    {
+        DecodeCache disk_cache{{.directory = directory_}};
+        EXPECT_EQ(Read(&disk_cache), Read(nullptr));
+        EXPECT_EQ(disk_cache.GetStats().misses, 1);
+    }
+    EXPECT_EQ(Read(&cache), Read(nullptr));
+    EXPECT_EQ(cache.GetStats().invalidations, 1);
+
+    ImageEditor editor{DecodedImage::Decode(filename_, GetOptions(&cache))};
+    editor.DrawCross(0, 69, 149, 0);
+    editor.SaveBMP(filename_);
+    ASSERT_EQ(utimensat(AT_FDCWD, filename_.c_str(), times, 0), 0);
+    EXPECT_EQ(Read(&cache), Read(nullptr));
+    EXPECT_EQ(cache.GetStats().invalidations, 2);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        DecodeCacheTests, DecodeCacheTest,
+        testing::Values(DecodeCacheParams{InputMode::kStream, ThresholdMode::kFixed, 24},
+                        DecodeCacheParams{InputMode::kMapped, ThresholdMode::kLuma, 32},
+                        DecodeCacheParams{InputMode::kStream, ThresholdMode::kOtsu, 8},
+                        DecodeCacheParams{InputMode::kMapped, ThresholdMode::kAdaptive, 1}));
+
+TEST(DecodeCacheTests, KeyDependsOnFileAndThreshold) {
+    std::string const filename = "test_decode_cache_key.bmp";
+    WriteRandomBMP(filename, 40, 30, 24, 1);
+    DecodeCache cache;
+    auto read = [&](ThresholdOptions const& threshold) {
+        BMPReader reader{filename, {.threshold = threshold, .decode_cache = &cache}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        return reader.GetPixelData();
+    };
+    read({});
+    read({.max_black_sum = 100});
+    // Luma limit does not apply to fixed threshold
+    read({.max_black_luma = 10});
+    EXPECT_EQ(cache.GetStats().misses, 2);
+    EXPECT_EQ(cache.GetStats().memory_hits, 1);
+
+    // Another image in place of the same file
+    WriteRandomBMP(filename, 41, 30, 24, 2);
+    EXPECT_EQ(read({}).GetWidth(), 41);
+    EXPECT_EQ(cache.GetStats().misses, 3);
+    std::remove(filename.c_str());
+}
+
+TEST(DecodeCacheTests, EvictsLeastRecentlyUsed) {
+    // Every 64x64 image takes 512 bytes
+    DecodeCache cache{{.memory_budget = 1024}};
+    BinaryImage image{64, 64};
+    auto key = [](std::uint64_t inode) {
+        return DecodeKey{util::FileIdentity{.inode = inode}, 64, 64, ThresholdOptions{}};
+    };
+    cache.Insert(key(1), image);
+    cache.Insert(key(2), image);
+    EXPECT_TRUE(cache.Lookup(key(1), image));
+    cache.Insert(key(3), image);
+    EXPECT_EQ(cache.GetMemoryUsed(), 1024);
+    EXPECT_TRUE(cache.Lookup(key(1), image));
+    EXPECT_FALSE(cache.Lookup(key(2), image));
+    EXPECT_TRUE(cache.Lookup(key(3), image));
+    EXPECT_EQ(cache.GetStats().evictions, 1);
+
+    // Too large to be kept
+    DecodeKey const large_key{util::FileIdentity{.inode = 4}, 200, 200, ThresholdOptions{}};
+    cache.Insert(large_key, BinaryImage{200, 200});
+    EXPECT_FALSE(cache.Lookup(large_key, image));
+    EXPECT_EQ(cache.GetMemoryUsed(), 1024);
+}
+
+TEST(DecodeCacheTests, IgnoresBrokenDiskEntries) {
+    std::string const directory = "test_decode_cache_broken";
+    DecodeKey const key{util::FileIdentity{.inode = 7}, 100, 10, ThresholdOptions{}};
+    BinaryImage image{100, 10};
+    image.Set(3, 4);
+    {
+        DecodeCache cache{{.directory = directory}};
+        cache.Insert(key, image);
+    }
+    for (auto const& entry : std::filesystem::recursive_directory_iterator(directory)) {
+        if (entry.is_regular_file()) {
+            std::filesystem::resize_file(entry.path(), 200);
+        }
+    }
+    DecodeCache cache{{.directory = directory}};
+    BinaryImage loaded;
+    EXPECT_FALSE(cache.Lookup(key, loaded));
+    std::filesystem::remove_all(directory);
+}
+
+TEST(DecodeCacheTests, IgnoresEntriesOfAnotherSize) {
+    std::string const directory = "test_decode_cache_size";
+    DecodeKey const key{util::FileIdentity{.inode = 7}, 100, 10, ThresholdOptions{}};
+    {
+        DecodeCache cache{{.directory = directory}};
+        cache.Insert(key, BinaryImage{100, 10});
+    }
+    // Consistent entry of 50x20 image under the key of 100x10 one
+    for (auto const& entry : std::filesystem::recursive_directory_iterator(directory)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::uint64_t const dimensions[] = {50, 20};
+        std::fstream{entry.path(), std::ios::binary | std::ios::in | std::ios::out}
+                .seekp(8)
+                .write(reinterpret_cast<char const*>(dimensions), sizeof(dimensions));
+        std::filesystem::resize_file(entry.path(), 128 + 20 * sizeof(BinaryImage::BitWord));
+    }
+    DecodeCache cache{{.directory = directory}};
+    BinaryImage loaded;
+    EXPECT_FALSE(cache.Lookup(key, loaded));
+    EXPECT_EQ(cache.GetStats().misses, 1);
+    std::filesystem::remove_all(directory);
+}
+}  // namespace test
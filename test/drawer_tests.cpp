@@ -1,9 +1,24 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <iterator>
+#include <random>
+#include <set>
 #include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "bmp_generator.h"
 #include "bmp_reader.h"
+#include "draw_list.h"
 #include "gtest/gtest.h"
 #include "util/field_types.h"
+#include "util/invalid_bmp_error.h"
+#include "util/line_rasterizer.h"
+#include "util/ms_constants.h"
 
 namespace test {
 constexpr static char kWhiteFilename[] = "test_input_data/white.bmp";
@@ -24,13 +39,19 @@ struct CrossParams {
     std::string bmp_filename;
     bmp::DWord x1, y1, x2, y2;
     std::string expected_data;
+    bmp::InputMode input_mode = bmp::InputMode::kStream;
 };
 
+std::string ReadFile(std::string const& filename) {
+    std::ifstream ifs{filename, std::ios::binary};
+    return {std::istreambuf_iterator<char>{ifs}, std::istreambuf_iterator<char>{}};
+}
+
 class CrossTest : public testing::TestWithParam<CrossParams> {};
 
 TEST_P(CrossTest, DrawCross) {
     auto const& param = GetParam();
-    bmp::BMPReader reader{param.bmp_filename};
+    bmp::BMPReader reader{param.bmp_filename, {.input_mode = param.input_mode}};
     reader.ReadHeaders();
     reader.ReadData();
     reader.DrawCross(param.x1, param.y1, param.x2, param.y2);
@@ -51,5 +72,283 @@ TEST_P(CrossTest, DrawCross) {
 }
 
 INSTANTIATE_TEST_SUITE_P(DrawerTests, CrossTest,
-                         testing::Values(CrossParams{kWhiteFilename, 2, 2, 8, 8, kCrossOnWhite}));
+                         testing::Values(CrossParams{kWhiteFilename, 2, 2, 8, 8, kCrossOnWhite},
+                                         CrossParams{kWhiteFilename, 2, 2, 8, 8, kCrossOnWhite,
+                                                     bmp::InputMode::kMapped}));
+
+TEST(DrawerTests, MappedSaveMatchesStream) {
+    auto const original = ReadFile(kWhiteFilename);
+    std::string const stream_output = "test_output_stream.bmp";
+    std::string const mapped_output = "test_output_mapped.bmp";
+
+    bmp::BMPReader stream_reader{kWhiteFilename};
+    stream_reader.ReadHeaders();
+    stream_reader.ReadData();
+    stream_reader.DrawCross(2, 2, 8, 8);
+    stream_reader.SaveBMP(stream_output);
+
+    bmp::BMPReader mapped_reader{kWhiteFilename, {.input_mode = bmp::InputMode::kMapped}};
+    mapped_reader.ReadHeaders();
+    mapped_reader.ReadData();
+    mapped_reader.DrawCross(2, 2, 8, 8);
+    mapped_reader.SaveBMP(mapped_output);
+
+    EXPECT_EQ(ReadFile(mapped_output), ReadFile(stream_output));
+    EXPECT_NE(ReadFile(mapped_output), original);
+    // Edits must not leak into the input file
+    EXPECT_EQ(ReadFile(kWhiteFilename), original);
+
+    std::remove(stream_output.c_str());
+    std::remove(mapped_output.c_str());
+}
+
+constexpr static char kManyPrimitivesOnWhite[] =
+        "#########.\n"
+        "#.......#.\n"
+        "#..###..#.\n"
+        "#..###..#.\n"
+        "#.......#.\n"
+        "#.......#.\n"
+        "#.......#.\n"
+        "#.......#.\n"
+        "#########.\n"
+        ".........#\n";
+
+TEST(DrawerTests, DrawListRoundTrip) {
+    std::string const output = "test_output_draw_list.bmp";
+    for (auto input_mode : {bmp::InputMode::kStream, bmp::InputMode::kMapped}) {
+        bmp::DrawList draw_list;
+        draw_list.AddRect(0, 1, 8, 9);
+        draw_list.AddFilledRect(3, 6, 5, 7);
+        draw_list.AddPoint(9, 0);
+        // Everything outside of image is dropped
+        draw_list.AddPoint(10, 0);
+        draw_list.AddLine(20, 20, 30, 30);
+
+        bmp::BMPReader reader{kWhiteFilename, {.input_mode = input_mode}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        reader.Draw(draw_list);
+
+        std::ostringstream oss;
+        for (auto const& scan : reader.GetPixelData()) {
+            for (auto px : scan) {
+                oss << (px ? '#' : '.');
+            }
+            oss << '\n';
+        }
+        EXPECT_EQ(oss.str(), kManyPrimitivesOnWhite);
+
+        // Saved BMP must contain exactly the same picture
+        reader.SaveBMP(output);
+        bmp::BMPReader saved{output};
+        saved.ReadHeaders();
+        saved.ReadData();
+        EXPECT_EQ(saved.GetPixelData(), reader.GetPixelData());
+    }
+    std::remove(output.c_str());
+}
+
+TEST(DrawerTests, SpansAreMergedAndSorted) {
+    bmp::DrawList draw_list;
+    draw_list.AddLine(5, 3, 1, 3);
+    draw_list.AddLine(0, 0, 3, 1);
+    draw_list.AddPoint(7, 3);
+
+    using Span = bmp::DrawList::Span;
+    std::vector<Span> const expected{{0, 0, 2}, {1, 2, 4}, {3, 1, 6}, {3, 7, 8}};
+    EXPECT_EQ(draw_list.Rasterize(10, 10), expected);
+}
+
+// Reference: every pixel of unclipped line, rounded the same way as in rasterizer
+std::set<std::pair<std::int64_t, std::int64_t>> NaiveLine(std::int64_t x1, std::int64_t y1,
+                                                          std::int64_t x2, std::int64_t y2) {
+    std::set<std::pair<std::int64_t, std::int64_t>> pixels;
+    bool const x_major = std::abs(x2 - x1) >= std::abs(y2 - y1);
+    if (!x_major) {
+        std::swap(x1, y1);
+        std::swap(x2, y2);
+    }
+    if (x1 > x2) {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+    }
+    std::int64_t const dx = x2 - x1;
+    std::int64_t const dy = std::abs(y2 - y1);
+    for (std::int64_t t = 0; t <= dx; ++t) {
+        std::int64_t const k = dx == 0 ? 0 : (2 * dy * t + dx) / (2 * dx);
+        std::int64_t const y = y2 >= y1 ? y1 + k : y1 - k;
+        pixels.insert(x_major ? std::pair{x1 + t, y} : std::pair{y, x1 + t});
+    }
+    return pixels;
+}
+
+TEST(DrawerTests, ClippedLineMatchesUnclipped) {
+    constexpr std::int64_t kWidth = 23;
+    constexpr std::int64_t kHeight = 17;
+    std::mt19937 gen{5};
+    std::uniform_int_distribution<std::int64_t> coord_dist{-40, 60};
+    for (int i = 0; i < 2000; ++i) {
+        std::int64_t const x1 = coord_dist(gen), y1 = coord_dist(gen);
+        std::int64_t const x2 = coord_dist(gen), y2 = coord_dist(gen);
+
+        std::set<std::pair<std::int64_t, std::int64_t>> expected;
+        for (auto const& [x, y] : NaiveLine(x1, y1, x2, y2)) {
+            if (x >= 0 && x < kWidth && y >= 0 && y < kHeight) {
+                expected.emplace(x, y);
+            }
+        }
+
+        std::set<std::pair<std::int64_t, std::int64_t>> actual;
+        std::int64_t prev_y = -1, prev_x_end = -1;
+        bmp::util::RasterizeLine(
+                x1, y1, x2, y2, kWidth, kHeight,
+                [&](std::int64_t y, std::int64_t x_begin, std::int64_t x_end) {
+                    ASSERT_LT(x_begin, x_end);
+                    // Runs of one row are maximal
+                    ASSERT_FALSE(y == prev_y && x_begin == prev_x_end);
+                    prev_y = y;
+                    prev_x_end = x_end;
+                    for (auto x = x_begin; x < x_end; ++x) {
+                        ASSERT_TRUE(actual.emplace(x, y).second) << "pixel is drawn twice";
+                    }
+                });
+        EXPECT_EQ(actual, expected) << "(" << x1 << ", " << y1 << ") - (" << x2 << ", " << y2
+                                    << ")";
+    }
+}
+
+TEST(DrawerTests, HorizontalLineIsOneSpan) {
+    bmp::DrawList draw_list;
+    draw_list.AddLine(100, 2, 3, 2);
+    draw_list.AddLine(4, 1, 4, 100);
+
+    using Span = bmp::DrawList::Span;
+    std::vector<Span> const expected{{1, 4, 5}, {2, 3, 10}, {2, 4, 5}, {3, 4, 5}, {4, 4, 5}};
+    EXPECT_EQ(draw_list.Rasterize(10, 5), expected);
+}
+
+TEST(DrawerTests, IncrementalSave) {
+    std::string const full_output = "test_output_full.bmp";
+    std::string const incremental_output = "test_output_incremental.bmp";
+    std::string const in_place_output = "test_output_in_place.bmp";
+    auto original = ReadFile(kWhiteFilename);
+
+    // Output that holds the original, except for one byte in a scan that is not edited
+    std::size_t const untouched_pos = original.size() - 1;
+    original[untouched_pos] = 'x';
+    std::ofstream{in_place_output, std::ios::binary} << original;
+
+    for (auto input_mode : {bmp::InputMode::kStream, bmp::InputMode::kMapped}) {
+        bmp::BMPReader reader{kWhiteFilename, {.input_mode = input_mode}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        reader.DrawCross(2, 2, 8, 8);
+        reader.DrawCross(0, 0, 1, 1);
+        reader.SaveBMP(full_output);
+        reader.SaveBMP(incremental_output, bmp::SaveMode::kIncremental);
+        reader.SaveBMP(in_place_output, bmp::SaveMode::kInPlace);
+
+        auto const expected = ReadFile(full_output);
+        EXPECT_EQ(ReadFile(incremental_output), expected);
+        auto in_place = ReadFile(in_place_output);
+        EXPECT_EQ(in_place[untouched_pos], 'x') << "untouched scan must not be written";
+        in_place[untouched_pos] = expected[untouched_pos];
+        EXPECT_EQ(in_place, expected);
+    }
+
+    std::remove(full_output.c_str());
+    std::remove(incremental_output.c_str());
+    std::remove(in_place_output.c_str());
+}
+
+TEST(DrawerTests, SaveToInputFile) {
+    std::string const input = "test_save_to_input.bmp";
+    std::string const reference = "test_save_to_input_reference.bmp";
+    auto const original = ReadFile("test_input_data/test1.bmp");
+
+    for (auto input_mode : {bmp::InputMode::kStream, bmp::InputMode::kMapped}) {
+        for (auto mode : {bmp::SaveMode::kFull, bmp::SaveMode::kIncremental}) {
+            std::ofstream{input, std::ios::binary} << original;
+            bmp::BMPReader reader{input, {.input_mode = input_mode}};
+            reader.ReadHeaders();
+            reader.ReadData();
+            reader.DrawCross(1, 1, 8, 8);
+            reader.SaveBMP(reference);
+            // Another path to the same file
+            reader.SaveBMP("./" + input, mode);
+            EXPECT_EQ(ReadFile(input), ReadFile(reference)) << static_cast<int>(mode);
+        }
+    }
+
+    std::remove(input.c_str());
+    std::remove(reference.c_str());
+}
+
+TEST(DrawerTests, DrawBeforeReadData) {
+    for (auto input_mode : {bmp::InputMode::kStream, bmp::InputMode::kMapped}) {
+        for (std::size_t thread_count : {1, 3}) {
+            bmp::ReaderOptions const options{.input_mode = input_mode,
+                                             .thread_count = thread_count};
+            bmp::BMPReader expected{kWhiteFilename, options};
+            expected.ReadHeaders();
+            expected.ReadData();
+            expected.DrawCross(2, 2, 8, 8);
+
+            // Drawn pixels are decoded from edited contents in both modes
+            bmp::BMPReader reader{kWhiteFilename, options};
+            reader.ReadHeaders();
+            reader.DrawCross(2, 2, 8, 8);
+            reader.ReadData();
+            EXPECT_EQ(reader.GetPixelData(), expected.GetPixelData())
+                    << static_cast<int>(input_mode) << ", " << thread_count;
+            EXPECT_EQ(reader.ReadRegion(1, 1, 5, 5), expected.GetPixelData().GetRegion(1, 4, 5, 5))
+                    << static_cast<int>(input_mode) << ", " << thread_count;
+        }
+    }
+}
+
+class IndexedDrawTest : public testing::TestWithParam<bmp::Word> {};
+
+TEST_P(IndexedDrawTest, SavedMatchesPixelData) {
+    std::string const input = "test_indexed_input.bmp";
+    std::string const output = "test_indexed_output.bmp";
+    // Odd width, so that spans start and end in the middle of bytes
+    bmp::BMPGenerator{{.width = 37, .height = 23, .bit_count = GetParam(), .seed = 5}}.Write(
+            input);
+
+    bmp::BMPReader reader{input};
+    reader.ReadHeaders();
+    reader.ReadData();
+    bmp::DrawList draw_list;
+    draw_list.AddCross(1, 2, 35, 20);
+    draw_list.AddFilledRect(3, 4, 30, 6);
+    reader.Draw(draw_list);
+    reader.SaveBMP(output);
+
+    bmp::BMPReader saved{output};
+    saved.ReadHeaders();
+    saved.ReadData();
+    EXPECT_EQ(saved.GetPixelData(), reader.GetPixelData());
+
+    std::remove(input.c_str());
+    std::remove(output.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(DrawerTests, IndexedDrawTest, testing::Values(1, 4, 8));
+
+TEST(DrawerTests, RLEIsReadOnly) {
+    std::string const input = "test_rle_input.bmp";
+    bmp::BMPGenerator{{.width = 20,
+                       .height = 20,
+                       .bit_count = 8,
+                       .compression = bmp::util::Compression::RLE8}}
+            .Write(input);
+
+    bmp::BMPReader reader{input};
+    reader.ReadHeaders();
+    reader.ReadData();
+    EXPECT_THROW(reader.DrawCross(0, 0, 19, 19), bmp::InvalidBMPError);
+    std::remove(input.c_str());
+}
 }  // namespace test
@@ -0,0 +1,252 @@
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binary_image.h"
+#include "bmp_generator.h"
+#include "bmp_reader.h"
+#include "decoded_image.h"
+#include "draw_list.h"
+#include "image_editor.h"
+#include "reader_options.h"
+#include "util/invalid_bmp_error.h"
+
+using namespace bmp;
+
+namespace test {
+static std::string ReadFile(std::string const& filename) {
+    std::ifstream is{filename, std::ios::binary};
+    return {std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+}
+
+struct EditorParams {
+    GeneratorOptions generator;
+    InputMode input_mode;
+};
+
+class ImageEditorTest : public testing::TestWithParam<EditorParams> {
+protected:
+    std::string const filename_ = "test_editor_input.bmp";
+    std::vector<std::string> files_;
+
+    void SetUp() override {
+        BMPGenerator{GetParam().generator}.Write(filename_);
+    }
+
+    void TearDown() override {
+        std::remove(filename_.c_str());
+        for (auto const& filename : files_) {
+            std::remove(filename.c_str());
+        }
+    }
+
+    std::string AddFile(std::string const& filename) {
+        files_.push_back(filename);
+        return filename;
+    }
+
+    /// @brief Annotation number @p i: cross (all of them are different, some go out of the
+    /// image) and bar across the image, that spans several tiles
+    static DrawList GetDrawList(std::size_t i) {
+        DWord const width = GetParam().generator.width;
+        DWord const height = GetParam().generator.height;
+        DrawList draw_list;
+        draw_list.AddCross(i * 7 % width, i * 3 % height, width / 2 + i * 5, height - 1 - i);
+        draw_list.AddFilledRect(i, i + 1, width - 2, i + 2);
+        return draw_list;
+    }
+};
+
+TEST_P(ImageEditorTest, VariantsMatchReader) {
+    constexpr std::size_t kVariants = 4;
+    ReaderOptions const options{.input_mode = GetParam().input_mode};
+    auto const image = DecodedImage::Decode(filename_, options);
+    BinaryImage const original = image->GetPixelData();
+
+    // Editors of one image run concurrently
+    std::vector<std::string> outputs;
+    std::vector<BinaryImage> pixel_data(kVariants);
+    for (std::size_t i = 0; i < kVariants; ++i) {
+        outputs.push_back(AddFile("test_editor_output_" + std::to_string(i) + ".bmp"));
+    }
+    {
+        std::vector<std::jthread> threads;
+        for (std::size_t i = 0; i < kVariants; ++i) {
+            threads.emplace_back([&, i] {
+                ImageEditor editor{image};
+                editor.Draw(GetDrawList(i));
+                editor.SaveBMP(outputs[i]);
+                pixel_data[i] = editor.GetPixelData();
+            });
+        }
+    }
+
+    std::string const reference = AddFile("test_editor_reference.bmp");
+    for (std::size_t i = 0; i < kVariants; ++i) {
+        BMPReader reader{filename_, options};
+        reader.ReadHeaders();
+        reader.ReadData();
+        reader.Draw(GetDrawList(i));
+        reader.SaveBMP(reference);
+        EXPECT_EQ(pixel_data[i], reader.GetPixelData()) << i;
+        EXPECT_EQ(ReadFile(outputs[i]), ReadFile(reference)) << i;
+    }
+    EXPECT_EQ(image->GetPixelData(), original);
+}
+
+TEST_P(ImageEditorTest, CopiesEditedRowsOnly) {
+    auto const image = DecodedImage::Decode(filename_, {.input_mode = GetParam().input_mode});
+    ImageEditor editor{image};
+    editor.DrawCross(0, 2, 5, 6);
+    EXPECT_EQ(editor.GetEditedTileCount(), 5);
+
+    BinaryImage const pixel_data = editor.GetPixelData();
+    for (std::size_t y = 0; y < pixel_data.GetHeight(); ++y) {
+        for (std::size_t x = 0; x < pixel_data.GetWidth(); ++x) {
+            ASSERT_EQ(editor.Get(x, y), pixel_data.Get(x, y)) << x << ", " << y;
+        }
+    }
+
+    // In-place save writes edited scans over a copy of the original
+    std::string const output = AddFile("test_editor_in_place.bmp");
+    std::string const reference = AddFile("test_editor_reference.bmp");
+    ImageEditor{image}.SaveBMP(output);
+    editor.SaveBMP(output, SaveMode::kInPlace);
+    editor.SaveBMP(reference);
+    EXPECT_EQ(ReadFile(output), ReadFile(reference));
+
+    editor.Clear();
+    EXPECT_EQ(editor.GetPixelData(), image->GetPixelData());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        ImageEditorTests, ImageEditorTest,
+        testing::Values(
+                EditorParams{{.width = 61, .height = 37}, InputMode::kStream},
+                EditorParams{{.width = 61, .height = 37, .bit_count = 32, .bottom_up = false},
+                             InputMode::kMapped},
+                EditorParams{{.width = 75, .height = 20, .bit_count = 1}, InputMode::kStream},
+                EditorParams{{.width = 33, .height = 40, .bit_count = 4}, InputMode::kMapped},
+                EditorParams{{.width = 90, .height = 12, .bit_count = 8}, InputMode::kStream},
+                EditorParams{{.width = 64, .height = 64, .bit_count = 16}, InputMode::kMapped}));
+
+TEST(ImageEditorTests, ReleasedImageKeepsReaderEdits) {
+    std::string const filename = "test_editor_release.bmp";
+    BMPGenerator{{.width = 30, .height = 30}}.Write(filename);
+    BMPReader reader{filename};
+    reader.ReadHeaders();
+    reader.ReadData();
+    reader.DrawCross(0, 0, 29, 29);
+    BinaryImage const expected = reader.GetPixelData();
+
+    auto const image = reader.ReleaseImage();
+    EXPECT_EQ(image->GetPixelData(), expected);
+    EXPECT_EQ(image->GetContentsSize(), BMPGenerator({.width = 30, .height = 30}).GetFileSize());
+    EXPECT_EQ(reader.GetFileSize(), 0);
+
+    // Reader is ready for the next file
+    reader.Open(filename);
+    reader.ReadHeaders();
+    reader.ReadData();
+    EXPECT_NE(reader.GetPixelData(), expected);
+    std::remove(filename.c_str());
+}
+
+TEST(ImageEditorTests, SaveToSourceFile) {
+    std::string const input = "test_editor_save_to_source.bmp";
+    std::string const reference = "test_editor_save_to_source_reference.bmp";
+    for (auto input_mode : {InputMode::kStream, InputMode::kMapped}) {
+        // Reader edits before release make contents differ from the source
+        for (bool reader_edits : {false, true}) {
+            BMPGenerator{{.width = 45, .height = 30}}.Write(input);
+            BMPReader reader{input, {.input_mode = input_mode}};
+            reader.ReadHeaders();
+            reader.ReadData();
+            if (reader_edits) {
+                reader.DrawCross(0, 0, 44, 29);
+            }
+            ImageEditor editor{reader.ReleaseImage()};
+            editor.DrawCross(3, 25, 40, 2);
+            editor.SaveBMP(reference);
+            for (auto mode : {SaveMode::kFull, SaveMode::kIncremental}) {
+                // Another path to the same file
+                editor.SaveBMP("./" + input, mode);
+                EXPECT_EQ(ReadFile(input), ReadFile(reference))
+                        << static_cast<int>(input_mode) << ", " << reader_edits << ", "
+                        << static_cast<int>(mode);
+            }
+        }
+    }
+    std::remove(input.c_str());
+    std::remove(reference.c_str());
+}
+
+TEST(ImageEditorTests, EditorsSaveToSourceInTurn) {
+    std::string const input = "test_editor_in_turn.bmp";
+    std::string const reference = "test_editor_in_turn_reference.bmp";
+    for (auto input_mode : {InputMode::kStream, InputMode::kMapped}) {
+        BMPGenerator{{.width = 70, .height = 40}}.Write(input);
+        auto const image = DecodedImage::Decode(input, {.input_mode = input_mode});
+        ImageEditor first{image};
+        first.DrawCross(0, 0, 69, 39);
+        ImageEditor second{image};
+        second.DrawCross(10, 30, 60, 5);
+        second.SaveBMP(reference);
+
+        // Source holds the first cross when the second editor saves, it must be undone
+        first.SaveBMP(input);
+        second.SaveBMP(input, SaveMode::kInPlace);
+        EXPECT_EQ(ReadFile(input), ReadFile(reference)) << static_cast<int>(input_mode);
+    }
+    std::remove(input.c_str());
+    std::remove(reference.c_str());
+}
+
+TEST(ImageEditorTests, ImageDoesNotChangeWithSource) {
+    std::string const input = "test_editor_snapshot.bmp";
+    std::string const pristine = "test_editor_snapshot_pristine.bmp";
+    std::string const output = "test_editor_snapshot_output.bmp";
+    std::string const reference = "test_editor_snapshot_reference.bmp";
+    GeneratorOptions const generator{.width = 70, .height = 40};
+    BMPGenerator{generator}.Write(pristine);
+    for (auto input_mode : {InputMode::kStream, InputMode::kMapped}) {
+        BMPGenerator{generator}.Write(input);
+        auto const image = DecodedImage::Decode(input, {.input_mode = input_mode});
+        ImageEditor first{image};
+        first.DrawCross(0, 0, 69, 39);
+        first.SaveBMP(input);
+
+        // Second editor still sees the original image
+        ImageEditor second{image};
+        second.DrawCross(10, 30, 60, 5);
+        second.SaveBMP(output);
+        BMPReader reader{pristine};
+        reader.ReadHeaders();
+        reader.ReadData();
+        reader.DrawCross(10, 30, 60, 5);
+        reader.SaveBMP(reference);
+        EXPECT_EQ(ReadFile(output), ReadFile(reference)) << static_cast<int>(input_mode);
+        EXPECT_EQ(std::string(reinterpret_cast<char const*>(image->GetContents()),
+                              image->GetContentsSize()),
+                  ReadFile(pristine))
+                << static_cast<int>(input_mode);
+    }
+    for (auto const& filename : {input, pristine, output, reference}) {
+        std::remove(filename.c_str());
+    }
+}
+
+TEST(ImageEditorTests, RLEIsNotEditable) {
+    std::string const filename = "test_editor_rle.bmp";
+    BMPGenerator{{.width = 20, .height = 5, .bit_count = 8, .compression = util::Compression::RLE8}}
+            .Write(filename);
+    ImageEditor editor{DecodedImage::Decode(filename)};
+    EXPECT_THROW(editor.DrawCross(0, 0, 3, 3), InvalidBMPError);
+    std::remove(filename.c_str());
+}
+}  // namespace test
@@ -0,0 +1,158 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "binary_image.h"
+#include "bmp_generator.h"
+#include "bmp_probe.h"
+#include "bmp_reader.h"
+#include "reader_options.h"
+#include "util/file.h"
+#include "util/invalid_bmp_error.h"
+
+using namespace bmp;
+
+namespace test {
+namespace {
+// 24-bit 50000x50000 BMP takes 7.5 GB, scans at the top are past 4 GiB
+constexpr DWord kSize = 50000;
+// Scans at the top of the image are white (the rest is black), except for checkerboard
+// of kBoardSize pixels in the top-left corner
+constexpr std::size_t kWhiteRows = 100;
+constexpr std::size_t kBoardSize = 64;
+
+bool IsBoardBlack(std::size_t x, std::size_t y) {
+    return (x / 3 + y) % 2 == 0;
+}
+
+/// @brief Write sparse 24-bit BMP: only headers and top scans take disk space
+void WriteSparseBMP(std::string const& filename) {
+    BMPGenerator const generator{{.width = kSize, .height = kSize}};
+    util::File const file{filename, O_WRONLY | O_CREAT | O_TRUNC};
+    file.WriteAt(generator.GetHeaders().data(), generator.GetHeaders().size(), 0);
+    std::filesystem::resize_file(filename, generator.GetFileSize());
+
+    std::size_t const full_scan = generator.GetFullScanSize();
+    std::vector<Byte> scan(full_scan);
+    for (std::size_t y = 0; y < kWhiteRows; ++y) {
+        std::memset(scan.data(), 0xFF, kSize * 3);
+        for (std::size_t x = 0; x < kBoardSize && y < kBoardSize; ++x) {
+            if (IsBoardBlack(x, y)) {
+                std::memset(scan.data() + x * 3, 0, 3);
+            }
+        }
+        // Bottom-up: the top row is the last scan
+        std::uint64_t const scan_num = kSize - 1 - y;
+        file.WriteAt(scan.data(), full_scan, generator.GetHeaders().size() + scan_num * full_scan);
+    }
+}
+
+/// @brief Write 24-bit BMP headers alone and patch @p width and @p height fields
+void WriteCraftedHeaders(std::string const& filename, Long width, Long height, Word bit_count) {
+    std::vector<Byte> headers = BMPGenerator{{.width = 1, .height = 1}}.GetHeaders();
+    auto const file_size = static_cast<DWord>(headers.size());
+    std::memcpy(headers.data() + 2, &file_size, sizeof(file_size));
+    std::memcpy(headers.data() + 18, &width, sizeof(width));
+    std::memcpy(headers.data() + 22, &height, sizeof(height));
+    std::memcpy(headers.data() + 28, &bit_count, sizeof(bit_count));
+    std::ofstream{filename, std::ios::binary}.write(reinterpret_cast<char const*>(headers.data()),
+                                                    headers.size());
+}
+}  // namespace
+
+class LargeImageTest : public testing::TestWithParam<InputMode> {
+protected:
+    std::string const filename_ = "test_large_image.bmp";
+
+    void SetUp() override {
+        WriteSparseBMP(filename_);
+    }
+
+    void TearDown() override {
+        std::remove(filename_.c_str());
+    }
+};
+
+TEST_P(LargeImageTest, ReadsHeaders) {
+    BMPReader reader{filename_, {.input_mode = GetParam()}};
+    reader.ReadHeaders();
+    ImportantFields const& fields = reader.GetImportantFields();
+    EXPECT_EQ(fields.width, kSize);
+    EXPECT_EQ(fields.height, kSize);
+    EXPECT_EQ(fields.size_image, std::uint64_t{kSize} * kSize * 3);
+    EXPECT_EQ(reader.GetFileSize(), fields.offset + fields.size_image);
+    EXPECT_EQ(ProbeBMP(filename_), fields);
+}
+
+TEST_P(LargeImageTest, ReadsRegionPast4GiB) {
+    BMPReader reader{filename_, {.input_mode = GetParam()}};
+    reader.ReadHeaders();
+    // Region is top-down, its y is counted from the bottom
+    BinaryImage const region = reader.ReadRegion(0, kSize - kBoardSize, kBoardSize, kBoardSize);
+    for (std::size_t y = 0; y < kBoardSize; ++y) {
+        for (std::size_t x = 0; x < kBoardSize; ++x) {
+            ASSERT_EQ(region.Get(x, y), IsBoardBlack(x, y)) << x << ", " << y;
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(LargeImageTests, LargeImageTest,
+                         testing::Values(InputMode::kStream, InputMode::kMapped));
+
+TEST(LargeImageTests, DrawsAndSavesInPlace) {
+    std::string const filename = "test_large_image_draw.bmp";
+    std::string const output = "test_large_image_draw_output.bmp";
+    WriteSparseBMP(filename);
+    WriteSparseBMP(output);
+    DWord const x = 1000;
+    DWord const y = kSize - kWhiteRows;
+    DWord const size = kWhiteRows;
+
+    // Pixel data is not read: only touched scans are copied and written
+    BMPReader reader{filename, {.input_mode = InputMode::kMapped}};
+    reader.ReadHeaders();
+    reader.DrawCross(x, y, x + size - 1, y + size - 1);
+    reader.SaveBMP(output, SaveMode::kInPlace);
+
+    BMPReader result{output};
+    result.ReadHeaders();
+    BinaryImage const region = result.ReadRegion(x, y, size, size);
+    for (std::size_t row = 0; row < size; ++row) {
+        for (std::size_t col = 0; col < size; ++col) {
+            ASSERT_EQ(region.Get(col, row), col == row || col == size - 1 - row)
+                    << col << ", " << row;
+        }
+    }
+    // Mapping is private, input is not changed
+    BMPReader input{filename};
+    input.ReadHeaders();
+    EXPECT_EQ(input.ReadRegion(x, y, size, size), BinaryImage(size, size));
+
+    std::remove(filename.c_str());
+    std::remove(output.c_str());
+}
+
+TEST(LargeImageTests, RejectsPixelDataPastEndOfFile) {
+    std::string const filename = "test_large_image_crafted.bmp";
+    // Largest dimensions, top-down height of -2^31 and ordinary ones, all with no pixel data
+    for (auto [width, height, bit_count] :
+         {std::tuple<Long, Long, Word>{0x7FFFFFFF, 0x7FFFFFFF, 32},
+          {50000, INT32_MIN, 24},
+          {50000, 50000, 24}}) {
+        WriteCraftedHeaders(filename, width, height, bit_count);
+        EXPECT_THROW(ProbeBMP(filename), InvalidBMPError) << width << "x" << height;
+        for (InputMode mode : {InputMode::kStream, InputMode::kMapped}) {
+            BMPReader reader{filename, {.input_mode = mode}};
+            EXPECT_THROW(reader.ReadHeaders(), InvalidBMPError) << width << "x" << height;
+        }
+    }
+    std::remove(filename.c_str());
+}
+}  // namespace test
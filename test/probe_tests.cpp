@@ -0,0 +1,67 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "bmp_probe.h"
+#include "bmp_reader.h"
+#include "test_util.h"
+#include "util/invalid_bmp_error.h"
+
+using namespace bmp;
+
+namespace test {
+class ProbeTest : public testing::TestWithParam<std::string> {};
+
+TEST_P(ProbeTest, MatchesReader) {
+    BMPReader reader{GetParam()};
+    reader.ReadHeaders();
+    EXPECT_EQ(ProbeBMP(GetParam()), reader.GetImportantFields());
+}
+
+INSTANTIATE_TEST_SUITE_P(ProbeTests, ProbeTest,
+                         testing::Values("test_input_data/test1.bmp", "test_input_data/test2.bmp",
+                                         "test_input_data/white.bmp"));
+
+TEST(ProbeTests, Directory) {
+    std::string const directory = "test_probe_directory";
+    std::filesystem::create_directory(directory);
+    WriteRandomBMP(directory + "/a.bmp", 17, 5, 24, 1);
+    WriteRandomBMP(directory + "/b.bmp", 3, -200, 32, 2);
+    std::ofstream{directory + "/c.txt"} << "not a BMP";
+
+    auto const results = ProbeDirectory(directory, 2);
+    ASSERT_EQ(results.size(), 3);
+    EXPECT_EQ(results[0].filename, directory + "/a.bmp");
+    EXPECT_TRUE(results[0].error.empty());
+    EXPECT_EQ(results[0].fields, ProbeBMP(directory + "/a.bmp"));
+    EXPECT_EQ(results[1].fields.height, 200);
+    EXPECT_FALSE(results[1].fields.bottom_up);
+    EXPECT_FALSE(results[2].error.empty());
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(ProbeTests, TruncatedHeaders) {
+    std::string const filename = "test_probe_truncated.bmp";
+    std::ofstream{filename, std::ios::binary} << "BM";
+    EXPECT_ANY_THROW(ProbeBMP(filename));
+    std::remove(filename.c_str());
+}
+TEST(ProbeTests, RejectsBitfieldsFor24Bit) {
+    std::string const filename = "test_probe_bitfields.bmp";
+    WriteRandomBMP(filename, 10, 10, 24, 1);
+    for (DWord const compression : {static_cast<DWord>(util::Compression::BITFIELDS),
+                                    static_cast<DWord>(util::Compression::ALPHABITFIELDS)}) {
+        // Compression field of info header
+        std::fstream{filename, std::ios::binary | std::ios::in | std::ios::out}
+                .seekp(30)
+                .write(reinterpret_cast<char const*>(&compression), sizeof(compression));
+        EXPECT_THROW(ProbeBMP(filename), InvalidBMPError);
+        BMPReader reader{filename};
+        EXPECT_THROW(reader.ReadHeaders(), InvalidBMPError);
+    }
+    std::remove(filename.c_str());
+}
+}  // namespace test
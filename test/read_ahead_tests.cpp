@@ -0,0 +1,110 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bmp_reader.h"
+#include "reader_options.h"
+#include "test_util.h"
+#include "util/field_types.h"
+#include "util/file.h"
+#include "util/io_error.h"
+#include "util/read_ahead.h"
+
+using namespace bmp;
+
+namespace test {
+class ReadAheadQueueTest : public testing::TestWithParam<bool> {
+protected:
+    std::string const filename_ = "test_read_ahead.bin";
+    std::vector<Byte> contents_;
+
+    void SetUp() override {
+        contents_.resize(100'003);
+        std::mt19937 gen{3};
+        for (Byte& byte : contents_) {
+            byte = static_cast<Byte>(gen());
+        }
+        std::ofstream ofs{filename_, std::ios::binary};
+        ofs.write(reinterpret_cast<char const*>(contents_.data()), contents_.size());
+    }
+
+    void TearDown() override {
+        std::remove(filename_.c_str());
+    }
+};
+
+TEST_P(ReadAheadQueueTest, ReadsBlocksInOrder) {
+    util::File const file{filename_};
+    std::size_t const block = 1000;
+    util::ReadAheadQueue queue{file, 3, block, GetParam()};
+    std::size_t next = 0;
+    for (std::size_t offset = 0; offset < contents_.size(); offset += block) {
+        while (next < contents_.size() && queue.CanPush()) {
+            queue.Push(next, std::min(block, contents_.size() - next));
+            next += block;
+        }
+        std::size_t const size = std::min(block, contents_.size() - offset);
+        Byte const* data = queue.Pop();
+        ASSERT_EQ(std::memcmp(data, contents_.data() + offset, size), 0) << offset;
+    }
+    EXPECT_TRUE(queue.Empty());
+}
+
+TEST_P(ReadAheadQueueTest, ReportsEndOfFile) {
+    util::File const file{filename_};
+    util::ReadAheadQueue queue{file, 2, 100, GetParam()};
+    queue.Push(contents_.size() - 50, 100);
+    EXPECT_THROW(queue.Pop(), IOError);
+}
+
+TEST_P(ReadAheadQueueTest, DestroyedWithReadsInFlight) {
+    util::File const file{filename_};
+    util::ReadAheadQueue queue{file, 4, 30'000, GetParam()};
+    while (queue.CanPush()) {
+        queue.Push(0, 30'000);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(ReadAheadTests, ReadAheadQueueTest, testing::Values(true, false));
+
+struct ReadAheadParams {
+    ReadAhead read_ahead;
+    std::size_t queue_depth;
+    std::size_t block_size;
+};
+
+class ReadAheadReaderTest : public testing::TestWithParam<ReadAheadParams> {};
+
+TEST_P(ReadAheadReaderTest, MatchesBlockReads) {
+    auto const& param = GetParam();
+    std::string const filename = "test_read_ahead.bmp";
+    WriteRandomBMP(filename, 301, -97, 24, 5);
+
+    BMPReader expected{filename, {.block_size = param.block_size}};
+    expected.ReadHeaders();
+    expected.ReadData();
+
+    BMPReader reader{filename,
+                     {.block_size = param.block_size,
+                      .read_ahead = param.read_ahead,
+                      .queue_depth = param.queue_depth}};
+    reader.ReadHeaders();
+    reader.ReadData();
+    EXPECT_EQ(reader.GetPixelData(), expected.GetPixelData());
+    EXPECT_EQ(reader.GetIOCounters().read_calls, expected.GetIOCounters().read_calls);
+    EXPECT_EQ(reader.GetIOCounters().bytes_read, expected.GetIOCounters().bytes_read);
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(ReadAheadTests, ReadAheadReaderTest,
+                         testing::Values(ReadAheadParams{ReadAhead::kIOUring, 4, 5000},
+                                         ReadAheadParams{ReadAhead::kIOUring, 2, 1},
+                                         ReadAheadParams{ReadAhead::kIOUring, 16, 20'000},
+                                         ReadAheadParams{ReadAhead::kThread, 4, 5000},
+                                         ReadAheadParams{ReadAhead::kThread, 1, 1000},
+                                         ReadAheadParams{ReadAhead::kThread, 3, 1 << 20}));
+}  // namespace test
@@ -1,10 +1,14 @@
+#include <cstdio>
 #include <gtest/gtest.h>
 #include <sstream>
 #include <string>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <utility>
 
+#include "bmp_generator.h"
 #include "bmp_reader.h"
+#include "test_util.h"
 #include "util/ms_constants.h"
 
 using namespace bmp;
@@ -52,6 +56,7 @@ INSTANTIATE_TEST_SUITE_P(
                                                  .height = 10,
                                                  .bottom_up = true,
                                                  .byte_count = 3,
+                                                 .bit_count = 24,
                                                  .compression = util::Compression::RGB,
                                                  .size_image = 320,
                                                  .palette_used = false,
@@ -66,23 +71,28 @@ INSTANTIATE_TEST_SUITE_P(
                                                  .height = 10,
                                                  .bottom_up = true,
                                                  .byte_count = 4,
+                                                 .bit_count = 32,
                                                  .compression = util::Compression::BITFIELDS,
                                                  .size_image = 400,
                                                  .palette_used = false,
                                                  .palette_important = 0,
                                                  .padding_bytes = 0,
+                                                 .red_mask = 0x00FF0000,
+                                                 .green_mask = 0x0000FF00,
+                                                 .blue_mask = 0x000000FF,
                                          }}));
 
 struct ReadDataParams {
     std::string bmp_filename;
     std::string expected_data;
+    InputMode input_mode = InputMode::kStream;
 };
 
 class ReadDataTest : public testing::TestWithParam<ReadDataParams> {};
 
 TEST_P(ReadDataTest, ReadData) {
     auto const& param = GetParam();
-    bmp::BMPReader reader{param.bmp_filename};
+    bmp::BMPReader reader{param.bmp_filename, {.input_mode = param.input_mode}};
     reader.ReadHeaders();
     reader.ReadData();
 
@@ -103,5 +113,113 @@ TEST_P(ReadDataTest, ReadData) {
 
 INSTANTIATE_TEST_SUITE_P(ReaderTests, ReadDataTest,
                          testing::Values(ReadDataParams{kTest1Filename, kTestData},
-                                         ReadDataParams{kTest2Filename, kTestData}));
+                                         ReadDataParams{kTest2Filename, kTestData},
+                                         ReadDataParams{kTest1Filename, kTestData,
+                                                        InputMode::kMapped},
+                                         ReadDataParams{kTest2Filename, kTestData,
+                                                        InputMode::kMapped}));
+
+TEST(ReaderTests, MappedHeaders) {
+    BMPReader stream_reader{kTest2Filename};
+    stream_reader.ReadHeaders();
+    BMPReader mapped_reader{kTest2Filename, {.input_mode = InputMode::kMapped}};
+    mapped_reader.ReadHeaders();
+
+    EXPECT_EQ(mapped_reader.GetImportantFields(), stream_reader.GetImportantFields());
+}
+
+struct ParallelReadParams {
+    Long width;
+    Long height;
+    Word bit_count;
+    InputMode input_mode;
+};
+
+class ParallelReadTest : public testing::TestWithParam<ParallelReadParams> {};
+
+TEST_P(ParallelReadTest, MatchesSequential) {
+    auto const& param = GetParam();
+    std::string const filename = "test_parallel_input.bmp";
+    WriteRandomBMP(filename, param.width, param.height, param.bit_count, 7);
+
+    BMPReader sequential{filename};
+    sequential.ReadHeaders();
+    sequential.ReadData();
+
+    for (std::size_t thread_count : {2, 3, 8}) {
+        BMPReader parallel{filename,
+                           {.input_mode = param.input_mode, .thread_count = thread_count}};
+        parallel.ReadHeaders();
+        parallel.ReadData();
+        EXPECT_EQ(parallel.GetPixelData(), sequential.GetPixelData())
+                << thread_count << " threads";
+    }
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        ReaderTests, ParallelReadTest,
+        testing::Values(ParallelReadParams{333, 257, 24, InputMode::kStream},
+                        ParallelReadParams{333, 257, 24, InputMode::kMapped},
+                        ParallelReadParams{129, -100, 32, InputMode::kStream},
+                        ParallelReadParams{129, -100, 32, InputMode::kMapped},
+                        ParallelReadParams{5, 1, 24, InputMode::kMapped}));
+
+TEST(ReaderTests, ReadsWholeScansByBlocks) {
+    std::string const filename = "test_block_input.bmp";
+    // Full scan is 333 * 3 + 1 padding = 1000 bytes
+    WriteRandomBMP(filename, 333, 257, 24, 3);
+
+    BMPReader sequential{filename};
+    sequential.ReadHeaders();
+    sequential.ReadData();
+    EXPECT_EQ(sequential.GetIOCounters().read_calls, 1);
+
+    // Block smaller than one scan still holds one scan, partial scans are not read
+    for (auto [block_size, read_calls] : {std::pair<std::size_t, std::size_t>{1, 257},
+                                          {10'500, 26},
+                                          {257'000, 1}}) {
+        BMPReader reader{filename, {.block_size = block_size}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        EXPECT_EQ(reader.GetPixelData(), sequential.GetPixelData()) << block_size;
+        EXPECT_EQ(reader.GetIOCounters().read_calls, read_calls) << block_size;
+        EXPECT_EQ(reader.GetIOCounters().bytes_read, 257'000) << block_size;
+    }
+    std::remove(filename.c_str());
+}
+
+class IndexedReadTest : public testing::TestWithParam<GeneratorOptions> {};
+
+TEST_P(IndexedReadTest, ModesAgree) {
+    std::string const filename = "test_indexed_input.bmp";
+    BMPGenerator{GetParam()}.Write(filename);
+
+    BMPReader sequential{filename};
+    sequential.ReadHeaders();
+    sequential.ReadData();
+    for (auto input_mode : {InputMode::kStream, InputMode::kMapped}) {
+        BMPReader reader{filename, {.input_mode = input_mode, .thread_count = 3}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        EXPECT_EQ(reader.GetPixelData(), sequential.GetPixelData());
+    }
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        ReaderTests, IndexedReadTest,
+        testing::Values(GeneratorOptions{.width = 100, .height = 50, .bit_count = 1},
+                        GeneratorOptions{.width = 100, .height = 50, .bit_count = 4},
+                        GeneratorOptions{.width = 100, .height = 50, .bit_count = 8},
+                        GeneratorOptions{.width = 100,
+                                         .height = 50,
+                                         .bit_count = 8,
+                                         .compression = util::Compression::RLE8,
+                                         .pattern = Pattern::kGlyphs},
+                        GeneratorOptions{.width = 100,
+                                         .height = 50,
+                                         .bit_count = 4,
+                                         .compression = util::Compression::RLE4,
+                                         .pattern = Pattern::kGradient}));
 }  // namespace test
@@ -0,0 +1,153 @@
+#include <array>
+#include <cstdio>
+#include <filesystem>
+#include <gtest/gtest.h>
+#include <stdexcept>
+#include <string>
+
+#include "binary_image.h"
+#include "bmp_generator.h"
+#include "bmp_reader.h"
+#include "decode_cache.h"
+#include "reader_options.h"
+#include "util/io_error.h"
+#include "util/ms_constants.h"
+
+using namespace bmp;
+
+namespace test {
+struct RegionParams {
+    GeneratorOptions generator;
+    InputMode input_mode;
+    ThresholdMode threshold_mode = ThresholdMode::kFixed;
+    std::size_t block_size = 1 << 20;
+};
+
+class RegionTest : public testing::TestWithParam<RegionParams> {};
+
+TEST_P(RegionTest, MatchesCropOfFullImage) {
+    auto const& param = GetParam();
+    std::string const filename = "test_region.bmp";
+    BMPGenerator{param.generator}.Write(filename);
+    ReaderOptions const options{.input_mode = param.input_mode,
+                                .block_size = param.block_size,
+                                .threshold = {.mode = param.threshold_mode}};
+
+    BMPReader full_reader{filename, options};
+    full_reader.ReadHeaders();
+    full_reader.ReadData();
+    BinaryImage const& full = full_reader.GetPixelData();
+
+    BMPReader reader{filename, options};
+    reader.ReadHeaders();
+    DWord const width = param.generator.width;
+    DWord const height = param.generator.height;
+    // {x, y, width, height}: whole image, corners, odd offsets and single pixels
+    for (auto [x, y, w, h] : {std::array<DWord, 4>{0, 0, width, height},
+                              {0, 0, 1, 1},
+                              {width - 1, height - 1, 1, 1},
+                              {1, 2, 13, 7},
+                              {3, 0, width - 3, 5},
+                              {width / 2 + 1, height / 3, width / 3, height / 2},
+                              {5, 5, 0, 3}}) {
+        BinaryImage const region = reader.ReadRegion(x, y, w, h);
+        // Region rows are top-down, y is counted from the bottom
+        BinaryImage const expected = full.GetRegion(x, height - y - h, w, h);
+        if (param.threshold_mode == ThresholdMode::kFixed || (x == 0 && w == width)) {
+            EXPECT_EQ(region, expected) << x << ", " << y << ", " << w << "x" << h;
+        } else {
+            EXPECT_EQ(region.GetWidth(), w);
+            EXPECT_EQ(region.GetHeight(), h);
+        }
+    }
+    // Pixel data is not touched
+    EXPECT_EQ(reader.GetPixelData(), BinaryImage{});
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        RegionTests, RegionTest,
+        testing::Values(
+                RegionParams{{.width = 101, .height = 40}, InputMode::kStream},
+                // Blocks of a few scans
+                RegionParams{{.width = 101, .height = 40},
+                             InputMode::kStream,
+                             ThresholdMode::kFixed,
+                             1000},
+                RegionParams{{.width = 101, .height = 40, .bottom_up = false}, InputMode::kMapped},
+                RegionParams{{.width = 70, .height = 33, .bit_count = 32}, InputMode::kMapped},
+                RegionParams{{.width = 70,
+                              .height = 33,
+                              .bit_count = 16,
+                              .compression = util::Compression::BITFIELDS},
+                             InputMode::kStream},
+                RegionParams{{.width = 150, .height = 20, .bit_count = 1}, InputMode::kStream},
+                RegionParams{{.width = 150, .height = 20, .bit_count = 1, .bottom_up = false},
+                             InputMode::kMapped},
+                RegionParams{{.width = 77, .height = 21, .bit_count = 4}, InputMode::kStream},
+                RegionParams{{.width = 77, .height = 21, .bit_count = 8}, InputMode::kMapped},
+                RegionParams{{.width = 90,
+                              .height = 30,
+                              .bit_count = 8,
+                              .compression = util::Compression::RLE8,
+                              .pattern = Pattern::kGlyphs},
+                             InputMode::kStream},
+                RegionParams{{.width = 90, .height = 30, .pattern = Pattern::kGradient},
+                             InputMode::kStream,
+                             ThresholdMode::kOtsu,
+                             100},
+                RegionParams{{.width = 90, .height = 30, .bit_count = 1},
+                             InputMode::kMapped,
+                             ThresholdMode::kAdaptive}));
+
+TEST(RegionTests, ReadsOnlyRegionBytes) {
+    std::string const filename = "test_region_io.bmp";
+    BMPGenerator{{.width = 1000, .height = 500}}.Write(filename);
+    BMPReader reader{filename};
+    reader.ReadHeaders();
+    std::size_t const header_bytes = reader.GetIOCounters().bytes_read;
+
+    reader.ReadRegion(400, 200, 16, 10);
+    EXPECT_EQ(reader.GetIOCounters().bytes_read - header_bytes, 16 * 3 * 10);
+    std::remove(filename.c_str());
+}
+
+TEST(RegionTests, RejectsRegionOutsideImage) {
+    std::string const filename = "test_region_bounds.bmp";
+    BMPGenerator{{.width = 10, .height = 10}}.Write(filename);
+    BMPReader reader{filename};
+    reader.ReadHeaders();
+    EXPECT_THROW(reader.ReadRegion(5, 0, 6, 1), std::out_of_range);
+    EXPECT_THROW(reader.ReadRegion(0, 10, 1, 1), std::out_of_range);
+    EXPECT_THROW(reader.ReadRegion(0xFFFFFFFF, 0, 2, 1), std::out_of_range);
+    std::remove(filename.c_str());
+}
+TEST(RegionTests, RLERegionKeepsPixelData) {
+    std::string const filename = "test_region_rle.bmp";
+    BMPGenerator const generator{{.width = 40,
+                                  .height = 20,
+                                  .bit_count = 8,
+                                  .compression = util::Compression::RLE8,
+                                  .pattern = Pattern::kGlyphs}};
+    generator.Write(filename);
+    DecodeCache cache;
+    BMPReader reader{filename, {.decode_cache = &cache}};
+    reader.ReadHeaders();
+    reader.ReadData();
+    BinaryImage const expected = reader.GetPixelData();
+
+    EXPECT_EQ(reader.ReadRegion(3, 4, 20, 10), expected.GetRegion(3, 6, 20, 10));
+    EXPECT_EQ(reader.GetPixelData(), expected);
+    // Region is not a ReadData, and it does not use the cache
+    EXPECT_EQ(cache.GetStats().misses, 1);
+    if constexpr (kStatsEnabled) {
+        EXPECT_EQ(reader.GetStats()[Phase::kReadData].calls, 1);
+    }
+
+    // Pixel data survives failed decoding
+    std::filesystem::resize_file(filename, generator.GetFileSize() / 2);
+    EXPECT_THROW(reader.ReadRegion(0, 0, 5, 5), IOError);
+    EXPECT_EQ(reader.GetPixelData(), expected);
+    std::remove(filename.c_str());
+}
+}  // namespace test
@@ -0,0 +1,158 @@
+#include <cstdint>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <memory_resource>
+#include <string>
+
+#include "binary_image.h"
+#include "bmp_generator.h"
+#include "bmp_reader.h"
+#include "reader_options.h"
+#include "reader_stats.h"
+#include "util/io_error.h"
+#include "util/ms_constants.h"
+
+using namespace bmp;
+
+namespace test {
+/// @brief Counts allocations that reach upstream resource
+class CountingResource : public std::pmr::memory_resource {
+private:
+    std::pmr::memory_resource* upstream_ = std::pmr::new_delete_resource();
+
+protected:
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+        ++allocations;
+        return upstream_->allocate(bytes, alignment);
+    }
+
+    void do_deallocate(void* ptr, std::size_t bytes, std::size_t alignment) override {
+        upstream_->deallocate(ptr, bytes, alignment);
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    std::size_t allocations = 0;
+};
+
+struct ReuseParams {
+    GeneratorOptions generator;
+    InputMode input_mode;
+    ThresholdMode threshold_mode = ThresholdMode::kFixed;
+};
+
+class ReuseTest : public testing::TestWithParam<ReuseParams> {
+protected:
+    std::string const first_ = "test_reuse_first.bmp";
+    std::string const second_ = "test_reuse_second.bmp";
+    std::string const other_size_ = "test_reuse_other_size.bmp";
+
+    ReaderOptions GetOptions() const {
+        return {.input_mode = GetParam().input_mode,
+                .threshold = {.mode = GetParam().threshold_mode}};
+    }
+
+    void SetUp() override {
+        GeneratorOptions options = GetParam().generator;
+        BMPGenerator{options}.Write(first_);
+        options.seed += 1;
+        BMPGenerator{options}.Write(second_);
+        options.width += 33;
+        options.height += 7;
+        BMPGenerator{options}.Write(other_size_);
+    }
+
+    void TearDown() override {
+        for (auto const& filename : {first_, second_, other_size_}) {
+            std::remove(filename.c_str());
+        }
+    }
+
+    BinaryImage ReadWithNewReader(std::string const& filename) const {
+        BMPReader reader{filename, GetOptions()};
+        reader.ReadHeaders();
+        reader.ReadData();
+        return reader.GetPixelData();
+    }
+};
+
+TEST_P(ReuseTest, MatchesNewReaders) {
+    BMPReader reader{GetOptions()};
+    for (auto const& filename : {first_, other_size_, second_, first_}) {
+        reader.Open(filename);
+        reader.ReadHeaders();
+        reader.ReadData();
+        EXPECT_EQ(reader.GetPixelData(), ReadWithNewReader(filename)) << filename;
+    }
+}
+
+TEST_P(ReuseTest, NoAllocationsAfterWarmUp) {
+    CountingResource resource;
+    BMPReader reader{GetOptions(), &resource};
+    for (auto const& filename : {first_, second_}) {
+        reader.Open(filename);
+        reader.ReadHeaders();
+        reader.ReadData();
+    }
+
+    // Heap allocations of the whole test binary (see counting_new.cpp) are counted only around
+    // checked code
+    std::size_t const resource_allocations = resource.allocations;
+    AllocationCounters const& counters = GetAllocationCounters();
+    std::uint64_t const allocations = counters.count;
+    EnableAllocationCounting(true);
+    reader.Open(first_);
+    reader.ReadHeaders();
+    reader.ReadData();
+    EnableAllocationCounting(false);
+    EXPECT_EQ(counters.count - allocations, 0);
+    EXPECT_EQ(resource.allocations, resource_allocations);
+    EXPECT_EQ(reader.GetPixelData(), ReadWithNewReader(first_));
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        ReuseTests, ReuseTest,
+        testing::Values(
+                ReuseParams{{.width = 150, .height = 60}, InputMode::kStream},
+                ReuseParams{{.width = 150, .height = 60, .bottom_up = false},
+                            InputMode::kMapped,
+                            ThresholdMode::kLuma},
+                ReuseParams{{.width = 90, .height = 50, .bit_count = 32}, InputMode::kStream},
+                ReuseParams{{.width = 90, .height = 50, .bit_count = 8},
+                            InputMode::kStream,
+                            ThresholdMode::kOtsu},
+                ReuseParams{{.width = 200, .height = 30, .bit_count = 1},
+                            InputMode::kMapped,
+                            ThresholdMode::kAdaptive},
+                ReuseParams{{.width = 200, .height = 30, .pattern = Pattern::kGradient},
+                            InputMode::kStream,
+                            ThresholdMode::kAdaptive},
+                ReuseParams{{.width = 80,
+                             .height = 40,
+                             .bit_count = 8,
+                             .compression = util::Compression::RLE8,
+                             .pattern = Pattern::kGlyphs},
+                            InputMode::kStream}));
+
+TEST(ReuseTests, ResetForgetsInput) {
+    std::string const filename = "test_reuse_reset.bmp";
+    BMPGenerator{{.width = 20, .height = 10}}.Write(filename);
+    BMPReader reader{filename};
+    reader.ReadHeaders();
+    reader.ReadData();
+    reader.Reset();
+    EXPECT_EQ(reader.GetPixelData(), BinaryImage{});
+    EXPECT_EQ(reader.GetImportantFields(), ImportantFields{});
+
+    // Failed Open leaves reader usable
+    EXPECT_THROW(reader.Open("test_reuse_missing.bmp"), IOError);
+    reader.Open(filename);
+    reader.ReadHeaders();
+    reader.ReadData();
+    EXPECT_EQ(reader.GetPixelData().GetWidth(), 20);
+    std::remove(filename.c_str());
+}
+}  // namespace test
@@ -0,0 +1,82 @@
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <random>
+#include <variant>
+#include <vector>
+
+#include "binary_image.h"
+#include "important_fields.h"
+#include "row_decoders.h"
+#include "scan_decoder.h"
+#include "util/invalid_bmp_error.h"
+#include "util/ms_constants.h"
+
+using namespace bmp;
+
+namespace test {
+struct RegistryParams {
+    ImportantFields fields;
+    std::size_t expected_index;
+};
+
+class RowDecoderRegistryTest : public testing::TestWithParam<RegistryParams> {};
+
+TEST_P(RowDecoderRegistryTest, SelectsDecoder) {
+    auto const& param = GetParam();
+    EXPECT_EQ(MakeRowDecoder(param.fields, {}, 0).index(), param.expected_index);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+        RowDecoderTests, RowDecoderRegistryTest,
+        testing::Values(
+                RegistryParams{{.width = 10, .byte_count = 3, .bit_count = 24}, 0},
+                RegistryParams{{.width = 10,
+                                .byte_count = 4,
+                                .bit_count = 32,
+                                .red_mask = 0x00FF0000,
+                                .green_mask = 0x0000FF00,
+                                .blue_mask = 0x000000FF},
+                               0},
+                RegistryParams{{.width = 10,
+                                .byte_count = 2,
+                                .bit_count = 16,
+                                .red_mask = 0x7C00,
+                                .green_mask = 0x03E0,
+                                .blue_mask = 0x001F},
+                               0},
+                RegistryParams{{.width = 10, .bit_count = 1}, 1},
+                RegistryParams{{.width = 10, .bit_count = 4}, 2},
+                RegistryParams{{.width = 10, .bit_count = 8}, 3},
+                RegistryParams{{.width = 10,
+                                .byte_count = 4,
+                                .bit_count = 32,
+                                .compression = util::Compression::BITFIELDS,
+                                .red_mask = 0x0001F800,
+                                .green_mask = 0x000007E0,
+                                .blue_mask = 0x1FE00000},
+                               4}));
+
+TEST(RowDecoderTests, RejectsUnknownFormat) {
+    EXPECT_THROW(MakeRowDecoder({.width = 10, .bit_count = 2}, {}, 0), InvalidBMPError);
+}
+
+TEST(RowDecoderTests, NegativeRowStrideReversesRows) {
+    ImportantFields const fields{.width = 70, .height = 5, .byte_count = 3, .bit_count = 24};
+    std::size_t const full_scan = 70 * 3 + 2;
+    std::vector<Byte> scans(full_scan * fields.height);
+    std::mt19937 gen{1};
+    for (Byte& byte : scans) {
+        byte = static_cast<Byte>(gen());
+    }
+
+    ScanDecoder const decoder{fields};
+    BinaryImage expected{fields.width, fields.height};
+    for (std::size_t scan = 0; scan < fields.height; ++scan) {
+        decoder.Decode(scans.data() + scan * full_scan, expected.GetRow(fields.height - 1 - scan));
+    }
+    BinaryImage actual{fields.width, fields.height};
+    decoder.DecodeScans(scans.data(), fields.height, full_scan, actual.GetRow(fields.height - 1),
+                        -static_cast<std::ptrdiff_t>(actual.GetStride()));
+    EXPECT_EQ(actual, expected);
+}
+}  // namespace test
@@ -0,0 +1,56 @@
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <string>
+
+#include "binary_image.h"
+#include "bmp_reader.h"
+#include "scanline_reader.h"
+#include "test_util.h"
+
+namespace test {
+struct ScanlineParams {
+    bmp::Long width;
+    bmp::Long height;
+    bmp::Word bit_count;
+    std::size_t batch_scans;
+};
+
+class ScanlineTest : public testing::TestWithParam<ScanlineParams> {};
+
+TEST_P(ScanlineTest, MatchesReader) {
+    auto const& param = GetParam();
+    std::string const filename = "test_scanline_input.bmp";
+    WriteRandomBMP(filename, param.width, param.height, param.bit_count, 11);
+
+    bmp::BMPReader reader{filename};
+    reader.ReadHeaders();
+    reader.ReadData();
+
+    bmp::ScanlineReader scanline_reader{filename, param.batch_scans};
+    scanline_reader.ReadHeaders();
+    EXPECT_EQ(scanline_reader.GetImportantFields(), reader.GetImportantFields());
+    EXPECT_LE(scanline_reader.GetBatch().GetHeight(), param.batch_scans);
+
+    bmp::BinaryImage streamed{reader.GetPixelData().GetWidth(),
+                              reader.GetPixelData().GetHeight()};
+    std::size_t expected_y = 0;
+    scanline_reader.ForEachRow([&](std::size_t y, bmp::BinaryImage::ConstRowView row) {
+        ASSERT_EQ(y, expected_y++);
+        for (std::size_t x = 0; x < row.size(); ++x) {
+            streamed.Set(x, y, row[x]);
+        }
+    });
+    EXPECT_EQ(expected_y, streamed.GetHeight());
+    EXPECT_EQ(streamed, reader.GetPixelData());
+
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(ScanlineTests, ScanlineTest,
+                         testing::Values(ScanlineParams{37, 29, 24, 1},
+                                         ScanlineParams{37, 29, 24, 4},
+                                         ScanlineParams{37, -29, 24, 4},
+                                         ScanlineParams{70, 64, 32, 16},
+                                         ScanlineParams{70, -64, 32, 7},
+                                         ScanlineParams{3, 5, 24, 100}));
+}  // namespace test
@@ -0,0 +1,204 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <set>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "bmp_reader.h"
+#include "reader_options.h"
+#include "server.h"
+#include "test_util.h"
+#include "util/io_error.h"
+
+using namespace bmp;
+
+namespace test {
+class ServerTest : public testing::Test {
+protected:
+    std::string const socket_path_ = "test_server.sock";
+    std::vector<std::string> files_;
+
+    void TearDown() override {
+        for (auto const& filename : files_) {
+            std::remove(filename.c_str());
+        }
+    }
+
+    std::string AddFile(std::string const& filename) {
+        files_.push_back(filename);
+        return filename;
+    }
+
+    static std::string ReadFile(std::string const& filename) {
+        std::ifstream is{filename, std::ios::binary};
+        return {std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+    }
+
+    static std::uint64_t GetId(std::string const& response) {
+        return std::stoull(response.substr(response.find(':') + 1));
+    }
+};
+
+TEST_F(ServerTest, AnswersPipelinedRequests) {
+    Server server{{.socket_path = socket_path_, .thread_count = 3, .max_queued = 2}};
+    std::thread server_thread{[&] { server.Run(); }};
+
+    std::vector<std::string> inputs, outputs;
+    std::vector<std::string> requests;
+    for (unsigned i = 0; i < 8; ++i) {
+        inputs.push_back(AddFile("test_server_input_" + std::to_string(i) + ".bmp"));
+        outputs.push_back(AddFile("test_server_output_" + std::to_string(i) + ".bmp"));
+        WriteRandomBMP(inputs.back(), 40 + 30 * i, 30, i % 2 == 0 ? 24 : 8, i);
+        requests.push_back(i % 2 == 0 ? inputs.back() + ",0,0,30,20," + outputs.back()
+                                       : "{\"input\": \"" + inputs.back() +
+                                                 "\", \"cross\": [0, 0, 30, 20], \"output\": \"" +
+                                                 outputs.back() + "\", \"threshold\": \"otsu\"}");
+    }
+    requests.push_back("test_server_missing.bmp,0,0,1,1,test_server_missing_output.bmp");
+    requests.push_back("not a job");
+
+    {
+        ServerClient client{socket_path_};
+        for (auto const& request : requests) {
+            client.Send(request);
+        }
+        std::set<std::uint64_t> ids;
+        for (std::size_t i = 0; i < requests.size(); ++i) {
+            std::string const response = client.Receive();
+            std::uint64_t const id = GetId(response);
+            ids.insert(id);
+            bool const ok = response.find("\"ok\": true") != std::string::npos;
+            EXPECT_EQ(ok, id < inputs.size()) << response;
+        }
+        EXPECT_EQ(ids.size(), requests.size());
+    }
+
+    std::string const reference = AddFile("test_server_reference.bmp");
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        BMPReader expected{inputs[i], {.threshold = {.mode = i % 2 == 0 ? ThresholdMode::kFixed
+                                                                        : ThresholdMode::kOtsu}}};
+        expected.ReadHeaders();
+        expected.ReadData();
+        expected.DrawCross(0, 0, 30, 20);
+        expected.SaveBMP(reference);
+        EXPECT_EQ(ReadFile(outputs[i]), ReadFile(reference)) << inputs[i];
+    }
+
+    server.Stop();
+    server_thread.join();
+}
+
+TEST_F(ServerTest, StopsWithOpenConnections) {
+    std::string const input = AddFile("test_server_stop_input.bmp");
+    std::string const output = AddFile("test_server_stop_output.bmp");
+    WriteRandomBMP(input, 100, 100, 24, 1);
+
+    Server server{{.socket_path = socket_path_, .thread_count = 2}};
+    std::thread server_thread{[&] { server.Run(); }};
+    ServerClient idle{socket_path_};
+    ServerClient client{socket_path_};
+    client.Send(input + ",0,0,99,99," + output);
+    EXPECT_NE(client.Receive().find("\"ok\": true"), std::string::npos);
+
+    server.Stop();
+    server_thread.join();
+    // Connections are closed by the server
+    EXPECT_THROW(idle.Receive(), IOError);
+}
+
+TEST_F(ServerTest, LimitsConnections) {
+    std::string const input = AddFile("test_server_limit_input.bmp");
+    std::string const output = AddFile("test_server_limit_output.bmp");
+    WriteRandomBMP(input, 20, 20, 24, 1);
+
+    Server server{{.socket_path = socket_path_, .thread_count = 1, .max_connections = 1}};
+    std::thread server_thread{[&] { server.Run(); }};
+    {
+        ServerClient client{socket_path_};
+        client.Send(input + ",0,0,19,19," + output);
+        EXPECT_NE(client.Receive().find("\"ok\": true"), std::string::npos);
+
+        ServerClient rejected{socket_path_};
+        EXPECT_NE(rejected.Receive().find("too many connections"), std::string::npos);
+        EXPECT_THROW(rejected.Receive(), IOError);
+    }
+    // Slot of closed connection is reused once its thread sees the end of stream
+    std::string response;
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        ServerClient client{socket_path_};
+        client.Send(input + ",0,0,19,19," + output);
+        response = client.Receive();
+        if (response.find("too many connections") == std::string::npos) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_NE(response.find("\"ok\": true"), std::string::npos) << response;
+
+    server.Stop();
+    server_thread.join();
+}
+
+TEST_F(ServerTest, DropsClientThatDoesNotRead) {
+    std::string const input = AddFile("test_server_greedy_input.bmp");
+    std::string const output = AddFile("test_server_greedy_output.bmp");
+    WriteRandomBMP(input, 20, 20, 24, 1);
+
+    Server server{{.socket_path = socket_path_, .thread_count = 1, .max_queued_responses = 4}};
+    std::thread server_thread{[&] { server.Run(); }};
+    {
+        // Responses fill socket buffer, then the queue of the connection
+        ServerClient greedy{socket_path_};
+        std::thread sender{[&] {
+            try {
+                for (int i = 0; i < 20'000; ++i) {
+                    greedy.Send("test_server_missing.bmp,0,0,1,1,test_server_missing_out.bmp");
+                }
+            } catch (IOError const&) {
+                // Server disconnected the client
+            }
+        }};
+
+        // Workers are not blocked by the greedy client
+        ServerClient client{socket_path_};
+        client.Send(input + ",0,0,19,19," + output);
+        EXPECT_NE(client.Receive().find("\"ok\": true"), std::string::npos);
+        sender.join();
+
+        std::size_t received = 0;
+        try {
+            while (true) {
+                greedy.Receive();
+                ++received;
+            }
+        } catch (IOError const&) {
+        }
+        EXPECT_LT(received, 20'000);
+    }
+
+    server.Stop();
+    server_thread.join();
+}
+
+TEST(ServerTests, RejectsLargeFrames) {
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+    std::string payload;
+    ASSERT_TRUE(WriteFrame(fds[0], "abc"));
+    ASSERT_TRUE(ReadFrame(fds[1], payload));
+    EXPECT_EQ(payload, "abc");
+
+    unsigned char const header[4] = {0xFF, 0xFF, 0xFF, 0x7F};
+    ASSERT_EQ(write(fds[0], header, sizeof(header)), 4);
+    EXPECT_FALSE(ReadFrame(fds[1], payload));
+    close(fds[0]);
+    EXPECT_FALSE(ReadFrame(fds[1], payload));
+    close(fds[1]);
+}
+}  // namespace test
@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+
+#include "binary_image.h"
+#include "bmp_reader.h"
+#include "reader_options.h"
+#include "reader_stats.h"
+#include "test_util.h"
+
+using namespace bmp;
+
+namespace test {
+class StatsTest : public testing::TestWithParam<InputMode> {
+protected:
+    void SetUp() override {
+        if (!kStatsEnabled) {
+            GTEST_SKIP() << "library is built without statistics";
+        }
+        // Test binary links counting_new.cpp, as CLI does
+        EnableAllocationCounting(true);
+    }
+
+    void TearDown() override {
+        EnableAllocationCounting(false);
+    }
+};
+
+TEST_P(StatsTest, CountsPhases) {
+    std::string const filename = "test_stats_input.bmp";
+    std::string const output = "test_stats_output.bmp";
+    WriteRandomBMP(filename, 100, 40, 24, 1);
+
+    BMPReader reader{filename, {.input_mode = GetParam()}};
+    reader.ReadHeaders();
+    reader.ReadData();
+    reader.ReadRegion(10, 10, 20, 5);
+    reader.DrawCross(0, 0, 99, 39);
+    reader.DrawCross(0, 39, 99, 0);
+    reader.SaveBMP(output, SaveMode::kIncremental);
+
+    ReaderStats const stats = reader.GetStats();
+    EXPECT_EQ(stats[Phase::kReadHeaders].calls, 1);
+    EXPECT_EQ(stats[Phase::kReadData].calls, 1);
+    EXPECT_EQ(stats[Phase::kReadRegion].calls, 1);
+    EXPECT_EQ(stats[Phase::kDraw].calls, 2);
+    EXPECT_EQ(stats[Phase::kSaveBMP].calls, 1);
+    EXPECT_GT(stats[Phase::kReadData].wall_ns, 0);
+    EXPECT_EQ(stats.pixels_decoded, 100 * 40 + 20 * 5);
+    // Every scan is crossed
+    std::size_t const full_scan = 100 * 3;
+    EXPECT_EQ(stats.bytes_written, 40 * full_scan);
+    if (GetParam() == InputMode::kStream) {
+        // Pixel data, region and contents for Draw
+        EXPECT_EQ(stats.read_calls, 1 + 5 + 1);
+        EXPECT_EQ(stats.bytes_read, 40 * full_scan + 5 * 20 * 3 + 54 + 40 * full_scan);
+    } else {
+        EXPECT_EQ(stats.read_calls, 0);
+    }
+    std::remove(filename.c_str());
+    std::remove(output.c_str());
+}
+
+TEST_P(StatsTest, CountsPixelDataAllocation) {
+    std::string const filename = "test_stats_allocation.bmp";
+    WriteRandomBMP(filename, 1000, 300, 24, 2);
+
+    BMPReader reader{filename, {.input_mode = GetParam()}};
+    reader.ReadHeaders();
+    reader.ReadData();
+    // Pixel data is allocated with over-aligned operator new, it is replaced in counting_new.cpp
+    std::size_t const packed_size =
+            BinaryImage::WordsPerRow(1000) * 300 * sizeof(BinaryImage::BitWord);
+    EXPECT_GE(reader.GetStats()[Phase::kReadData].allocated_bytes, packed_size);
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(StatsTests, StatsTest,
+                         testing::Values(InputMode::kStream, InputMode::kMapped));
+
+TEST(StatsTests, PrintsAllPhases) {
+    ReaderStats stats;
+    stats[Phase::kDraw].calls = 3;
+    stats.bytes_written = 12345;
+    for (bool json : {false, true}) {
+        std::ostringstream os;
+        PrintStats(os, stats, json);
+        std::string const text = os.str();
+        for (Phase phase : {Phase::kReadHeaders, Phase::kReadData, Phase::kReadRegion,
+                            Phase::kDraw, Phase::kSaveBMP}) {
+            EXPECT_NE(text.find(GetPhaseName(phase)), std::string::npos) << text;
+        }
+        EXPECT_NE(text.find("12345"), std::string::npos) << text;
+    }
+    std::ostringstream os;
+    PrintStats(os, stats, true);
+    EXPECT_NE(os.str().find("\"Draw\": {\"calls\": 3,"), std::string::npos) << os.str();
+    EXPECT_EQ(os.str().front(), '{');
+}
+}  // namespace test
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdlib>
+#include <string>
+
+#include "bmp_generator.h"
+#include "util/field_types.h"
+
+namespace test {
+/// @brief Write BMP with random pixels. Negative @p height makes top-down BMP
+inline void WriteRandomBMP(std::string const& filename, bmp::Long width, bmp::Long height,
+                           bmp::Word bit_count, unsigned seed) {
+    bmp::BMPGenerator{{.width = static_cast<bmp::DWord>(width),
+                       .height = static_cast<bmp::DWord>(std::abs(height)),
+                       .bit_count = bit_count,
+                       .bottom_up = height > 0,
+                       .seed = seed}}
+            .Write(filename);
+}
+}  // namespace test
@@ -0,0 +1,145 @@
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "binary_image.h"
+#include "util/bitfields_kernel.h"
+#include "util/field_types.h"
+#include "util/threshold_kernel.h"
+
+namespace test {
+using bmp::Byte;
+using bmp::util::SimdLevel;
+
+// Scan is placed right before an inaccessible page, so any read past it crashes
+class GuardedScan {
+private:
+    std::size_t page_size_ = sysconf(_SC_PAGESIZE);
+    std::size_t mapping_size_;
+    Byte* mapping_;
+    Byte* scan_;
+
+public:
+    explicit GuardedScan(std::size_t size) {
+        std::size_t const pages = (size + page_size_ - 1) / page_size_ + 1;
+        mapping_size_ = pages * page_size_;
+        mapping_ = static_cast<Byte*>(mmap(nullptr, mapping_size_, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        mprotect(mapping_ + mapping_size_ - page_size_, page_size_, PROT_NONE);
+        scan_ = mapping_ + mapping_size_ - page_size_ - size;
+    }
+
+    ~GuardedScan() {
+        munmap(mapping_, mapping_size_);
+    }
+
+    Byte* Get() {
+        return scan_;
+    }
+};
+
+struct KernelParams {
+    bmp::Word byte_count;
+    SimdLevel level;
+};
+
+class ThresholdKernelTest : public testing::TestWithParam<KernelParams> {};
+
+TEST_P(ThresholdKernelTest, MatchesScalar) {
+    auto const& param = GetParam();
+    if (param.level > bmp::util::DetectSimdLevel()) {
+        GTEST_SKIP() << "instruction set is not supported by CPU";
+    }
+    auto const scalar = bmp::util::GetThresholdKernel(param.byte_count, SimdLevel::kScalar);
+    auto const kernel = bmp::util::GetThresholdKernel(param.byte_count, param.level);
+
+    std::mt19937 gen{42};
+    std::uniform_int_distribution<int> byte_dist{0, 255};
+    for (std::size_t width : {1, 2, 3, 4, 15, 16, 17, 63, 64, 65, 100, 129, 1000, 1023}) {
+        GuardedScan scan{width * param.byte_count};
+        for (std::size_t i = 0; i < width * param.byte_count; ++i) {
+            scan.Get()[i] = byte_dist(gen);
+        }
+        for (unsigned max_black_sum : {0u, 1u, 122u * 3, 764u, 765u}) {
+            auto const words = bmp::BinaryImage::WordsPerRow(width);
+            std::vector<std::uint64_t> expected(words, ~0ULL), actual(words, ~0ULL);
+            scalar(scan.Get(), width, max_black_sum, expected.data());
+            kernel(scan.Get(), width, max_black_sum, actual.data());
+            EXPECT_EQ(actual, expected) << "width " << width << ", sum " << max_black_sum;
+
+            // Check scalar kernel itself
+            for (std::size_t x = 0; x < width; ++x) {
+                Byte const* px = scan.Get() + x * param.byte_count;
+                bool const black = unsigned{px[0]} + px[1] + px[2] <= max_black_sum;
+                ASSERT_EQ((expected[x / 64] >> (x % 64)) & 1, black) << "x " << x;
+            }
+            if (width % 64 != 0) {
+                EXPECT_EQ(expected.back() >> (width % 64), 0) << "padding bits must be zero";
+            }
+        }
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(KernelTests, ThresholdKernelTest,
+                         testing::Values(KernelParams{3, SimdLevel::kScalar},
+                                         KernelParams{3, SimdLevel::kSSE2},
+                                         KernelParams{3, SimdLevel::kAVX2},
+                                         KernelParams{3, SimdLevel::kAVX512},
+                                         KernelParams{4, SimdLevel::kScalar},
+                                         KernelParams{4, SimdLevel::kSSE2},
+                                         KernelParams{4, SimdLevel::kAVX2},
+                                         KernelParams{4, SimdLevel::kAVX512}));
+
+struct BitfieldsParams {
+    bmp::Word byte_count;
+    bmp::util::ChannelMasks masks;
+};
+
+class BitfieldsKernelTest : public testing::TestWithParam<BitfieldsParams> {};
+
+TEST_P(BitfieldsKernelTest, MatchesLayout) {
+    auto const& param = GetParam();
+    auto const kernel = bmp::util::GetBitfieldsKernel(param.byte_count, param.masks);
+    auto const luma = bmp::util::GetLumaKernel(param.byte_count, param.masks);
+    ASSERT_NE(kernel, nullptr);
+    ASSERT_NE(luma, nullptr);
+    bmp::util::BitfieldsLayout const layout{param.byte_count, param.masks};
+
+    std::mt19937 gen{7};
+    std::uniform_int_distribution<int> byte_dist{0, 255};
+    for (std::size_t width : {1, 3, 63, 64, 65, 1000}) {
+        GuardedScan scan{width * param.byte_count};
+        for (std::size_t i = 0; i < width * param.byte_count; ++i) {
+            scan.Get()[i] = byte_dist(gen);
+        }
+        for (unsigned max_black_sum : {0u, 122u * 3, 765u}) {
+            auto const words = bmp::BinaryImage::WordsPerRow(width);
+            std::vector<std::uint64_t> expected(words, ~0ULL), actual(words, ~0ULL);
+            layout.Threshold(scan.Get(), width, max_black_sum, expected.data());
+            kernel(scan.Get(), width, max_black_sum, actual.data());
+            EXPECT_EQ(actual, expected) << "width " << width << ", sum " << max_black_sum;
+        }
+
+        std::vector<Byte> expected_luma(width), actual_luma(width);
+        layout.Luma(scan.Get(), width, expected_luma.data());
+        luma(scan.Get(), width, actual_luma.data());
+        EXPECT_EQ(actual_luma, expected_luma) << "width " << width;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(KernelTests, BitfieldsKernelTest,
+                         testing::Values(BitfieldsParams{3, {0x00FF0000, 0x0000FF00, 0xFF}},
+                                         BitfieldsParams{2, {0xF800, 0x07E0, 0x001F}},
+                                         BitfieldsParams{2, {0x7C00, 0x03E0, 0x001F}},
+                                         BitfieldsParams{2, {0x001F, 0x07E0, 0xF800}},
+                                         BitfieldsParams{4, {0x00FF0000, 0x0000FF00, 0xFF}},
+                                         BitfieldsParams{4, {0xFF, 0x0000FF00, 0x00FF0000}},
+                                         BitfieldsParams{4, {0xFF000000, 0x00FF0000, 0xFF00}},
+                                         BitfieldsParams{4, {0x3FF00000, 0x000FFC00, 0x3FF}},
+                                         BitfieldsParams{4, {0x3FF, 0x000FFC00, 0x3FF00000}}));
+}  // namespace test
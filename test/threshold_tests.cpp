@@ -0,0 +1,239 @@
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "binary_image.h"
+#include "bmp_generator.h"
+#include "bmp_reader.h"
+#include "reader_options.h"
+#include "threshold.h"
+#include "util/color.h"
+#include "util/invalid_bmp_error.h"
+#include "util/ms_constants.h"
+
+using namespace bmp;
+
+namespace test {
+using ColorFunction = std::function<util::RGBColor(std::size_t x, std::size_t y)>;
+
+/// @brief Write top-down 24-bit BMP with pixels from @p color
+void WriteBMP(std::string const& filename, DWord width, DWord height, ColorFunction const& color) {
+    BMPGenerator const generator{{.width = width, .height = height, .bottom_up = false}};
+    std::ofstream ofs{filename, std::ios::binary};
+    auto const& headers = generator.GetHeaders();
+    ofs.write(reinterpret_cast<char const*>(headers.data()), headers.size());
+    std::vector<Byte> scan(generator.GetFullScanSize());
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            util::RGBColor const pixel = color(x, y);
+            scan[x * 3] = pixel.blue;
+            scan[x * 3 + 1] = pixel.green;
+            scan[x * 3 + 2] = pixel.red;
+        }
+        ofs.write(reinterpret_cast<char const*>(scan.data()), scan.size());
+    }
+}
+
+util::RGBColor Gray(unsigned value) {
+    auto const byte = static_cast<Byte>(value);
+    return {byte, byte, byte};
+}
+
+// Sparse dots on dim or unevenly lit background
+bool IsDot(std::size_t x, std::size_t y) {
+    return x % 7 == 3 && y % 5 == 2;
+}
+
+BinaryImage GetDots(std::size_t width, std::size_t height) {
+    BinaryImage dots{width, height};
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            dots.Set(x, y, IsDot(x, y));
+        }
+    }
+    return dots;
+}
+
+TEST(ThresholdTests, OtsuSeparatesPeaks) {
+    LumaHistogram histogram{};
+    histogram[20] = 100;
+    histogram[21] = 50;
+    histogram[50] = 1000;
+    histogram[52] = 300;
+    Byte const threshold = GetOtsuThreshold(histogram);
+    EXPECT_GE(threshold, 21);
+    EXPECT_LT(threshold, 50);
+}
+
+TEST(ThresholdTests, OtsuOfUniformImage) {
+    LumaHistogram histogram{};
+    histogram[77] = 10;
+    EXPECT_EQ(GetOtsuThreshold(histogram), 0);
+}
+
+TEST(ThresholdTests, AdaptiveHandlesGradient) {
+    std::size_t const width = 200;
+    std::size_t const height = 60;
+    std::vector<Byte> luma(width * height);
+    for (std::size_t y = 0; y < height; ++y) {
+        for (std::size_t x = 0; x < width; ++x) {
+            unsigned const background = 60 + x * 160 / width;
+            luma[y * width + x] = static_cast<Byte>(IsDot(x, y) ? background / 2 : background);
+        }
+    }
+    BinaryImage image{width, height};
+    ThresholdAdaptive(luma.data(), {.mode = ThresholdMode::kAdaptive, .adaptive_window = 15},
+                      image);
+    EXPECT_EQ(image, GetDots(width, height));
+}
+
+struct ThresholdModeParams {
+    InputMode input_mode;
+    std::size_t thread_count;
+};
+
+class ThresholdModeTest : public testing::TestWithParam<ThresholdModeParams> {
+protected:
+    ReaderOptions GetOptions(ThresholdOptions const& threshold) const {
+        return {.input_mode = GetParam().input_mode,
+                .thread_count = GetParam().thread_count,
+                .block_size = 4096,
+                .threshold = threshold};
+    }
+};
+
+TEST_P(ThresholdModeTest, OtsuFindsTextOnDimBackground) {
+    std::string const filename = "test_threshold_dim.bmp";
+    WriteBMP(filename, 150, 90, [](std::size_t x, std::size_t y) {
+        return Gray(IsDot(x, y) ? 15 + x % 3 : 45 + y % 4);
+    });
+
+    BMPReader fixed_reader{filename, GetOptions({})};
+    fixed_reader.ReadHeaders();
+    fixed_reader.ReadData();
+    // Background is too dark for the default threshold
+    EXPECT_NE(fixed_reader.GetPixelData(), GetDots(150, 90));
+
+    BMPReader reader{filename, GetOptions({.mode = ThresholdMode::kOtsu})};
+    reader.ReadHeaders();
+    reader.ReadData();
+    EXPECT_EQ(reader.GetPixelData(), GetDots(150, 90));
+    std::remove(filename.c_str());
+}
+
+TEST_P(ThresholdModeTest, AdaptiveFindsTextUnderUnevenLight) {
+    std::string const filename = "test_threshold_uneven.bmp";
+    WriteBMP(filename, 210, 70, [](std::size_t x, std::size_t y) {
+        unsigned const background = 40 + (x + y) * 180 / 280;
+        return Gray(IsDot(x, y) ? background * 2 / 5 : background);
+    });
+
+    BMPReader reader{filename,
+                     GetOptions({.mode = ThresholdMode::kAdaptive, .adaptive_window = 21})};
+    reader.ReadHeaders();
+    reader.ReadData();
+    EXPECT_EQ(reader.GetPixelData(), GetDots(210, 70));
+    std::remove(filename.c_str());
+}
+
+TEST_P(ThresholdModeTest, LumaWeightsChannels) {
+    std::string const filename = "test_threshold_luma.bmp";
+    // Same channel sums, different luma: green is the brightest channel, blue is the darkest
+    auto color = [](std::size_t x, std::size_t y) -> util::RGBColor {
+        switch ((x + y) % 3) {
+            case 0:
+                return {.blue = 0, .green = 200, .red = 0};
+            case 1:
+                return {.blue = 200, .green = 0, .red = 0};
+            default:
+                return {.blue = 0, .green = 0, .red = 200};
+        }
+    };
+    WriteBMP(filename, 70, 30, color);
+
+    BMPReader reader{filename,
+                     GetOptions({.mode = ThresholdMode::kLuma, .max_black_luma = 100})};
+    reader.ReadHeaders();
+    reader.ReadData();
+    BinaryImage expected{70, 30};
+    for (std::size_t y = 0; y < 30; ++y) {
+        for (std::size_t x = 0; x < 70; ++x) {
+            util::RGBColor const pixel = color(x, y);
+            expected.Set(x, y, util::GetLuma(pixel.red, pixel.green, pixel.blue) <= 100);
+        }
+    }
+    EXPECT_EQ(reader.GetPixelData(), expected);
+    std::remove(filename.c_str());
+}
+
+INSTANTIATE_TEST_SUITE_P(ThresholdTests, ThresholdModeTest,
+                         testing::Values(ThresholdModeParams{InputMode::kStream, 1},
+                                         ThresholdModeParams{InputMode::kMapped, 1},
+                                         ThresholdModeParams{InputMode::kStream, 3},
+                                         ThresholdModeParams{InputMode::kMapped, 3}));
+
+/// @brief Luma of pixel @p x of generated 8-bit (gray palette) or 16-bit RGB565 scan
+Byte GetGeneratedLuma(BMPGenerator const& generator, Word bit_count, Byte const* scan,
+                      std::size_t x) {
+    if (bit_count == 8) {
+        util::RGBColor const color = generator.GetPalette()[scan[x]];
+        return util::GetLuma(color.red, color.green, color.blue);
+    }
+    unsigned const pixel = scan[x * 2] | scan[x * 2 + 1] << 8;
+    auto scale = [](unsigned value, unsigned max) {
+        return static_cast<Byte>((value * 255 + max / 2) / max);
+    };
+    return util::GetLuma(scale(pixel >> 11, 31), scale((pixel >> 5) & 63, 63),
+                         scale(pixel & 31, 31));
+}
+
+TEST(ThresholdTests, LumaOfIndexedAndMaskedPixels) {
+    std::string const filename = "test_threshold_formats.bmp";
+    for (GeneratorOptions const& options :
+         {GeneratorOptions{.width = 77, .height = 9, .bit_count = 8, .pattern = Pattern::kGradient},
+          GeneratorOptions{.width = 77,
+                           .height = 9,
+                           .bit_count = 16,
+                           .compression = util::Compression::BITFIELDS,
+                           .pattern = Pattern::kGradient},
+          GeneratorOptions{.width = 77,
+                           .height = 9,
+                           .bit_count = 8,
+                           .compression = util::Compression::RLE8,
+                           .pattern = Pattern::kGradient}}) {
+        BMPGenerator const generator{options};
+        generator.Write(filename);
+        BinaryImage expected{options.width, options.height};
+        std::vector<Byte> scan(generator.GetFullScanSize());
+        for (std::size_t y = 0; y < options.height; ++y) {
+            generator.FillRow(y, scan.data());
+            for (std::size_t x = 0; x < options.width; ++x) {
+                expected.Set(x, y,
+                             GetGeneratedLuma(generator, options.bit_count, scan.data(), x) <= 90);
+            }
+        }
+
+        BMPReader reader{filename, {.threshold = {.mode = ThresholdMode::kLuma,
+                                                  .max_black_luma = 90}}};
+        reader.ReadHeaders();
+        reader.ReadData();
+        EXPECT_EQ(reader.GetPixelData(), expected) << options.bit_count << "-bit";
+    }
+    std::remove(filename.c_str());
+}
+
+TEST(ThresholdTests, RLEDoesNotSupportGlobalModes) {
+    std::string const filename = "test_threshold_rle.bmp";
+    BMPGenerator{{.width = 20, .height = 5, .bit_count = 8, .compression = util::Compression::RLE8}}
+            .Write(filename);
+    for (ThresholdMode mode : {ThresholdMode::kOtsu, ThresholdMode::kAdaptive}) {
+        BMPReader reader{filename, {.threshold = {.mode = mode}}};
+        reader.ReadHeaders();
+        EXPECT_THROW(reader.ReadData(), InvalidBMPError);
+    }
+    std::remove(filename.c_str());
+}
+}  // namespace test